@@ -26,6 +26,8 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/utsname.h>
+#include <sys/wait.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +50,9 @@
 #include "../core/runtime.h"
 #include "../core/cmp.h"
 #include "../core/eval.h"
+#include "../core/pool.h"
+#include "../core/ipc.h"
+#include "../core/serde.h"
 
 #define MAX_SCRIPT_NAME 256
 #define MAX_SCRIPT_CONTENT 8192
@@ -65,6 +70,11 @@
 #define MAX_GIT_COMMIT 64
 #define MAX_VERSION_STR 128
 #define MAX_PATH_LEN 512
+#define BENCH_IPC_PORT 15123
+#define BENCH_IPC_PATH "/tmp/rayforce.bench.sock"
+#define BENCH_IPC_BATCH 1000   // async messages per call of ipc_async
+#define BENCH_IPC_CLIENTS 8    // client processes of ipc_clients
+#define BENCH_IPC_ROUNDS 100   // round trips of each of them per call
 
 typedef struct {
     char name[MAX_SCRIPT_NAME];
@@ -80,6 +90,10 @@ typedef struct {
     double max_time;
     double avg_time;
     double expected_time;  // in milliseconds
+    double p50_time;       // micro benchmarks only, in milliseconds
+    double p99_time;
+    double rate;       // operations per second, micro benchmarks that set ops only
+    double bandwidth;  // MB per second, micro benchmarks that count bytes only
     char timestamp[MAX_TIMESTAMP];
     char os_info[MAX_OS_INFO];
     char cpu_info[MAX_CPU_INFO];
@@ -91,6 +105,18 @@ typedef struct {
     int result_count;
 } bench_results_t;
 
+// Micro benchmarks drive internals that scripts can't reach, one call per iteration
+typedef void (*bench_micro_fn)(void);
+
+typedef struct {
+    const char* name;
+    bench_micro_fn fn;
+    int iterations;
+    bench_micro_fn setup;     // runs before the runtime is created, may be NULL
+    bench_micro_fn teardown;  // runs before the runtime is destroyed, may be NULL
+    int ops;                  // operations per call, for the rate, may be 0
+} bench_micro_t;
+
 // Function declarations
 void get_system_info(char* os_info, size_t os_size, char* cpu_info, size_t cpu_size);
 void get_git_commit(char* commit_hash, size_t hash_size);
@@ -101,9 +127,12 @@ void save_results(bench_results_t* results);
 void compare_and_print_results(bench_result_t* current, bench_result_t* previous);
 void print_colored_diff(double current, double previous);
 void print_expected_time_diff(double actual, double expected);
+void print_colored_gain(double current, double previous);
+void print_micro_metrics(bench_result_t* current, bench_result_t* previous);
 void scan_benchmark_scripts(bench_results_t* results);
 void process_script_file(const char* filename, bench_results_t* results);
 void print_system_info(bench_result_t* result);
+bool process_micro(const char* name, bench_results_t* results);
 
 // Get system information
 void get_system_info(char* os_info, size_t os_size, char* cpu_info, size_t cpu_size) {
@@ -300,6 +329,14 @@ void load_previous_results(bench_results_t* results) {
             results->results[current_result].avg_time = atof(strchr(start, ':') + 1);
         } else if (strstr(start, "\"expected_time\":")) {
             results->results[current_result].expected_time = atof(strchr(start, ':') + 1);
+        } else if (strstr(start, "\"p50_time\":")) {
+            results->results[current_result].p50_time = atof(strchr(start, ':') + 1);
+        } else if (strstr(start, "\"p99_time\":")) {
+            results->results[current_result].p99_time = atof(strchr(start, ':') + 1);
+        } else if (strstr(start, "\"rate\":")) {
+            results->results[current_result].rate = atof(strchr(start, ':') + 1);
+        } else if (strstr(start, "\"bandwidth\":")) {
+            results->results[current_result].bandwidth = atof(strchr(start, ':') + 1);
         } else if (strstr(start, "\"timestamp\":")) {
             char* timestamp = strchr(start, ':');
             if (timestamp) {
@@ -403,6 +440,16 @@ void save_results(bench_results_t* results) {
         if (existing_results.results[i].expected_time > 0) {
             fprintf(file, "      \"expected_time\": %.3f,\n", existing_results.results[i].expected_time);
         }
+        if (existing_results.results[i].p50_time > 0) {
+            fprintf(file, "      \"p50_time\": %.4f,\n", existing_results.results[i].p50_time);
+            fprintf(file, "      \"p99_time\": %.4f,\n", existing_results.results[i].p99_time);
+        }
+        if (existing_results.results[i].rate > 0) {
+            fprintf(file, "      \"rate\": %.1f,\n", existing_results.results[i].rate);
+        }
+        if (existing_results.results[i].bandwidth > 0) {
+            fprintf(file, "      \"bandwidth\": %.1f,\n", existing_results.results[i].bandwidth);
+        }
         fprintf(file, "      \"timestamp\": \"%s\",\n", existing_results.results[i].timestamp);
         fprintf(file, "      \"os_info\": \"%s\",\n", existing_results.results[i].os_info);
         fprintf(file, "      \"cpu_info\": \"%s\",\n", existing_results.results[i].cpu_info);
@@ -441,6 +488,7 @@ void compare_and_print_results(bench_result_t* current, bench_result_t* previous
         printf("  %sExp Time:%s %.3f ms ", BLUE, RESET, current->expected_time);
         print_colored_diff(current->avg_time, current->expected_time);
         printf("\n");
+        print_micro_metrics(current, previous);
         printf("\n");
 
         // Print summary
@@ -462,6 +510,7 @@ void compare_and_print_results(bench_result_t* current, bench_result_t* previous
         printf("  %sMax Time:%s %.3f ms %s(new)%s\n", BLUE, RESET, current->max_time, GREEN, RESET);
         printf("  %sAvg Time:%s %.3f ms %s(new)%s\n", BLUE, RESET, current->avg_time, GREEN, RESET);
         printf("  %sExp Time:%s %.3f ms\n", BLUE, RESET, current->expected_time);
+        print_micro_metrics(current, NULL);
         printf("\n%sSummary:%s First run of this benchmark\n", MAGENTA, RESET);
     }
 
@@ -498,6 +547,47 @@ void print_colored_diff(double current, double previous) {
     }
 }
 
+// Same as print_colored_diff, for metrics where higher is better
+void print_colored_gain(double current, double previous) {
+    double diff = ((current - previous) / previous) * 100.0;
+    if (diff > 0) {
+        printf("%s+%.1f%%%s", GREEN, diff, RESET);
+    } else if (diff < 0) {
+        printf("%s%.1f%%%s", RED, diff, RESET);
+    } else {
+        printf("%s0.0%%%s", YELLOW, RESET);
+    }
+}
+
+// Percentiles, rate and bandwidth, for the results that have them
+void print_micro_metrics(bench_result_t* current, bench_result_t* previous) {
+    if (current->p50_time > 0) {
+        printf("  %sP50 Time:%s %.4f ms ", BLUE, RESET, current->p50_time);
+        if (previous && previous->p50_time > 0)
+            print_colored_diff(current->p50_time, previous->p50_time);
+        printf("\n");
+
+        printf("  %sP99 Time:%s %.4f ms ", BLUE, RESET, current->p99_time);
+        if (previous && previous->p99_time > 0)
+            print_colored_diff(current->p99_time, previous->p99_time);
+        printf("\n");
+    }
+
+    if (current->rate > 0) {
+        printf("  %sRate:%s     %.0f ops/s ", BLUE, RESET, current->rate);
+        if (previous && previous->rate > 0)
+            print_colored_gain(current->rate, previous->rate);
+        printf("\n");
+    }
+
+    if (current->bandwidth > 0) {
+        printf("  %sBandwidth:%s %.1f MB/s ", BLUE, RESET, current->bandwidth);
+        if (previous && previous->bandwidth > 0)
+            print_colored_gain(current->bandwidth, previous->bandwidth);
+        printf("\n");
+    }
+}
+
 void print_expected_time_diff(double actual, double expected) {
     double diff = ((actual - expected) / expected) * 100.0;
     if (fabs(diff) < 5.0) {
@@ -509,6 +599,344 @@ void print_expected_time_diff(double actual, double expected) {
     }
 }
 
+static obj_p bench_empty_task(void) { return NULL_OBJ; }
+
+// An empty task per executor: what's left is the cost of waking executors up and waiting for them
+static void bench_pool_run(void) {
+    pool_p pool = pool_get();
+    i64_t i, n = pool_get_executors_count(pool);
+
+    pool_prepare(pool);
+    for (i = 0; i < n; i++)
+        pool_add_task(pool, (raw_p)bench_empty_task, 0);
+
+    drop_obj(pool_run(pool));
+}
+
+// IPC over loopback with a server forked off before the runtime exists, over TCP, a unix socket or shared memory
+// rings: round trips of a small sync request, batches of async messages, a large table, and several clients at once
+static pid_t __BENCH_SERVER = -1;
+static i64_t __BENCH_HANDLE = -1;
+static sock_addr_t __BENCH_ADDR;
+static lit_p __BENCH_INIT = NULL;  // evaluated by the server before it serves, may be NULL
+static i64_t __BENCH_BYTES = 0;    // bytes received by the micro benchmark that runs
+static pid_t __BENCH_CLIENTS[BENCH_IPC_CLIENTS];
+static int __BENCH_GO[BENCH_IPC_CLIENTS];  // a byte written starts a call of the client
+static int __BENCH_DONE = -1;              // each client writes a byte when its call is over
+static int __BENCH_CLIENTS_COUNT = 0;
+
+static void bench_ipc_serve(void) {
+    i64_t id;
+    obj_p v;
+
+    __BENCH_HANDLE = -1;
+    __BENCH_SERVER = fork();
+    if (__BENCH_SERVER != 0)
+        return;
+
+    runtime_create(0, NULL);
+    if (__BENCH_INIT != NULL) {
+        v = eval_str(__BENCH_INIT);
+        if (IS_ERR(v))
+            _exit(1);
+        drop_obj(v);
+    }
+
+    if (__BENCH_ADDR.local)
+        id = ipc_listen_local(runtime_get()->poll, __BENCH_ADDR.ip);
+    else
+        id = ipc_listen(runtime_get()->poll, __BENCH_ADDR.port);
+
+    if (id != -1)
+        poll_run(runtime_get()->poll);
+
+    _exit(id == -1);
+}
+
+static void bench_ipc_tcp_setup(void) {
+    strcpy(__BENCH_ADDR.ip, "127.0.0.1");
+    __BENCH_ADDR.port = BENCH_IPC_PORT;
+    __BENCH_ADDR.local = B8_FALSE;
+    __BENCH_ADDR.shm = B8_FALSE;
+    bench_ipc_serve();
+}
+
+static void bench_ipc_unix_setup(void) {
+    strcpy(__BENCH_ADDR.ip, BENCH_IPC_PATH);
+    __BENCH_ADDR.port = 0;
+    __BENCH_ADDR.local = B8_TRUE;
+    __BENCH_ADDR.shm = B8_FALSE;
+    bench_ipc_serve();
+}
+
+static void bench_ipc_shm_setup(void) {
+    bench_ipc_unix_setup();
+    __BENCH_ADDR.shm = B8_TRUE;
+}
+
+static void bench_ipc_table_setup(void) {
+    __BENCH_INIT = "(set t (table [id price qty] (list (til 1000000) (as 'F64 (til 1000000)) (til 1000000))))";
+    bench_ipc_tcp_setup();
+}
+
+static b8_t bench_ipc_connect(void) {
+    int i;
+
+    // the server may still be starting up on the first call
+    for (i = 0; __BENCH_HANDLE == -1 && i < 100; i++) {
+        __BENCH_HANDLE = ipc_open(runtime_get()->poll, &__BENCH_ADDR, 1);
+        if (__BENCH_HANDLE == -1)
+            usleep(10000);
+    }
+
+    return __BENCH_HANDLE != -1;
+}
+
+static void bench_ipc_roundtrip(void) {
+    obj_p msg;
+
+    if (!bench_ipc_connect())
+        return;
+
+    msg = i64(42);
+    drop_obj(ipc_send(runtime_get()->poll, __BENCH_HANDLE, msg, MSG_TYPE_SYNC));
+    drop_obj(msg);
+}
+
+static void bench_ipc_async(void) {
+    obj_p msg;
+    int i;
+
+    if (!bench_ipc_connect())
+        return;
+
+    msg = i64(42);
+    for (i = 0; i < BENCH_IPC_BATCH; i++)
+        drop_obj(ipc_send(runtime_get()->poll, __BENCH_HANDLE, msg, MSG_TYPE_ASYN));
+
+    // answered once the server went through the whole batch
+    drop_obj(ipc_send(runtime_get()->poll, __BENCH_HANDLE, msg, MSG_TYPE_SYNC));
+    drop_obj(msg);
+}
+
+static void bench_ipc_table(void) {
+    obj_p msg, res;
+
+    if (!bench_ipc_connect())
+        return;
+
+    msg = symbol("t", 1);
+    res = ipc_send(runtime_get()->poll, __BENCH_HANDLE, msg, MSG_TYPE_SYNC);
+    if (!IS_ERR(res))
+        __BENCH_BYTES += size_obj(res);
+
+    drop_obj(res);
+    drop_obj(msg);
+}
+
+static void bench_ipc_client(int go, int done) {
+    char c;
+    int i;
+
+    runtime_create(0, NULL);
+    while (read(go, &c, 1) == 1) {
+        for (i = 0; i < BENCH_IPC_ROUNDS; i++)
+            bench_ipc_roundtrip();
+
+        if (write(done, &c, 1) != 1)
+            break;
+    }
+
+    _exit(0);
+}
+
+static void bench_ipc_clients_setup(void) {
+    int go[2], done[2], i;
+
+    bench_ipc_tcp_setup();
+
+    __BENCH_CLIENTS_COUNT = 0;
+    if (pipe(done) == -1)
+        return;
+
+    __BENCH_DONE = done[0];
+    for (i = 0; i < BENCH_IPC_CLIENTS; i++) {
+        if (pipe(go) == -1)
+            break;
+
+        __BENCH_CLIENTS[i] = fork();
+        if (__BENCH_CLIENTS[i] == 0) {
+            // a client that kept the others' pipes open would keep them from seeing the end
+            while (i--)
+                close(__BENCH_GO[i]);
+            close(go[1]);
+            close(done[0]);
+            bench_ipc_client(go[0], done[1]);
+        }
+
+        close(go[0]);
+        if (__BENCH_CLIENTS[i] == -1) {
+            close(go[1]);
+            break;
+        }
+
+        __BENCH_GO[i] = go[1];
+        __BENCH_CLIENTS_COUNT++;
+    }
+
+    close(done[1]);
+}
+
+static void bench_ipc_clients(void) {
+    char c = 0;
+    int i, n;
+
+    for (i = 0; i < __BENCH_CLIENTS_COUNT; i++)
+        if (write(__BENCH_GO[i], &c, 1) != 1)
+            return;
+
+    for (n = 0; n < __BENCH_CLIENTS_COUNT && read(__BENCH_DONE, &c, 1) == 1; n++)
+        ;
+}
+
+static void bench_ipc_teardown(void) {
+    int i;
+
+    if (__BENCH_HANDLE != -1)
+        poll_deregister(runtime_get()->poll, __BENCH_HANDLE);
+
+    for (i = 0; i < __BENCH_CLIENTS_COUNT; i++)
+        close(__BENCH_GO[i]);
+    for (i = 0; i < __BENCH_CLIENTS_COUNT; i++)
+        waitpid(__BENCH_CLIENTS[i], NULL, 0);
+
+    if (__BENCH_DONE != -1)
+        close(__BENCH_DONE);
+
+    if (__BENCH_SERVER > 0) {
+        kill(__BENCH_SERVER, SIGTERM);
+        waitpid(__BENCH_SERVER, NULL, 0);
+    }
+
+    if (__BENCH_ADDR.local)
+        unlink(__BENCH_ADDR.ip);
+
+    __BENCH_HANDLE = -1;
+    __BENCH_SERVER = -1;
+    __BENCH_INIT = NULL;
+    __BENCH_DONE = -1;
+    __BENCH_CLIENTS_COUNT = 0;
+}
+
+static bench_micro_t bench_micros[] = {
+    {"pool_run", bench_pool_run, 100000, NULL, NULL, 0},
+    {"ipc_tcp", bench_ipc_roundtrip, 100000, bench_ipc_tcp_setup, bench_ipc_teardown, 1},
+    {"ipc_unix", bench_ipc_roundtrip, 100000, bench_ipc_unix_setup, bench_ipc_teardown, 1},
+    {"ipc_shm", bench_ipc_roundtrip, 100000, bench_ipc_shm_setup, bench_ipc_teardown, 1},
+    {"ipc_async", bench_ipc_async, 1000, bench_ipc_tcp_setup, bench_ipc_teardown, BENCH_IPC_BATCH},
+    {"ipc_table", bench_ipc_table, 100, bench_ipc_table_setup, bench_ipc_teardown, 1},
+    {"ipc_clients", bench_ipc_clients, 200, bench_ipc_clients_setup, bench_ipc_teardown,
+     BENCH_IPC_CLIENTS * BENCH_IPC_ROUNDS},
+};
+
+static int bench_time_cmp(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void run_micro(bench_micro_t* micro, bench_results_t* results) {
+    bench_result_t result = {0};
+    struct timespec start, end;
+    double total_time = 0, *times;
+    int n = micro->iterations;
+
+    if (results->result_count >= MAX_RESULTS) {
+        printf("Warning: Maximum number of results reached, skipping %s\n", micro->name);
+        return;
+    }
+
+    times = malloc(n * sizeof(double));
+    if (!times)
+        return;
+
+    strncpy(result.script_name, micro->name, sizeof(result.script_name) - 1);
+    get_system_info(result.os_info, sizeof(result.os_info), result.cpu_info, sizeof(result.cpu_info));
+    get_git_commit(result.git_commit, sizeof(result.git_commit));
+
+    time_t now;
+    time(&now);
+    strftime(result.timestamp, sizeof(result.timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    result.min_time = 1e9;
+    result.max_time = 0;
+
+    if (micro->setup)
+        micro->setup();
+
+    runtime_create(0, NULL);
+
+    // an untimed call first, so that connecting or warming caches isn't counted
+    micro->fn();
+    __BENCH_BYTES = 0;
+
+    for (int j = 0; j < n; j++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        micro->fn();
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double iteration_time = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+        times[j] = iteration_time;
+        total_time += iteration_time;
+        if (iteration_time < result.min_time)
+            result.min_time = iteration_time;
+        if (iteration_time > result.max_time)
+            result.max_time = iteration_time;
+    }
+
+    result.avg_time = total_time / n;
+
+    qsort(times, n, sizeof(double), bench_time_cmp);
+    result.p50_time = times[n / 2];
+    result.p99_time = times[n - 1 - n / 100];
+    free(times);
+
+    if (micro->ops > 0 && total_time > 0)
+        result.rate = (double)micro->ops * n / (total_time / 1000.0);
+    if (__BENCH_BYTES > 0 && total_time > 0)
+        result.bandwidth = __BENCH_BYTES / 1e6 / (total_time / 1000.0);
+
+    if (micro->teardown)
+        micro->teardown();
+
+    runtime_destroy();
+
+    results->results[results->result_count++] = result;
+}
+
+// Run a micro benchmark by name, or all of those named with it and an underscore (e.g. "ipc" for "ipc_tcp",
+// "ipc_unix"...), returns false if there is no such one
+bool process_micro(const char* name, bench_results_t* results) {
+    size_t i, l = strlen(name);
+    bool found = false;
+
+    for (i = 0; i < sizeof(bench_micros) / sizeof(bench_micros[0]); i++) {
+        if (strcmp(bench_micros[i].name, name) == 0) {
+            run_micro(&bench_micros[i], results);
+            return true;
+        }
+    }
+
+    for (i = 0; i < sizeof(bench_micros) / sizeof(bench_micros[0]); i++) {
+        if (strncmp(bench_micros[i].name, name, l) == 0 && bench_micros[i].name[l] == '_') {
+            run_micro(&bench_micros[i], results);
+            found = true;
+        }
+    }
+
+    return found;
+}
+
 void process_script_file(const char* filename, bench_results_t* results) {
     char script_path[MAX_PATH_LEN];
     char init_path[MAX_PATH_LEN];
@@ -622,6 +1050,9 @@ void scan_benchmark_scripts(bench_results_t* results) {
     }
 
     pclose(pipe);
+
+    for (size_t i = 0; i < sizeof(bench_micros) / sizeof(bench_micros[0]); i++)
+        process_micro(bench_micros[i].name, results);
 }
 
 int main(int argc, char* argv[]) {
@@ -641,6 +1072,9 @@ int main(int argc, char* argv[]) {
             const char* test_name = argv[i];
             char script_path[MAX_PATH_LEN];
 
+            if (process_micro(test_name, &results))
+                continue;
+
             // Check if .rfl extension is already present
             const char* ext = strstr(test_name, ".rfl");
             if (ext) {
@@ -657,8 +1091,10 @@ int main(int argc, char* argv[]) {
         if (bench_var && *bench_var) {
             specific_tests = true;
             char script_path[MAX_PATH_LEN];
-            snprintf(script_path, sizeof(script_path), "%s/%s.rfl", BENCH_SCRIPTS_DIR, bench_var);
-            process_script_file(script_path, &results);
+            if (!process_micro(bench_var, &results)) {
+                snprintf(script_path, sizeof(script_path), "%s/%s.rfl", BENCH_SCRIPTS_DIR, bench_var);
+                process_script_file(script_path, &results);
+            }
         } else {
             // If no BENCH variable, scan all benchmark scripts
             scan_benchmark_scripts(&results);
@@ -668,7 +1104,7 @@ int main(int argc, char* argv[]) {
     // Update only the results that were run
     if (specific_tests) {
         // For each result we just ran
-        for (int i = 1; i < results.result_count; i++) {
+        for (int i = 0; i < results.result_count; i++) {
             // Find matching previous result
             bench_result_t* previous = NULL;
             for (int j = 0; j < previous_results.result_count; j++) {
@@ -696,20 +1132,8 @@ int main(int argc, char* argv[]) {
 
     // Save results if we have any
     if (results.result_count > 0) {
-        // If running specific tests, only update those tests in the previous results
-        if (specific_tests) {
-            for (int i = 1; i < results.result_count; i++) {
-                for (int j = 0; j < previous_results.result_count; j++) {
-                    if (strcmp(results.results[i].script_name, previous_results.results[j].script_name) == 0) {
-                        previous_results.results[j] = results.results[i];
-                        break;
-                    }
-                }
-            }
-            save_results(&previous_results);
-        } else {
-            save_results(&results);
-        }
+        // save_results keeps the previous results of what didn't run, and adds what ran for the first time
+        save_results(&results);
     }
 
     return has_errors ? 1 : 0;
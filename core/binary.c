@@ -32,10 +32,15 @@
 #include "string.h"
 #include "io.h"
 #include "iter.h"
+#include "serve.h"
 
 obj_p binary_call(obj_p f, obj_p x, obj_p y) {
     binary_f fn;
 
+    // A reader stops short of any side effect, its request runs again on the main thread
+    if (UNLIKELY(f->attrs & FN_EFFECT) && serve_rerun())
+        return err_nyi(0);
+
     switch (f->attrs & FN_ATOMIC_MASK) {
         case FN_ATOMIC:
             return map_binary(f, x, y);
@@ -58,7 +63,7 @@ obj_p binary_set(obj_p x, obj_p y) {
 
     switch (x->type) {
         case -TYPE_SYMBOL:
-            res = set_obj(&runtime_get()->env.variables, x, clone_obj(y));
+            res = set_obj(env_variables(), x, clone_obj(y));
 
             if (y && y->type == TYPE_LAMBDA) {
                 if (is_null(AS_LAMBDA(y)->name))
@@ -30,6 +30,7 @@
 #include "nfo.h"
 #include "env.h"
 #include "error.h"
+#include "atomic.h"
 
 // Add location info from compiler context when a compile error occurs
 static nil_t cc_error_add_loc(cc_ctx_t *cc) {
@@ -391,8 +392,10 @@ end:
     return NULL_OBJ;  // Success
 }
 
-// Main compilation entry point
-obj_p cc_compile(obj_p lambda) {
+// Lambdas are shared with the readers: one thread compiles at a time
+static i64_t __CC_LOCK = 0;
+
+static obj_p cc_lambda(obj_p lambda) {
     lambda_p fn = AS_LAMBDA(lambda);
     obj_p body = fn->body;
     obj_p result;
@@ -458,10 +461,10 @@ obj_p cc_compile(obj_p lambda) {
         return result;
     }
 
-    // Store compiled bytecode, constants, and debug info in lambda
-    fn->bc = cc.bc;
+    // Store compiled bytecode, constants, and debug info in lambda, the bytecode last as it tells it is compiled
     fn->consts = cc.consts;
     fn->dbg = cc.dbg;
+    __atomic_store_n(&fn->bc, cc.bc, __ATOMIC_RELEASE);
 
     // Don't pre-create env dict - let runtime handle it via amend()
     // env_names was just for compile-time offset lookups (args)
@@ -474,6 +477,25 @@ obj_p cc_compile(obj_p lambda) {
     return NULL_OBJ;  // Success
 }
 
+// Main compilation entry point
+obj_p cc_compile(obj_p lambda) {
+    i64_t rounds = 0, unlocked = 0;
+    obj_p res = NULL_OBJ;
+
+    while (!__atomic_compare_exchange_n(&__CC_LOCK, &unlocked, 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        unlocked = 0;
+        backoff_spin(&rounds);
+    }
+
+    // Another thread may have compiled it meanwhile
+    if (AS_LAMBDA(lambda)->bc == NULL_OBJ)
+        res = cc_lambda(lambda);
+
+    __atomic_store_n(&__CC_LOCK, 0, __ATOMIC_RELEASE);
+
+    return res;
+}
+
 // Dump bytecode for debugging
 nil_t cc_dump(obj_p lambda) {
     lambda_p fn = AS_LAMBDA(lambda);
@@ -28,6 +28,7 @@
 #include "eval.h"
 #include "io.h"
 #include "ipc.h"
+#include "pubsub.h"
 
 #if defined(OS_WINDOWS)
 
@@ -309,12 +310,18 @@ nil_t timer_del(timers_p timers, i64_t id) {
 }
 
 i64_t timer_next_timeout(timers_p timers) {
-    i64_t now = get_time_millis();
+    i64_t now = get_time_millis(), next, scavenge, batch;
     ray_timer_p timer;
     obj_p res;
 
+    // The heap scavenger and the subscriber batches ride on the event loop wakeups
+    scavenge = heap_scavenge_tick(now);
+    batch = pubsub_tick(now);
+    if (batch != TIMEOUT_INFINITY && (scavenge == TIMEOUT_INFINITY || batch < scavenge))
+        scavenge = batch;
+
     if (timers->size == 0)
-        return TIMEOUT_INFINITY;
+        return scavenge;
 
     while (timers->size > 0 && timers->timers[0]->exp <= now) {
         // Pop the top timer for processing
@@ -354,8 +361,13 @@ i64_t timer_next_timeout(timers_p timers) {
     }
 
     // After processing all expired (and potentially re-added) timers,
-    // return the expiration of the next timer or TIMEOUT_INFINITY
-    return (timers->size > 0) ? timers->timers[0]->exp - now : TIMEOUT_INFINITY;
+    // return the expiration of the next timer (or scavenger pass) or TIMEOUT_INFINITY
+    next = (timers->size > 0) ? timers->timers[0]->exp - now : TIMEOUT_INFINITY;
+
+    if (scavenge != TIMEOUT_INFINITY && (next == TIMEOUT_INFINITY || scavenge < next))
+        next = scavenge;
+
+    return next;
 }
 
 obj_p ray_timer(obj_p *x, i64_t n) {
@@ -83,6 +83,8 @@ nil_t timeit_print(nil_t);
 nil_t ray_clock_get_time(ray_clock_t *clock);
 f64_t ray_clock_elapsed_ms(ray_clock_t *start, ray_clock_t *end);
 
+i64_t get_time_millis(nil_t);
+
 timers_p timers_create(i64_t capacity);
 nil_t timers_destroy(timers_p timers);
 i64_t timer_next_timeout(timers_p timers);
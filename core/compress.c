@@ -0,0 +1,381 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+#include "compress.h"
+#include "heap.h"
+#include "pool.h"
+#include "ops.h"
+#include "error.h"
+
+/*
+ * LZ77 block codec in the LZ4 mould: a token holds the literal run length in its high
+ * nibble and the match length (minus MIN_MATCH) in the low one, 15 meaning that more
+ * length bytes follow. Literals come next, then a 2-byte little endian match offset.
+ * The last sequence of a block has literals only.
+ */
+
+#define HASH_LOG 14
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+
+static inline u32_t read32(u8_t *p) {
+    u32_t v;
+    memcpy(&v, p, sizeof(u32_t));
+    return v;
+}
+
+static inline u32_t hash32(u32_t v) { return (v * 2654435761u) >> (32 - HASH_LOG); }
+
+static inline u8_t *put_len(u8_t *op, i64_t n) {
+    for (; n >= 255; n -= 255)
+        *op++ = 255;
+    *op++ = (u8_t)n;
+    return op;
+}
+
+static inline u8_t *put_literals(u8_t *op, u8_t *lit, i64_t len, i64_t match) {
+    *op++ = (u8_t)((MINI64(len, 15) << 4) | MINI64(match, 15));
+    if (len >= 15)
+        op = put_len(op, len - 15);
+    memcpy(op, lit, len);
+    return op + len;
+}
+
+// Returns the compressed size, or -1 if it does not fit into cap
+i64_t compress_block(u8_t *src, i64_t len, u8_t *dst, i64_t cap) {
+    u32_t table[1 << HASH_LOG];
+    i64_t ip, ref, anchor, lit, m;
+    u8_t *op, *oend;
+    u32_t h;
+
+    memset(table, 0, sizeof(table));
+    op = dst;
+    oend = dst + cap;
+
+    for (ip = 0, anchor = 0; ip + MIN_MATCH <= len;) {
+        h = hash32(read32(src + ip));
+        ref = table[h];
+        table[h] = (u32_t)ip;
+
+        if (ref >= ip || ip - ref > MAX_OFFSET || read32(src + ref) != read32(src + ip)) {
+            // step faster over data that does not compress
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        for (m = MIN_MATCH; ip + m < len && src[ref + m] == src[ip + m]; m++)
+            ;
+
+        lit = ip - anchor;
+        if (op + lit + lit / 255 + m / 255 + 5 > oend)
+            return -1;
+
+        op = put_literals(op, src + anchor, lit, m - MIN_MATCH);
+        *op++ = (u8_t)(ip - ref);
+        *op++ = (u8_t)((ip - ref) >> 8);
+        if (m - MIN_MATCH >= 15)
+            op = put_len(op, m - MIN_MATCH - 15);
+
+        ip += m;
+        anchor = ip;
+    }
+
+    lit = len - anchor;
+    if (op + lit + lit / 255 + 2 > oend)
+        return -1;
+
+    op = put_literals(op, src + anchor, lit, 0);
+
+    return op - dst;
+}
+
+// Returns the decompressed size, or -1 for a malformed block
+i64_t decompress_block(u8_t *src, i64_t len, u8_t *dst, i64_t cap) {
+    u8_t *ip, *iend, *op, *oend, *ref;
+    i64_t i, lit, m, off, b;
+    u8_t token;
+
+    ip = src;
+    iend = src + len;
+    op = dst;
+    oend = dst + cap;
+
+    while (ip < iend) {
+        token = *ip++;
+
+        lit = token >> 4;
+        if (lit == 15) {
+            do {
+                if (ip == iend)
+                    return -1;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+
+        if (lit > iend - ip || lit > oend - op)
+            return -1;
+
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+
+        off = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        m = token & 15;
+        if (m == 15) {
+            do {
+                if (ip == iend)
+                    return -1;
+                b = *ip++;
+                m += b;
+            } while (b == 255);
+        }
+        m += MIN_MATCH;
+
+        if (off == 0 || off > op - dst || m > oend - op)
+            return -1;
+
+        // overlapping matches repeat the last off bytes
+        ref = op - off;
+        if (off >= m)
+            memcpy(op, ref, m);
+        else
+            for (i = 0; i < m; i++)
+                op[i] = ref[i];
+
+        op += m;
+    }
+
+    return op - dst;
+}
+
+/*
+ * Frame: raw size (8), block count (8), compressed length of every block (4 each),
+ * then the blocks. Blocks are independent, so both ways they are spread over the pool.
+ */
+
+#define FRAME_HEADER(n) (2 * ISIZEOF(i64_t) + (n) * ISIZEOF(u32_t))
+
+i64_t compress_frame_bound(i64_t len) { return FRAME_HEADER((len + COMPRESS_BLOCK - 1) / COMPRESS_BLOCK) + len; }
+
+// Each block is compressed into its own raw sized slot, stored as is when it does not shrink
+static obj_p compress_blocks(u8_t *src, i64_t len, u8_t *data, u32_t *lens, i64_t from, i64_t to) {
+    i64_t i, n, size;
+
+    for (i = from; i < to; i++) {
+        n = MINI64(COMPRESS_BLOCK, len - i * COMPRESS_BLOCK);
+        size = compress_block(src + i * COMPRESS_BLOCK, n, data + i * COMPRESS_BLOCK, n - 1);
+        if (size < 0) {
+            memcpy(data + i * COMPRESS_BLOCK, src + i * COMPRESS_BLOCK, n);
+            lens[i] = (u32_t)n | COMPRESS_STORED;
+        } else
+            lens[i] = (u32_t)size;
+    }
+
+    return NULL_OBJ;
+}
+
+static obj_p decompress_blocks(u8_t *data, i64_t len, u8_t *dst, u32_t *lens, i64_t *offs, i64_t from, i64_t to) {
+    i64_t i, n, size;
+
+    for (i = from; i < to; i++) {
+        n = MINI64(COMPRESS_BLOCK, len - i * COMPRESS_BLOCK);
+        size = lens[i] & ~COMPRESS_STORED;
+        if (lens[i] & COMPRESS_STORED) {
+            if (size != n)
+                return err_domain();
+            memcpy(dst + i * COMPRESS_BLOCK, data + offs[i], n);
+        } else if (decompress_block(data + offs[i], size, dst + i * COMPRESS_BLOCK, n) != n)
+            return err_domain();
+    }
+
+    return NULL_OBJ;
+}
+
+// Number of block ranges to hand to the executors, 1 for a serial run
+static i64_t frame_parts(pool_p pool, i64_t len, i64_t blocks) {
+    i64_t n = pool_split_by(pool, len, 0);
+    return (n < blocks) ? n : blocks;
+}
+
+// Returns the frame size, or -1 if cap (see compress_frame_bound) is too small
+i64_t compress_frame(u8_t *src, i64_t len, u8_t *dst, i64_t cap) {
+    i64_t i, n, at, size, parts, per;
+    u32_t *lens;
+    u8_t *data;
+    pool_p pool;
+
+    n = (len + COMPRESS_BLOCK - 1) / COMPRESS_BLOCK;
+    if (cap < compress_frame_bound(len))
+        return -1;
+
+    memcpy(dst, &len, ISIZEOF(i64_t));
+    memcpy(dst + ISIZEOF(i64_t), &n, ISIZEOF(i64_t));
+    lens = (u32_t *)(dst + 2 * ISIZEOF(i64_t));
+    data = dst + FRAME_HEADER(n);
+
+    pool = pool_get();
+    parts = frame_parts(pool, len, n);
+
+    if (parts <= 1)
+        compress_blocks(src, len, data, lens, 0, n);
+    else {
+        per = (n + parts - 1) / parts;
+        pool_prepare(pool);
+        for (i = 0; i < n; i += per)
+            pool_add_task(pool, (raw_p)compress_blocks, 6, src, len, data, lens, i, MINI64(i + per, n));
+        drop_obj(pool_run(pool));
+    }
+
+    // close the gaps the slots left
+    for (i = 0, at = 0; i < n; i++) {
+        size = lens[i] & ~COMPRESS_STORED;
+        if (at != i * COMPRESS_BLOCK)
+            memmove(data + at, data + i * COMPRESS_BLOCK, size);
+        at += size;
+    }
+
+    return FRAME_HEADER(n) + at;
+}
+
+// Returns the raw size of a frame, or -1 if it is malformed
+i64_t decompress_frame_size(u8_t *src, i64_t len) {
+    i64_t raw, n;
+
+    if (len < FRAME_HEADER(0))
+        return -1;
+
+    memcpy(&raw, src, ISIZEOF(i64_t));
+    memcpy(&n, src + ISIZEOF(i64_t), ISIZEOF(i64_t));
+
+    if (raw < 0 || n != (raw + COMPRESS_BLOCK - 1) / COMPRESS_BLOCK || len < FRAME_HEADER(n))
+        return -1;
+
+    return raw;
+}
+
+// Returns the raw size, or -1 for a malformed frame
+i64_t decompress_frame(u8_t *src, i64_t len, u8_t *dst, i64_t cap) {
+    i64_t i, n, raw, at, parts, per;
+    i64_t *offs;
+    u32_t *lens;
+    pool_p pool;
+    obj_p res;
+
+    raw = decompress_frame_size(src, len);
+    if (raw < 0 || raw > cap)
+        return -1;
+
+    n = (raw + COMPRESS_BLOCK - 1) / COMPRESS_BLOCK;
+    lens = (u32_t *)(src + 2 * ISIZEOF(i64_t));
+
+    offs = (i64_t *)heap_alloc(ISIZEOF(i64_t) * (n + 1));
+    for (i = 0, at = 0; i < n; i++) {
+        offs[i] = at;
+        at += lens[i] & ~COMPRESS_STORED;
+    }
+
+    if (FRAME_HEADER(n) + at > len) {
+        heap_free(offs);
+        return -1;
+    }
+
+    pool = pool_get();
+    parts = frame_parts(pool, raw, n);
+
+    if (parts <= 1)
+        res = decompress_blocks(src + FRAME_HEADER(n), raw, dst, lens, offs, 0, n);
+    else {
+        per = (n + parts - 1) / parts;
+        pool_prepare(pool);
+        for (i = 0; i < n; i += per)
+            pool_add_task(pool, (raw_p)decompress_blocks, 7, src + FRAME_HEADER(n), raw, dst, lens, offs, i,
+                          MINI64(i + per, n));
+        res = pool_run(pool);
+    }
+
+    heap_free(offs);
+
+    if (IS_ERR(res)) {
+        drop_obj(res);
+        return -1;
+    }
+
+    drop_obj(res);
+
+    return raw;
+}
+
+/*
+ * Column filters, run before compression: deltas turn sorted or slowly moving integers
+ * (timestamps, ids) into small repeating values, and a byte shuffle groups the exponent
+ * bytes of doubles together.
+ */
+
+// The stream side may be unaligned
+nil_t compress_delta(i64_t *src, u8_t *dst, i64_t len) {
+    i64_t i;
+    u64_t prev, v;
+
+    for (i = 0, prev = 0; i < len; i++) {
+        v = (u64_t)src[i] - prev;
+        memcpy(dst + i * ISIZEOF(i64_t), &v, ISIZEOF(i64_t));
+        prev = (u64_t)src[i];
+    }
+}
+
+nil_t decompress_delta(u8_t *src, i64_t *dst, i64_t len) {
+    i64_t i;
+    u64_t acc, v;
+
+    for (i = 0, acc = 0; i < len; i++) {
+        memcpy(&v, src + i * ISIZEOF(i64_t), ISIZEOF(i64_t));
+        acc += v;
+        dst[i] = (i64_t)acc;
+    }
+}
+
+// len is the number of 8-byte elements
+nil_t compress_shuffle(u8_t *src, u8_t *dst, i64_t len) {
+    i64_t i, b;
+
+    for (i = 0; i < len; i++)
+        for (b = 0; b < 8; b++)
+            dst[b * len + i] = src[i * 8 + b];
+}
+
+nil_t decompress_shuffle(u8_t *src, u8_t *dst, i64_t len) {
+    i64_t i, b;
+
+    for (i = 0; i < len; i++)
+        for (b = 0; b < 8; b++)
+            dst[i * 8 + b] = src[b * len + i];
+}
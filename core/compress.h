@@ -0,0 +1,43 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "rayforce.h"
+
+#define COMPRESS_BLOCK (1 << 20)     // frames are cut into blocks of this size, compressed independently
+#define COMPRESS_STORED 0x80000000u  // block length flag: the block did not shrink and is stored as is
+
+i64_t compress_frame_bound(i64_t len);
+i64_t compress_block(u8_t *src, i64_t len, u8_t *dst, i64_t cap);
+i64_t decompress_block(u8_t *src, i64_t len, u8_t *dst, i64_t cap);
+i64_t compress_frame(u8_t *src, i64_t len, u8_t *dst, i64_t cap);
+i64_t decompress_frame_size(u8_t *src, i64_t len);
+i64_t decompress_frame(u8_t *src, i64_t len, u8_t *dst, i64_t cap);
+nil_t compress_delta(i64_t *src, u8_t *dst, i64_t len);
+nil_t decompress_delta(u8_t *src, i64_t *dst, i64_t len);
+nil_t compress_shuffle(u8_t *src, u8_t *dst, i64_t len);
+nil_t decompress_shuffle(u8_t *src, u8_t *dst, i64_t len);
+
+#endif  // COMPRESS_H
@@ -28,6 +28,7 @@
 #include "compose.h"
 #include "cond.h"
 #include "dynlib.h"
+#include "error.h"
 #include "format.h"
 #include "io.h"
 #include "items.h"
@@ -51,6 +52,7 @@
 #include "vary.h"
 #include "os.h"
 #include "proc.h"
+#include "pubsub.h"
 
 i64_t SYMBOL_FN;
 i64_t SYMBOL_SELF;
@@ -91,27 +93,124 @@ i64_t SYMBOL_SYM;
 obj_p ray_env(obj_p *x, i64_t n) {
     UNUSED(x);
     UNUSED(n);
-    return clone_obj(runtime_get()->env.variables);
+    return clone_obj(*env_variables());
+}
+
+// Profiler stats as a table, the first column names the rows
+static obj_p memstat_prof(lit_p name, obj_p names, heap_prof_t *stats, i64_t n) {
+    i64_t i;
+    obj_p keys, vals;
+
+    keys = SYMBOL(5);
+    ins_sym(&keys, 0, name);
+    ins_sym(&keys, 1, "count");
+    ins_sym(&keys, 2, "bytes");
+    ins_sym(&keys, 3, "live");
+    ins_sym(&keys, 4, "peak");
+
+    vals = LIST(5);
+    AS_LIST(vals)[0] = names;
+    for (i = 1; i < 5; i++)
+        AS_LIST(vals)[i] = I64(n);
+
+    for (i = 0; i < n; i++) {
+        AS_I64(AS_LIST(vals)[1])[i] = stats[i].count;
+        AS_I64(AS_LIST(vals)[2])[i] = stats[i].bytes;
+        AS_I64(AS_LIST(vals)[3])[i] = stats[i].live;
+        AS_I64(AS_LIST(vals)[4])[i] = stats[i].peak;
+    }
+
+    return table(keys, vals);
+}
+
+static obj_p memstat_types(nil_t) {
+    i64_t i, n;
+    obj_p names;
+    heap_prof_t all[256], stats[256];
+
+    heap_prof_types(all);
+    names = SYMBOL(256);
+
+    for (i = 0, n = 0; i < 256; i++) {
+        if (all[i].count == 0)
+            continue;
+
+        AS_SYMBOL(names)[n] = env_get_typename_by_type(&runtime_get()->env, (i8_t)i);
+        stats[n++] = all[i];
+    }
+
+    resize_obj(&names, n);
+
+    return memstat_prof("type", names, stats, n);
+}
+
+// Sites are builtins, allocations made outside of any go to the top level
+static obj_p memstat_sites(nil_t) {
+    i64_t i, n, sym;
+    obj_p names, fn;
+    i64_t sites[PROF_SITES];
+    heap_prof_t stats[PROF_SITES];
+
+    n = heap_prof_sites(sites, stats);
+    names = SYMBOL(n);
+
+    for (i = 0; i < n; i++) {
+        if (sites[i] == 0) {
+            AS_SYMBOL(names)[i] = symbols_intern("top", 3);
+            continue;
+        }
+
+        fn = i64(sites[i]);
+        sym = env_get_internal_id(fn);
+        drop_obj(fn);
+        AS_SYMBOL(names)[i] = (sym != NULL_I64) ? sym : symbols_intern("@fn", 3);
+    }
+
+    return memstat_prof("site", names, stats, n);
 }
 
 obj_p ray_memstat(obj_p *x, i64_t n) {
-    UNUSED(x);
-    UNUSED(n);
     obj_p keys, vals;
-    memstat_t stat = heap_memstat();
+    memstat_t stat;
     symbols_p symbols = runtime_get()->symbols;
 
-    keys = SYMBOL(4);
+    if (n > 1)
+        return err_arity(1, n);
+
+    if (n == 1) {
+        if (x[0]->type != -TYPE_SYMBOL)
+            return err_type(-TYPE_SYMBOL, x[0]->type, 0);
+
+        if (x[0]->i64 == symbols_intern("types", 5))
+            return memstat_types();
+
+        if (x[0]->i64 == symbols_intern("sites", 5))
+            return memstat_sites();
+
+        return err_value(x[0]->i64);
+    }
+
+    stat = heap_memstat();
+
+    keys = SYMBOL(8);
     ins_sym(&keys, 0, "msys");
     ins_sym(&keys, 1, "heap");
     ins_sym(&keys, 2, "free");
-    ins_sym(&keys, 3, "syms");
+    ins_sym(&keys, 3, "huge");
+    ins_sym(&keys, 4, "thp");
+    ins_sym(&keys, 5, "scav");
+    ins_sym(&keys, 6, "spill");
+    ins_sym(&keys, 7, "syms");
 
-    vals = LIST(4);
+    vals = LIST(8);
     AS_LIST(vals)[0] = i64(stat.system);
     AS_LIST(vals)[1] = i64(stat.heap);
     AS_LIST(vals)[2] = i64(stat.free);
-    AS_LIST(vals)[3] = i64(symbols_count(symbols));
+    AS_LIST(vals)[3] = i64(stat.huge);
+    AS_LIST(vals)[4] = i64(stat.thp);
+    AS_LIST(vals)[5] = i64(stat.scav);
+    AS_LIST(vals)[6] = i64(stat.spill);
+    AS_LIST(vals)[7] = i64(symbols_count(symbols));
 
     return dict(keys, vals);
 }
@@ -126,7 +225,7 @@ nil_t init_functions(obj_p functions)
     REGISTER_FN(functions,  "read",                TYPE_UNARY,    FN_NONE,                   ray_read);
     REGISTER_FN(functions,  "parse",               TYPE_UNARY,    FN_NONE,                   ray_parse);
     REGISTER_FN(functions,  "eval",                TYPE_UNARY,    FN_NONE,                   ray_eval);
-    REGISTER_FN(functions,  "load",                TYPE_UNARY,    FN_NONE,                   ray_load);
+    REGISTER_FN(functions,  "load",                TYPE_UNARY,    FN_EFFECT,                 ray_load);
     REGISTER_FN(functions,  "type",                TYPE_UNARY,    FN_NONE,                   ray_type);
     REGISTER_FN(functions,  "til",                 TYPE_UNARY,    FN_NONE,                   ray_til);
     REGISTER_FN(functions,  "reverse",             TYPE_UNARY,    FN_NONE,                   ray_reverse);
@@ -158,7 +257,7 @@ nil_t init_functions(obj_p functions)
     REGISTER_FN(functions,  "parse",               TYPE_UNARY,    FN_NONE,                   ray_parse);
     REGISTER_FN(functions,  "ser",                 TYPE_UNARY,    FN_NONE,                   ser_obj);
     REGISTER_FN(functions,  "de",                  TYPE_UNARY,    FN_NONE,                   de_obj);
-    REGISTER_FN(functions,  "hclose",              TYPE_UNARY,    FN_NONE,                   ray_hclose);
+    REGISTER_FN(functions,  "hclose",              TYPE_UNARY,    FN_EFFECT,                 ray_hclose);
     REGISTER_FN(functions,  "rc",                  TYPE_UNARY,    FN_NONE,                   ray_rc);
     REGISTER_FN(functions,  "select",              TYPE_UNARY,    FN_NONE,                   ray_select);
     REGISTER_FN(functions,  "update",              TYPE_UNARY,    FN_NONE,                   ray_update);
@@ -167,10 +266,10 @@ nil_t init_functions(obj_p functions)
     REGISTER_FN(functions,  "timestamp",           TYPE_UNARY,    FN_NONE,                   ray_timestamp);
     REGISTER_FN(functions,  "nil?",                TYPE_UNARY,    FN_NONE,                   ray_is_null);
     REGISTER_FN(functions,  "resolve",             TYPE_UNARY,    FN_NONE,                   ray_resolve);
-    REGISTER_FN(functions,  "show",                TYPE_UNARY,    FN_NONE,                   ray_show);
+    REGISTER_FN(functions,  "show",                TYPE_UNARY,    FN_EFFECT,                 ray_show);
     REGISTER_FN(functions,  "meta",                TYPE_UNARY,    FN_NONE,                   ray_meta);
     REGISTER_FN(functions,  "os-get-var",          TYPE_UNARY,    FN_NONE,                   ray_os_get_var);
-    REGISTER_FN(functions,  "system",              TYPE_UNARY,    FN_NONE,                   ray_system);
+    REGISTER_FN(functions,  "system",              TYPE_UNARY,    FN_EFFECT,                 ray_system);
     REGISTER_FN(functions,  "unify",               TYPE_UNARY,    FN_NONE,                   ray_unify);
     REGISTER_FN(functions,  "raze",                TYPE_UNARY,    FN_NONE,                   ray_raze);
     REGISTER_FN(functions,  "diverse",             TYPE_UNARY,    FN_NONE,                   ray_diverse);
@@ -178,9 +277,11 @@ nil_t init_functions(obj_p functions)
     
     // Binary           
     REGISTER_FN(functions,  "try",                 TYPE_BINARY,   FN_NONE | FN_SPECIAL_FORM, try_obj);
-    REGISTER_FN(functions,  "set",                 TYPE_BINARY,   FN_NONE | FN_SPECIAL_FORM, ray_set);
+    REGISTER_FN(functions,  "set",                 TYPE_BINARY,   FN_EFFECT | FN_SPECIAL_FORM, ray_set);
     REGISTER_FN(functions,  "let",                 TYPE_BINARY,   FN_NONE | FN_SPECIAL_FORM, ray_let);
-    REGISTER_FN(functions,  "write",               TYPE_BINARY,   FN_NONE,                   ray_write);
+    REGISTER_FN(functions,  "write",               TYPE_BINARY,   FN_EFFECT,                 ray_write);
+    REGISTER_FN(functions,  "request",             TYPE_BINARY,   FN_EFFECT,                 ray_request);
+    REGISTER_FN(functions,  "await",               TYPE_BINARY,   FN_EFFECT,                 ray_await);
     REGISTER_FN(functions,  "at",                  TYPE_BINARY,   FN_RIGHT_ATOMIC,           ray_at);
     REGISTER_FN(functions,  "==",                  TYPE_BINARY,   FN_ATOMIC,                 ray_eq);
     REGISTER_FN(functions,  "<",                   TYPE_BINARY,   FN_ATOMIC,                 ray_lt);
@@ -214,7 +315,7 @@ nil_t init_functions(obj_p functions)
     REGISTER_FN(functions,  "xrank",               TYPE_BINARY,   FN_NONE,                   ray_xrank);
     REGISTER_FN(functions,  "enum",                TYPE_BINARY,   FN_NONE,                   ray_enum);
     REGISTER_FN(functions,  "xbar",                TYPE_BINARY,   FN_ATOMIC,                 ray_xbar);
-    REGISTER_FN(functions,  "os-set-var",          TYPE_BINARY,   FN_ATOMIC,                 ray_os_set_var);
+    REGISTER_FN(functions,  "os-set-var",          TYPE_BINARY,   FN_ATOMIC | FN_EFFECT,     ray_os_set_var);
     REGISTER_FN(functions,  "split",               TYPE_BINARY,   FN_NONE,                   ray_split);
     REGISTER_FN(functions,  "bin",                 TYPE_BINARY,   FN_NONE,                   ray_bin);
     REGISTER_FN(functions,  "binr",                TYPE_BINARY,   FN_NONE,                   ray_binr);
@@ -226,12 +327,12 @@ nil_t init_functions(obj_p functions)
     REGISTER_FN(functions,  "env",                 TYPE_VARY,     FN_NONE,                   ray_env);
     REGISTER_FN(functions,  "timeit",              TYPE_VARY,     FN_NONE | FN_SPECIAL_FORM, ray_timeit);
     REGISTER_FN(functions,  "memstat",             TYPE_VARY,     FN_NONE,                   ray_memstat);
-    REGISTER_FN(functions,  "gc",                  TYPE_VARY,     FN_NONE,                   ray_gc);
+    REGISTER_FN(functions,  "gc",                  TYPE_VARY,     FN_EFFECT,                 ray_gc);
     REGISTER_FN(functions,  "list",                TYPE_VARY,     FN_NONE,                   ray_list);
     REGISTER_FN(functions,  "enlist",              TYPE_VARY,     FN_NONE,                   ray_enlist);
     REGISTER_FN(functions,  "format",              TYPE_VARY,     FN_NONE,                   ray_format);
-    REGISTER_FN(functions,  "print",               TYPE_VARY,     FN_NONE,                   ray_print);
-    REGISTER_FN(functions,  "println",             TYPE_VARY,     FN_NONE,                   ray_println);
+    REGISTER_FN(functions,  "print",               TYPE_VARY,     FN_EFFECT,                 ray_print);
+    REGISTER_FN(functions,  "println",             TYPE_VARY,     FN_EFFECT,                 ray_println);
     REGISTER_FN(functions,  "apply",               TYPE_VARY,     FN_NONE,                   ray_apply);
     REGISTER_FN(functions,  "map",                 TYPE_VARY,     FN_NONE,                   ray_map);
     REGISTER_FN(functions,  "pmap",                TYPE_VARY,     FN_NONE,                   ray_pmap);
@@ -249,7 +350,7 @@ nil_t init_functions(obj_p functions)
     REGISTER_FN(functions,  "insert",              TYPE_VARY,     FN_NONE,                   ray_insert);
     REGISTER_FN(functions,  "upsert",              TYPE_VARY,     FN_NONE,                   ray_upsert);
     REGISTER_FN(functions,  "read-csv",            TYPE_VARY,     FN_NONE,                   ray_read_csv);
-    REGISTER_FN(functions,  "write-csv",           TYPE_VARY,     FN_NONE,                   ray_write_csv);
+    REGISTER_FN(functions,  "write-csv",           TYPE_VARY,     FN_EFFECT,                 ray_write_csv);
     REGISTER_FN(functions,  "left-join",           TYPE_VARY,     FN_NONE,                   ray_left_join);
     REGISTER_FN(functions,  "inner-join",          TYPE_VARY,     FN_NONE,                   ray_inner_join);
     REGISTER_FN(functions,  "asof-join",           TYPE_VARY,     FN_NONE,                   ray_asof_join);
@@ -257,13 +358,20 @@ nil_t init_functions(obj_p functions)
     REGISTER_FN(functions,  "window-join1",        TYPE_VARY,     FN_NONE,                   ray_window_join1);
     REGISTER_FN(functions,  "if",                  TYPE_VARY,     FN_NONE | FN_SPECIAL_FORM, ray_cond);
     REGISTER_FN(functions,  "return",              TYPE_VARY,     FN_NONE,                   ray_return);
-    REGISTER_FN(functions,  "hopen",               TYPE_VARY,     FN_NONE,                   ray_hopen);
-    REGISTER_FN(functions,  "exit",                TYPE_VARY,     FN_NONE,                   ray_exit);
-    REGISTER_FN(functions,  "loadfn",              TYPE_VARY,     FN_NONE,                   ray_loadfn);
-    REGISTER_FN(functions,  "timer",               TYPE_VARY,     FN_NONE,                   ray_timer);
-    REGISTER_FN(functions,  "set-splayed",         TYPE_VARY,     FN_NONE,                   ray_set_splayed);
+    REGISTER_FN(functions,  "hopen",               TYPE_VARY,     FN_EFFECT,                 ray_hopen);
+    REGISTER_FN(functions,  "exit",                TYPE_VARY,     FN_EFFECT,                 ray_exit);
+    REGISTER_FN(functions,  "defer",               TYPE_VARY,     FN_EFFECT,                 ray_defer);
+    REGISTER_FN(functions,  "respond",             TYPE_VARY,     FN_EFFECT,                 ray_respond);
+    REGISTER_FN(functions,  "hqueue",              TYPE_VARY,     FN_EFFECT,                 ray_hqueue);
+    REGISTER_FN(functions,  "stream",              TYPE_VARY,     FN_EFFECT,                 ray_stream);
+    REGISTER_FN(functions,  "subscribe",           TYPE_VARY,     FN_EFFECT,                 ray_subscribe);
+    REGISTER_FN(functions,  "unsubscribe",         TYPE_UNARY,    FN_EFFECT,                 ray_unsubscribe);
+    REGISTER_FN(functions,  "publish",             TYPE_BINARY,   FN_EFFECT,                 ray_publish);
+    REGISTER_FN(functions,  "loadfn",              TYPE_VARY,     FN_EFFECT,                 ray_loadfn);
+    REGISTER_FN(functions,  "timer",               TYPE_VARY,     FN_EFFECT,                 ray_timer);
+    REGISTER_FN(functions,  "set-splayed",         TYPE_VARY,     FN_EFFECT,                 ray_set_splayed);
     REGISTER_FN(functions,  "get-splayed",         TYPE_VARY,     FN_NONE,                   ray_get_splayed);
-    REGISTER_FN(functions,  "set-parted",          TYPE_VARY,     FN_NONE,                   ray_set_parted);
+    REGISTER_FN(functions,  "set-parted",          TYPE_VARY,     FN_EFFECT,                 ray_set_parted);
     REGISTER_FN(functions,  "get-parted",          TYPE_VARY,     FN_NONE,                   ray_get_parted);
     REGISTER_FN(functions,  "internals",           TYPE_VARY,     FN_NONE,                   ray_internals);
     REGISTER_FN(functions,  "sysinfo",             TYPE_VARY,     FN_NONE,                   ray_sysinfo);
@@ -377,6 +485,16 @@ env_t env_create(nil_t) {
     return env;
 }
 
+// Globals are looked up in the snapshot a reader evaluates against, if there is one
+obj_p *env_variables(nil_t) {
+    vm_p vm = VM;
+
+    if (vm->env != NULL_OBJ)
+        return &vm->env;
+
+    return &runtime_get()->env.variables;
+}
+
 nil_t env_destroy(env_t *env) {
     drop_obj(env->keywords);
     drop_obj(env->functions);
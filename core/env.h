@@ -56,6 +56,7 @@ typedef struct env_t {
 
 env_t env_create(nil_t);
 nil_t env_destroy(env_t *env);
+obj_p *env_variables(nil_t);
 
 i64_t env_get_typename_by_type(env_t *env, i8_t type);
 i8_t env_get_type_by_type_name(env_t *env, i64_t name);
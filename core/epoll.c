@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <signal.h>
 #include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include "poll.h"
 #include "heap.h"
@@ -141,10 +142,13 @@ i64_t poll_register(poll_p poll, poll_registry_p registry) {
     selector->tx.write_fn = registry->write_fn;
     selector->rx.recv_fn = registry->recv_fn;
     selector->tx.send_fn = registry->send_fn;
+    selector->tx.sendv_fn = registry->sendv_fn;
     selector->data_fn = registry->data_fn;
     selector->data = registry->data;
     selector->rx.buf = NULL;
     selector->tx.buf = NULL;
+    selector->tx.tail = NULL;
+    poll_tx_init(selector);
 
     LOG_DEBUG("Setting up epoll event");
 
@@ -187,6 +191,10 @@ i64_t poll_deregister(poll_p poll, i64_t id) {
 
     epoll_ctl(poll->fd, EPOLL_CTL_DEL, selector->fd, NULL);
 
+    // Connections are closed with their selectors, as kqueue does
+    if (selector->type == SELECTOR_TYPE_SOCKET)
+        close(selector->fd);
+
     if (selector->rx.buf != NULL) {
         heap_free(selector->rx.buf);
         selector->rx.buf = NULL;
@@ -194,9 +202,12 @@ i64_t poll_deregister(poll_p poll, i64_t id) {
 
     while (selector->tx.buf != NULL) {
         buf = selector->tx.buf->next;
-        heap_free(selector->tx.buf);
+        poll_buf_destroy(selector->tx.buf);
         selector->tx.buf = buf;
     }
+    selector->tx.tail = NULL;
+
+    poll_tx_free(selector);
 
     LOG_DEBUG("Freeing selector");
 
@@ -253,17 +264,26 @@ i64_t poll_recv(poll_p poll, selector_p selector) {
 i64_t poll_send(poll_p poll, selector_p selector) {
     UNUSED(poll);
 
-    i64_t size, total;
+    i64_t size, total, n;
     poll_buffer_p buf;
+    struct iovec iov[POLL_IOV_MAX];
 
     LOG_TRACE("Sending data to selector %lld", selector->id);
 
     total = 0;
 
-send_loop:
-    while (selector->tx.buf->offset < selector->tx.buf->size) {
-        size = selector->tx.send_fn(selector->fd, selector->tx.buf->data + selector->tx.buf->offset,
-                                    selector->tx.buf->size - selector->tx.buf->offset);
+    while (selector->tx.buf != NULL) {
+        // A message split around in-place payloads queues several buffers, gather them into one call
+        if (selector->tx.sendv_fn != NULL && selector->tx.buf->next != NULL) {
+            for (n = 0, buf = selector->tx.buf; buf != NULL && n < POLL_IOV_MAX; buf = buf->next, n++) {
+                iov[n].iov_base = POLL_BUF_DATA(buf) + buf->offset;
+                iov[n].iov_len = buf->size - buf->offset;
+            }
+            size = selector->tx.sendv_fn(selector->fd, iov, n);
+        } else {
+            buf = selector->tx.buf;
+            size = selector->tx.send_fn(selector->fd, POLL_BUF_DATA(buf) + buf->offset, buf->size - buf->offset);
+        }
 
         LOG_TRACE("Sent %lld bytes to selector %lld", size, selector->id);
 
@@ -282,19 +302,23 @@ send_loop:
             return 0;
         }
 
-        selector->tx.buf->offset += size;
-    }
-
-    total = selector->tx.buf->offset;
-
-    // switch to next buffer
-    LOG_TRACE("Switching to next buffer");
-    buf = selector->tx.buf->next;
-    heap_free(selector->tx.buf);
-    selector->tx.buf = buf;
+        total += size;
+        poll_tx_sent(selector, size);
 
-    if (selector->tx.buf != NULL)
-        goto send_loop;
+        // release the buffers sent completely
+        for (buf = selector->tx.buf; size > 0; buf = selector->tx.buf) {
+            n = buf->size - buf->offset;
+            if (size < n) {
+                buf->offset += size;
+                break;
+            }
+            size -= n;
+            selector->tx.buf = buf->next;
+            if (selector->tx.buf == NULL)
+                selector->tx.tail = NULL;
+            poll_buf_destroy(buf);
+        }
+    }
 
     LOG_TRACE("Total bytes sent to selector %lld: %lld", selector->id, total);
 
@@ -360,7 +384,7 @@ i64_t poll_run(poll_p poll) {
 
                         if (nbytes == 0) {
                             // No more data to read (EAGAIN/EWOULDBLOCK), wait for next edge trigger
-                            goto next_event;
+                            break;
                         }
                     }
 
@@ -377,15 +401,17 @@ i64_t poll_run(poll_p poll) {
                             continue;
                     }
 
-                    if (option_is_error(&poll_result))
+                    if (option_is_error(&poll_result)) {
                         poll_deregister(poll, selector->id);
+                        goto next_event;
+                    }
 
                     break;
                 }
             }
 
-            // write
-            if (ev.events & POLL_EVENT_WRITE) {
+            // write, also whatever is still queued once reading made room for it (shared memory rings)
+            if ((ev.events & POLL_EVENT_WRITE) || selector->tx.buf != NULL) {
                 LOG_TRACE("Write event received for selector %lld", selector->id);
                 nbytes = 0;
                 while (selector->tx.buf != NULL) {
@@ -399,6 +425,10 @@ i64_t poll_run(poll_p poll) {
                     if (nbytes == 0)
                         break;
                 }
+
+                // let the owner queue more as the peer takes what was sent
+                if (selector->tx.write_fn != NULL)
+                    selector->tx.write_fn(poll, selector);
             }
 
         next_event:;
@@ -410,12 +440,29 @@ i64_t poll_run(poll_p poll) {
 
 option_t poll_block_on(poll_p poll, selector_p selector) {
     option_t result;
-    fd_set readfds;
+    fd_set readfds, writefds;
     struct timeval timeout;
     i64_t nbytes, ret;
 
     LOG_TRACE("Blocking on selector id: %lld, fd: %lld", selector->id, selector->fd);
 
+    // Flush what is still queued, the peer can not answer before the whole request is out
+    while (selector->tx.buf != NULL) {
+        FD_ZERO(&writefds);
+        FD_SET(selector->fd, &writefds);
+        timeout.tv_sec = 3;
+        timeout.tv_usec = 0;
+
+        ret = select(selector->fd + 1, NULL, &writefds, NULL, &timeout);
+        if (ret <= 0)
+            return option_error(err_os());
+
+        if (poll_send(poll, selector) == -1) {
+            poll_deregister(poll, selector->id);
+            return option_error(err_os());
+        }
+    }
+
     // Perform the read operation
     while (selector->rx.buf != NULL) {
         // Setup select (must be done each iteration as select modifies these)
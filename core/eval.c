@@ -33,6 +33,7 @@
 #include "aggr.h"
 #include "cc.h"
 #include "env.h"
+#include "serve.h"
 
 // Thread-local VM pointer
 __thread vm_p __VM = NULL;
@@ -54,6 +55,8 @@ vm_p vm_create(i32_t id, struct pool_t *pool) {
     vm->trace = NULL_OBJ;
     vm->timeit = NULL;     // Lazy allocated when timing enabled
     vm->query_ctx = NULL;  // No active query context
+    vm->env = NULL_OBJ;    // Live globals
+    vm->locals = NULL_OBJ; // Locals kept in the lambdas
     vm->rc_sync = 0;       // Single-threaded by default
 
     // Set VM for this thread so heap_create can use it
@@ -91,6 +94,32 @@ nil_t vm_destroy(vm_p vm) {
 // Symbol Resolution
 // ============================================================================
 
+// A reader keeps the let-bound locals of each lambda it runs apart, as the lambdas are shared
+static obj_p *vm_locals(vm_p vm, obj_p fn) {
+    i64_t i, n;
+    obj_p fns, e = NULL_OBJ;
+
+    fns = AS_LIST(vm->locals)[0];
+    n = fns->len;
+    for (i = 0; i < n; i++)
+        if (AS_LIST(fns)[i] == fn)
+            return &AS_LIST(AS_LIST(vm->locals)[1])[i];
+
+    fn = clone_obj(fn);
+    push_raw(&AS_LIST(vm->locals)[0], &fn);
+    push_raw(&AS_LIST(vm->locals)[1], &e);
+
+    return &AS_LIST(AS_LIST(vm->locals)[1])[n];
+}
+
+// Where the let-bound locals of a lambda live
+static inline obj_p *lambda_env(vm_p vm, obj_p fn) {
+    if (LIKELY(vm->locals == NULL_OBJ))
+        return &AS_LAMBDA(fn)->env;
+
+    return vm_locals(vm, fn);
+}
+
 // Helper: resolve symbol in a lambda's env (unified args + locals)
 // Returns pointer to value slot, or NULL if not found
 // - offset < nargs: return stack pointer at fp_offset + offset
@@ -114,7 +143,7 @@ static obj_p *resolve_in_env(obj_p fn, i64_t sym, i64_t fp_offset) {
     }
 
     // Then check let-bound locals in env
-    env = AS_LAMBDA(fn)->env;
+    env = *lambda_env(vm, fn);
     if (env != NULL_OBJ && env->type == TYPE_DICT) {
         n = AS_LIST(env)[0]->len;
         for (i = 0; i < n; i++) {
@@ -133,7 +162,7 @@ static obj_p *resolve_in_env(obj_p fn, i64_t sym, i64_t fp_offset) {
 
 obj_p *resolve(i64_t sym) {
     i64_t j, frame;
-    obj_p fn, *result;
+    obj_p fn, env, *result;
     i64_t i, n;
     vm_p vm = VM;
 
@@ -168,11 +197,12 @@ obj_p *resolve(i64_t sym) {
     }
 
     // Search in globals
-    j = find_raw(AS_LIST(runtime_get()->env.variables)[0], &sym);
+    env = *env_variables();
+    j = find_raw(AS_LIST(env)[0], &sym);
     if (j == NULL_I64)
         return NULL;
 
-    return &AS_LIST(AS_LIST(runtime_get()->env.variables)[1])[j];
+    return &AS_LIST(AS_LIST(env)[1])[j];
 }
 
 obj_p amend(obj_p sym, obj_p val) {
@@ -181,7 +211,7 @@ obj_p amend(obj_p sym, obj_p val) {
 
     // Add to current lambda's env, or globals if at top level
     if (vm->fn != NULL_OBJ) {
-        env_slot = &AS_LAMBDA(vm->fn)->env;
+        env_slot = lambda_env(vm, vm->fn);
         if (*env_slot != NULL_OBJ)
             set_obj(env_slot, sym, clone_obj(val));
         else {
@@ -189,8 +219,12 @@ obj_p amend(obj_p sym, obj_p val) {
             AS_SYMBOL(AS_LIST(*env_slot)[0])[0] = sym->i64;
         }
     } else {
-        // Top level: add to globals
-        set_obj(&runtime_get()->env.variables, sym, clone_obj(val));
+        // Top level: add to globals, which a reader leaves to the main thread
+        if (serve_rerun()) {
+            drop_obj(val);
+            return err_nyi(0);
+        }
+        set_obj(env_variables(), sym, clone_obj(val));
     }
 
     return val;
@@ -480,7 +514,7 @@ OP_CALLF:
     }
 callf:
     // Compile if not already compiled
-    if (UNLIKELY(AS_LAMBDA(x)->bc == NULL_OBJ)) {
+    if (UNLIKELY(__atomic_load_n(&AS_LAMBDA(x)->bc, __ATOMIC_ACQUIRE) == NULL_OBJ)) {
         r = cc_compile(x);
         if (UNLIKELY(IS_ERR(r))) {
             drop_obj(x);
@@ -602,7 +636,7 @@ OP_LOADENV:
             push(clone_obj(x));
         } else {
             // Let-bound locals in env values
-            obj_p env = AS_LAMBDA(vm->fn)->env;
+            obj_p env = *lambda_env(vm, vm->fn);
             if (env != NULL_OBJ && env->type == TYPE_DICT) {
                 i64_t local_idx = n - nargs;
                 obj_p values = AS_LIST(env)[1];
@@ -625,7 +659,7 @@ OP_STOREENV:
     n = bc[ip++];
     {
         i64_t nargs = AS_LAMBDA(vm->fn)->args->len;
-        obj_p env = AS_LAMBDA(vm->fn)->env;
+        obj_p env = *lambda_env(vm, vm->fn);
         x = pop();  // value to store
 
         if (n < nargs) {
@@ -675,7 +709,7 @@ obj_p call(obj_p fn, i64_t arity) {
     UNUSED(arity);
 
     // Compile on first call - bytecode is cached in the lambda for reuse
-    if (lam->bc == NULL_OBJ) {
+    if (__atomic_load_n(&lam->bc, __ATOMIC_ACQUIRE) == NULL_OBJ) {
         res = cc_compile(fn);
         if (IS_ERR(res))
             return res;
@@ -719,6 +753,18 @@ static inline obj_p collect_lazy(obj_p x) {
     return x;
 }
 
+// A query over its memory budget fails at the next call boundary, the intermediates unwind through the callers
+static inline obj_p eval_budget(obj_p res) {
+    if (!heap_query_over() || IS_ERR(res))
+        return res;
+
+    drop_obj(res);
+    return err_limit((i32_t)(heap_get_limit() >> 20));
+}
+
+// A reader stops short of any side effect, its request runs again on the main thread
+static inline b8_t eval_effect(obj_p fn) { return UNLIKELY(fn->attrs & FN_EFFECT) && serve_rerun(); }
+
 // Evaluate and collect (unless aggregation function)
 static inline obj_p eval_arg(obj_p arg, b8_t is_aggr) {
     obj_p x = eval(arg);
@@ -730,15 +776,22 @@ static inline obj_p eval_arg(obj_p arg, b8_t is_aggr) {
 // Evaluate unary function call
 static obj_p eval_unary(obj_p fn, obj_p *args, i64_t id) {
     obj_p x, res;
+    i64_t site;
+
+    if (eval_effect(fn))
+        return unwrap(err_nyi(0), id);
 
     if (fn->attrs & FN_SPECIAL_FORM)
-        return ((unary_f)fn->i64)(args[0]);
+        return eval_budget(((unary_f)fn->i64)(args[0]));
 
     x = eval_arg(args[0], fn->attrs & FN_AGGR);
     if (IS_ERR(x))
         return x;
 
-    res = unary_call(fn, x);
+    // Allocations made by the builtin itself are profiled under its name
+    site = heap_prof_enter(fn->i64);
+    res = eval_budget(unary_call(fn, x));
+    heap_prof_leave(site);
     drop_obj(x);
     return unwrap(res, id);
 }
@@ -746,10 +799,14 @@ static obj_p eval_unary(obj_p fn, obj_p *args, i64_t id) {
 // Evaluate binary function call
 static obj_p eval_binary(obj_p fn, obj_p *args, i64_t id) {
     obj_p x, y, res;
+    i64_t site;
     b8_t is_aggr = fn->attrs & FN_AGGR;
 
+    if (eval_effect(fn))
+        return unwrap(err_nyi(0), id);
+
     if (fn->attrs & FN_SPECIAL_FORM)
-        return ((binary_f)fn->i64)(args[0], args[1]);
+        return eval_budget(((binary_f)fn->i64)(args[0], args[1]));
 
     x = eval_arg(args[0], is_aggr);
     if (IS_ERR(x))
@@ -761,7 +818,9 @@ static obj_p eval_binary(obj_p fn, obj_p *args, i64_t id) {
         return y;
     }
 
-    res = binary_call(fn, x, y);
+    site = heap_prof_enter(fn->i64);
+    res = eval_budget(binary_call(fn, x, y));
+    heap_prof_leave(site);
     drop_obj(x);
     drop_obj(y);
     return unwrap(res, id);
@@ -770,11 +829,14 @@ static obj_p eval_binary(obj_p fn, obj_p *args, i64_t id) {
 // Evaluate variadic function call
 static obj_p eval_vary(obj_p fn, obj_p *args, i64_t len, i64_t id) {
     obj_p x, res;
-    i64_t i;
+    i64_t i, site;
     b8_t is_aggr = fn->attrs & FN_AGGR;
 
+    if (eval_effect(fn))
+        return unwrap(err_nyi(0), id);
+
     if (fn->attrs & FN_SPECIAL_FORM) {
-        res = ((vary_f)fn->i64)(args, len);
+        res = eval_budget(((vary_f)fn->i64)(args, len));
         return (fn->i64 == (i64_t)ray_do) ? res : unwrap(res, id);
     }
 
@@ -788,7 +850,9 @@ static obj_p eval_vary(obj_p fn, obj_p *args, i64_t len, i64_t id) {
         vm_stack_push(x);
     }
 
-    res = vary_call(fn, vm_stack_peek(len - 1), len);
+    site = heap_prof_enter(fn->i64);
+    res = eval_budget(vary_call(fn, vm_stack_peek(len - 1), len));
+    heap_prof_leave(site);
 
     for (i = 0; i < len; i++)
         drop_obj(vm_stack_pop());
@@ -819,7 +883,7 @@ static obj_p eval_lambda(obj_p fn, obj_p *args, i64_t len, i64_t id) {
         vm_stack_push(x);
     }
 
-    return unwrap(lambda_call(fn, vm_stack_peek(len - 1), len), id);
+    return unwrap(eval_budget(lambda_call(fn, vm_stack_peek(len - 1), len)), id);
 }
 
 // Evaluate symbol lookup
@@ -931,7 +995,15 @@ obj_p ray_parse_str(i64_t fd, obj_p str, obj_p file) {
     return res;
 }
 
-obj_p eval_obj(obj_p obj) { return eval(obj); }
+obj_p eval_obj(obj_p obj) {
+    obj_p res;
+
+    heap_query_begin();
+    res = eval(obj);
+    heap_query_end();
+
+    return res;
+}
 
 obj_p eval_str_w_attr(lit_p str, i64_t len, obj_p nfo_arg) {
     obj_p parsed, res;
@@ -953,7 +1025,9 @@ obj_p eval_str_w_attr(lit_p str, i64_t len, obj_p nfo_arg) {
     if (vm)
         vm->nfo = nfo_arg;
 
+    heap_query_begin();
     res = eval(parsed);
+    heap_query_end();
     drop_obj(parsed);
 
     // Restore previous nfo
@@ -1010,7 +1084,8 @@ obj_p try_obj(obj_p obj, obj_p ctch) {
     // Simple try - just evaluate and catch errors
     res = eval(obj);
 
-    if (IS_ERR(res)) {
+    // A request a reader gave up on is not caught, nothing more of it runs there
+    if (IS_ERR(res) && !serve_aborted()) {
         obj_p *pfn;
         obj_p fn = ctch;
 
@@ -94,6 +94,8 @@ typedef struct vm_t {
     // === COLD section ===
     struct query_ctx_t *query_ctx;  // query context stack (for table column resolution)
     timeit_t *timeit;               // timeit (lazy allocated)
+    obj_p env;                      // snapshot of the globals a reader evaluates against, NULL_OBJ for the live ones
+    obj_p locals;                   // (lambdas envs) a reader ran, their locals kept off the shared lambdas, NULL_OBJ elsewhere
 } __attribute__((aligned(64))) * vm_p;
 
 // Thread-local VM pointer
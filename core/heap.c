@@ -33,6 +33,9 @@
 #include "os.h"
 #include "log.h"
 #include "eval.h"
+#include "pool.h"
+#include "runtime.h"
+#include "serve.h"
 
 #ifndef __EMSCRIPTEN__
 RAY_ASSERT(sizeof(struct block_t) == (2 * sizeof(struct obj_t)), "block_t must be 2x obj_t");
@@ -44,10 +47,57 @@ RAY_ASSERT(sizeof(struct block_t) == (2 * sizeof(struct obj_t)), "block_t must b
 #define ORDEROF(s) (64ll - __builtin_clzll((s) - 1))
 #define BLOCK2RAW(b) ((raw_p)((i64_t)(b) + sizeof(struct obj_t)))
 #define RAW2BLOCK(r) ((block_p)((i64_t)(r) - sizeof(struct obj_t)))
+#define SLAB_CARVE_ORDER 12             // slabs are refilled by carving 4KB buddy blocks
+#define SLAB_CACHE_SIZE (RAY_PAGE_SIZE * 16)  // cached bytes per order before half of them go back
 #define DEFAULT_HEAP_SWAP "./"
 
+static i64_t __SCAVENGE_INTERVAL = 0;  // ms between scavenger passes, 0 - off
+static i64_t __SCAVENGE_KEEP = 0;      // bytes of free pools the main heap keeps warm
+static i64_t __SCAVENGE_NEXT = 0;
+
+// Per-query memory budget: live bytes of all executor heaps are measured against the mark taken when the
+// top-level query started
+static i64_t __QUERY_LIMIT = 0;  // 0 - unlimited
+static i64_t __QUERY_MARK = 0;
+static i64_t __QUERY_DEPTH = 0;
+static b8_t __QUERY_OVER = B8_FALSE;
+
+// RSS soft limit: past it, standalone pools of at least __SPILL_MIN bytes are backed by files in the swap directory
+static i64_t __SPILL_SOFT = 0;
+static i64_t __SPILL_MIN = BSIZEOF(MAX_BLOCK_ORDER);
+
+// Query arenas: opened by query contexts on the main thread, used by every executor for temporaries
+static i64_t __ARENA_DEPTH = 0;
+
+#define ARENA_MAX_ALLOC (BSIZEOF(ARENA_CHUNK_ORDER) / 4)  // bigger temporaries come from the buddies
+
+// Readers run queries of their own alongside the main thread: they take no part in its arenas and budget
+#define HEAP_IN_QUERY(h) ((h)->id < SERVE_HEAP_ID)
+
+// Allocation profiler: counters are shared by all executors, sites are switched by the main thread only
+static b8_t __PROF = B8_FALSE;
+static heap_prof_t __PROF_TYPES[256];
+static heap_prof_t __PROF_SITES[PROF_SITES];
+static i64_t __PROF_KEYS[PROF_SITES];  // site 0 is the top level
+static i64_t __PROF_SITE = 0;
+
+#define PROF_ADD(v, n) __atomic_add_fetch(&(v), (n), __ATOMIC_RELAXED)
+#define PROF_MAX(v, n)                                     \
+    do {                                                   \
+        if ((n) > __atomic_load_n(&(v), __ATOMIC_RELAXED)) \
+            __atomic_store_n(&(v), (n), __ATOMIC_RELAXED); \
+    } while (0)
+
+// Only the owning thread writes its counter, others just sum them up
+#define LIVE_ADD(h, n) __atomic_store_n(&(h)->live, (h)->live + (n), __ATOMIC_RELAXED)
+
+static nil_t heap_slab_flush(heap_p heap, i64_t slab, i64_t keep);
+static nil_t heap_drain(heap_p heap);
+static i64_t heap_live(nil_t);
+
 heap_p heap_create(i64_t id) {
     heap_p heap;
+    c8_t buf[32];
 
     LOG_INFO("Creating heap with id %lld", id);
     heap = (heap_p)mmap_alloc(sizeof(struct heap_t));
@@ -59,9 +109,17 @@ heap_p heap_create(i64_t id) {
 
     heap->id = id;
     heap->avail = 0;
+    heap->live = 0;
+    heap->arena = NULL;
+    heap->arena_ptr = NULL;
+    heap->arena_end = NULL;
+    heap->temps = 0;
     heap->foreign_blocks = NULL;
+    heap->remote_blocks = NULL;
 
     memset(heap->freelist, 0, sizeof(heap->freelist));
+    memset(heap->slabs, 0, sizeof(heap->slabs));
+    memset(heap->slabs_count, 0, sizeof(heap->slabs_count));
 
     // Initialize swap path from environment or use default
     if (os_get_var("HEAP_SWAP", heap->swap_path, sizeof(heap->swap_path)) == -1) {
@@ -81,6 +139,28 @@ heap_p heap_create(i64_t id) {
         }
     }
 
+    // Scavenger settings are process wide, take them once with the main heap
+    if (id == 0) {
+        if (os_get_var("HEAP_SCAVENGE_MS", buf, sizeof(buf)) != -1)
+            i64_from_str(buf, strlen(buf), &__SCAVENGE_INTERVAL);
+        if (os_get_var("HEAP_SCAVENGE_KEEP_MB", buf, sizeof(buf)) != -1) {
+            i64_from_str(buf, strlen(buf), &__SCAVENGE_KEEP);
+            __SCAVENGE_KEEP <<= 20;
+        }
+        if (os_get_var("HEAP_SOFT_LIMIT_MB", buf, sizeof(buf)) != -1) {
+            i64_from_str(buf, strlen(buf), &__SPILL_SOFT);
+            __SPILL_SOFT <<= 20;
+        }
+        if (os_get_var("HEAP_SPILL_MIN_MB", buf, sizeof(buf)) != -1) {
+            i64_from_str(buf, strlen(buf), &__SPILL_MIN);
+            __SPILL_MIN <<= 20;
+            if (__SPILL_MIN < BSIZEOF(MAX_BLOCK_ORDER))  // smaller pools are shared by many blocks
+                __SPILL_MIN = BSIZEOF(MAX_BLOCK_ORDER);
+        }
+        if (os_get_var("HEAP_PROFILE", buf, sizeof(buf)) != -1)
+            __PROF = (buf[0] != '\0' && buf[0] != '0');
+    }
+
     LOG_DEBUG("Heap created successfully with swap path: %s", heap->swap_path);
     return heap;
 }
@@ -98,6 +178,11 @@ nil_t heap_destroy(heap_p heap) {
     if (heap->foreign_blocks != NULL)
         LOG_WARN("Heap[%lld]: foreign blocks not freed", heap->id);
 
+    heap_drain(heap);
+
+    for (i = 0; i < SLAB_ORDERS; i++)
+        heap_slab_flush(heap, i, 0);
+
     // All the nodes remains are pools, so just munmap them
     for (i = MIN_BLOCK_ORDER; i <= MAX_POOL_ORDER; i++) {
         block = heap->freelist[i];
@@ -140,63 +225,156 @@ i64_t heap_gc(nil_t) { return 0; }
 nil_t heap_borrow(heap_p heap) { UNUSED(heap); }
 nil_t heap_merge(heap_p heap) { UNUSED(heap); }
 memstat_t heap_memstat(nil_t) { return (memstat_t){0}; }
+i64_t heap_scavenge(heap_p heap, i64_t keep) {
+    UNUSED(heap);
+    UNUSED(keep);
+    return 0;
+}
+i64_t heap_scavenge_tick(i64_t now) {
+    UNUSED(now);
+    return -1;
+}
+nil_t heap_set_limit(i64_t bytes) { UNUSED(bytes); }
+nil_t heap_set_soft_limit(i64_t bytes) { UNUSED(bytes); }
+i64_t heap_get_limit(nil_t) { return 0; }
+nil_t heap_query_begin(nil_t) {}
+nil_t heap_query_end(nil_t) {}
+i64_t heap_query_used(nil_t) { return 0; }
+i64_t heap_query_left(nil_t) { return -1; }
+b8_t heap_query_over(nil_t) { return B8_FALSE; }
+nil_t heap_arena_begin(nil_t) {}
+nil_t heap_arena_end(nil_t) {}
+nil_t heap_temp_begin(nil_t) {}
+nil_t heap_temp_end(nil_t) {}
+static nil_t heap_slab_flush(heap_p heap, i64_t slab, i64_t keep) {
+    UNUSED(heap);
+    UNUSED(slab);
+    UNUSED(keep);
+}
+static nil_t heap_drain(heap_p heap) { UNUSED(heap); }
+nil_t heap_prof_set(b8_t on) { UNUSED(on); }
+b8_t heap_prof_get(nil_t) { return B8_FALSE; }
+nil_t heap_prof_tag(raw_p ptr, i8_t type) {
+    UNUSED(ptr);
+    UNUSED(type);
+}
+i64_t heap_prof_enter(i64_t site) {
+    UNUSED(site);
+    return 0;
+}
+nil_t heap_prof_leave(i64_t prev) { UNUSED(prev); }
+nil_t heap_prof_types(heap_prof_t stats[256]) { memset(stats, 0, sizeof(heap_prof_t) * 256); }
+i64_t heap_prof_sites(i64_t sites[PROF_SITES], heap_prof_t stats[PROF_SITES]) {
+    UNUSED(sites);
+    UNUSED(stats);
+    return 0;
+}
 
 #else
 
-block_p heap_add_pool(i64_t size) {
-    i64_t id;
-    i64_t fd;
+// Pool backed by a file in the swap directory, the file goes away with the pool
+static block_p heap_map_file(heap_p heap, i64_t size) {
+    i64_t id, fd;
     block_p block;
     c8_t filename[128];
-    heap_p heap = VM->heap;  // Cache heap pointer
 
-    LOG_TRACE("Adding pool of size %lld", size);
+    id = ops_rand_u64();
+    snprintf(filename, sizeof(filename), "%svec_%llu.dat", heap->swap_path, id);
+    fd = fs_fopen(filename, ATTR_RDWR | ATTR_CREAT);
 
-    block = (block_p)mmap_alloc(size);
+    if (fd == -1) {
+        perror("can't create mmap backed file");
+        return NULL;
+    }
+
+    // Set initial file size if the file
+    if (fs_file_extend(fd, size) == -1) {
+        perror("can't truncate mmap backed file");
+        fs_fclose(fd);
+        return NULL;
+    }
+
+    // Mapped for sequential access, spilled data is mostly scanned
+    block = (block_p)mmap_file_shared(fd, NULL, size, 0);
 
     if (block == NULL) {
-        // Try to mmap with a file
-        id = ops_rand_u64();
-        snprintf(filename, sizeof(filename), "%svec_%llu.dat", heap->swap_path, id);
-        fd = fs_fopen(filename, ATTR_RDWR | ATTR_CREAT);
+        fs_fclose(fd);
+        perror("can't mmap file");
+        return NULL;
+    }
 
-        if (fd == -1) {
-            perror("can't create mmap backed file");
-            return NULL;
-        }
+    block->pool = (block_p)fd;
+    block->backed = B8_TRUE;
+    heap->memstat.spill += size;
 
-        // Set initial file size if the file
-        if (fs_file_extend(fd, size) == -1) {
-            perror("can't truncate mmap backed file");
-            fs_fclose(fd);
-            return NULL;
-        }
+    return block;
+}
 
-        block = (block_p)mmap_file_shared(fd, NULL, size, 0);
+// Anonymous heap memory of all the executors, a cheap upper bound of what the heap adds to the RSS
+static i64_t heap_anon(nil_t) {
+    i64_t i, total = 0;
+    pool_p pool = (runtime_get() != NULL) ? runtime_get()->pool : NULL;
 
-        if (block == NULL) {
-            fs_fclose(fd);
-            perror("can't mmap file");
-            return NULL;
-        }
+    if (pool == NULL)
+        return VM->heap->memstat.heap - VM->heap->memstat.spill;
 
-        block->pool = (block_p)fd;
-        block->backed = B8_TRUE;
-    } else {
-        block->pool = block;
-        block->backed = B8_FALSE;
+    for (i = 0; i < pool->executors_count; i++)
+        total += pool->executors[i].heap->memstat.heap - pool->executors[i].heap->memstat.spill;
+
+    return total;
+}
+
+// Past the soft limit large standalone pools are spilled to files instead of growing the RSS
+static b8_t heap_spill_due(i64_t size) {
+    return __SPILL_SOFT > 0 && size >= __SPILL_MIN && heap_anon() + size > __SPILL_SOFT;
+}
+
+block_p heap_add_pool(i64_t size, b8_t spill) {
+    block_p block;
+    i64_t pages = MMAP_PAGES_SMALL;
+    heap_p heap = VM->heap;  // Cache heap pointer
+
+    LOG_TRACE("Adding pool of size %lld", size);
+
+    block = spill ? heap_map_file(heap, size) : NULL;
+
+    if (block == NULL) {
+        block = (block_p)mmap_alloc_huge(size, &pages);
+
+        if (block != NULL) {
+            block->pool = block;
+            block->backed = B8_FALSE;
+        } else if (!spill)
+            block = heap_map_file(heap, size);  // last resort when the system is out of memory
+
+        if (block == NULL)
+            return NULL;
     }
 
     block->pool_order = ORDEROF(size);
+    block->mode = (pages == MMAP_PAGES_HUGETLB) ? BLOCK_MODE_HUGE : (pages == MMAP_PAGES_ADVISED) ? BLOCK_MODE_THP : 0;
 
     heap->memstat.system += size;
     heap->memstat.heap += size;
+    if (pages == MMAP_PAGES_HUGETLB)
+        heap->memstat.huge += size;
+    else if (pages == MMAP_PAGES_ADVISED)
+        heap->memstat.thp += size;
 
     return block;
 }
 
 nil_t heap_remove_pool(block_p block, i64_t size) {
     heap_p heap = VM->heap;  // Cache heap pointer
+
+    if (block->mode & BLOCK_MODE_HUGE)
+        heap->memstat.huge -= size;
+    if (block->mode & BLOCK_MODE_THP)
+        heap->memstat.thp -= size;
+
+    if (block->backed)
+        heap->memstat.spill -= size;
+
     mmap_free(block, size);
 
     heap->memstat.system -= size;
@@ -210,6 +388,7 @@ inline __attribute__((always_inline)) nil_t heap_insert_block(heap_p heap, block
     block->next = heap->freelist[order];
     block->used = 0;
     block->order = order;
+    block->heap_id = heap->id;  // free blocks tell whose freelist they are on
 
     if (heap->freelist[order] != NULL)
         heap->freelist[order]->prev = block;
@@ -240,6 +419,7 @@ inline __attribute__((always_inline)) nil_t heap_split_block(heap_p heap, block_
         buddy = (block_p)((i64_t)block + BSIZEOF(order));
         buddy->pool = block->pool;
         buddy->pool_order = block->pool_order;
+        buddy->mode = block->mode & BLOCK_MODE_DISCARDED;
         heap_insert_block(heap, buddy, order);
     }
 }
@@ -267,18 +447,9 @@ raw_p heap_stack(i64_t size) {
     return ptr;
 }
 
-raw_p __attribute__((hot)) heap_alloc(i64_t size) {
-    i64_t i, order, block_size;
+static block_p heap_alloc_block(heap_p heap, i64_t order) {
+    i64_t i, size;
     block_p block;
-    heap_p heap = VM->heap;  // Cache heap pointer to avoid repeated VM calls
-
-    if (size == 0 || size > BSIZEOF(MAX_POOL_ORDER))
-        return NULL;
-
-    block_size = BLOCKSIZE(size);
-
-    // calculate minimal order for this size
-    order = ORDEROF(block_size);
 
     // find least order block that fits
     i = (AVAIL_MASK << order) & heap->avail;
@@ -287,9 +458,9 @@ raw_p __attribute__((hot)) heap_alloc(i64_t size) {
     // add a new pool and split as well
     if (i == 0) {
         if (order >= MAX_BLOCK_ORDER) {
-            LOG_TRACE("Adding pool of size %lld requested size %lld", BSIZEOF(order), size);
             size = BSIZEOF(order);
-            block = heap_add_pool(size);
+            LOG_TRACE("Adding pool of size %lld", size);
+            block = heap_add_pool(size, heap_spill_due(size));
 
             if (block == NULL)
                 return NULL;
@@ -300,10 +471,10 @@ raw_p __attribute__((hot)) heap_alloc(i64_t size) {
 
             heap->memstat.system += size;
 
-            return BLOCK2RAW(block);
+            return block;
         }
 
-        block = heap_add_pool(BSIZEOF(MAX_BLOCK_ORDER));
+        block = heap_add_pool(BSIZEOF(MAX_BLOCK_ORDER), B8_FALSE);
 
         if (block == NULL)
             return NULL;
@@ -326,18 +497,267 @@ raw_p __attribute__((hot)) heap_alloc(i64_t size) {
 
     block->order = order;
     block->used = 1;
+    block->mode &= ~BLOCK_MODE_DISCARDED;
+    block->heap_id = heap->id;
+    block->backed = B8_FALSE;
+
+    return block;
+}
+
+// Refills an empty slab: one buddy block is carved into a batch of small ones, those stay marked
+// as used for the buddy allocator while they sit in the cache
+static block_p heap_slab_refill(heap_p heap, i64_t order) {
+    i64_t i, n, size;
+    block_p carved, block, slab;
+
+    carved = heap_alloc_block(heap, SLAB_CARVE_ORDER);
+    if (carved == NULL)
+        return NULL;
+
+    size = BSIZEOF(order);
+    n = BSIZEOF(SLAB_CARVE_ORDER - order);
+    slab = NULL;
+
+    // Keep the first one for the caller
+    for (i = n - 1; i > 0; i--) {
+        block = (block_p)((i64_t)carved + i * size);
+        block->pool = carved->pool;
+        block->pool_order = carved->pool_order;
+        block->order = order;
+        block->used = 1;
+        block->mode = 0;
+        block->heap_id = heap->id;
+        block->backed = B8_FALSE;
+        block->next = slab;
+        slab = block;
+    }
+
+    carved->order = order;
+    heap->slabs[order - MIN_BLOCK_ORDER] = slab;
+    heap->slabs_count[order - MIN_BLOCK_ORDER] = n - 1;
+
+    return carved;
+}
+
+// Temporaries get a block header of their own so that drop_obj/heap_free can tell them apart, the exact size
+// is kept in place of the pool pointer for heap_realloc
+static raw_p heap_arena_alloc(heap_p heap, i64_t size) {
+    i64_t need;
+    block_p block, chunk;
+
+    need = (BLOCKSIZE(size) + 15) & ~15ll;
+
+    if (heap->arena == NULL || heap->arena_ptr + need > heap->arena_end) {
+        chunk = (block_p)heap_alloc(BSIZEOF(ARENA_CHUNK_ORDER) - sizeof(struct obj_t));
+        if (chunk == NULL)
+            return NULL;
+
+        chunk = RAW2BLOCK(chunk);
+        chunk->next = heap->arena;
+        heap->arena = chunk;
+        heap->arena_ptr = (u8_t *)chunk + sizeof(struct block_t);
+        heap->arena_end = (u8_t *)chunk + BSIZEOF(ARENA_CHUNK_ORDER);
+    }
+
+    block = (block_p)heap->arena_ptr;
+    heap->arena_ptr += need;
+
+    block->order = ORDEROF(BLOCKSIZE(size));
+    block->used = 1;
+    block->pool_order = 0;
+    block->mode = BLOCK_MODE_ARENA;
     block->heap_id = heap->id;
     block->backed = B8_FALSE;
+    block->pool = (block_p)size;
+
+    return BLOCK2RAW(block);
+}
+
+// Type counters follow the objects, live bytes drop when they are freed
+static inline nil_t heap_prof_add(u8_t tag, i64_t count, i64_t bytes, i64_t live) {
+    i64_t v;
+    heap_prof_t *stat = &__PROF_TYPES[tag ^ 0x80];
+
+    PROF_ADD(stat->count, count);
+    PROF_ADD(stat->bytes, bytes);
+    v = PROF_ADD(stat->live, live);
+    PROF_MAX(stat->peak, v);
+}
+
+// Site counters take every allocation, the peak is sampled on the bigger ones only as it sums up all the heaps
+static nil_t heap_prof_alloc(i64_t size, b8_t sample) {
+    i64_t v;
+    heap_prof_t *stat = &__PROF_SITES[__atomic_load_n(&__PROF_SITE, __ATOMIC_RELAXED)];
+
+    PROF_ADD(stat->count, 1);
+    PROF_ADD(stat->bytes, size);
+
+    if (sample) {
+        v = heap_live();
+        PROF_MAX(stat->peak, v);
+    }
+}
+
+raw_p __attribute__((hot)) heap_alloc(i64_t size) {
+    i64_t order, slab;
+    block_p block;
+    heap_p heap = VM->heap;  // Cache heap pointer to avoid repeated VM calls
+
+    if (size == 0 || size > BSIZEOF(MAX_POOL_ORDER))
+        return NULL;
+
+    // Take back what other threads have freed before going for new blocks
+    if (__atomic_load_n(&heap->remote_blocks, __ATOMIC_RELAXED) != NULL)
+        heap_drain(heap);
+
+    if (heap->temps > 0 && __ARENA_DEPTH > 0 && size <= ARENA_MAX_ALLOC && HEAP_IN_QUERY(heap))
+        return heap_arena_alloc(heap, size);
+
+    // calculate minimal order for this size
+    order = ORDEROF(BLOCKSIZE(size));
+
+    if (order <= SLAB_MAX_ORDER) {
+        slab = order - MIN_BLOCK_ORDER;
+        block = heap->slabs[slab];
+
+        if (block == NULL) {
+            block = heap_slab_refill(heap, order);
+            if (block == NULL)
+                return NULL;
+        } else {
+            heap->slabs[slab] = block->next;
+            heap->slabs_count[slab]--;
+        }
+
+        LIVE_ADD(heap, BSIZEOF(order));
+        block->tag = 0;
+
+        if (__PROF)
+            heap_prof_alloc(BSIZEOF(order), B8_FALSE);
+
+        return BLOCK2RAW(block);
+    }
+
+    block = heap_alloc_block(heap, order);
+
+    if (block == NULL)
+        return NULL;
+
+    LIVE_ADD(heap, BSIZEOF(order));
+    block->tag = 0;
+
+    if (__PROF)
+        heap_prof_alloc(BSIZEOF(order), B8_TRUE);
+
+    // Small blocks can't push a query far past its budget, so the sums are only taken for the bigger ones
+    if (__QUERY_LIMIT > 0 && __QUERY_DEPTH > 0 && HEAP_IN_QUERY(heap) && heap_query_used() > __QUERY_LIMIT)
+        __atomic_store_n(&__QUERY_OVER, B8_TRUE, __ATOMIC_RELAXED);
 
     return BLOCK2RAW(block);
 }
 
+static nil_t heap_free_block(heap_p heap, block_p block, i64_t order) {
+    block_p buddy;
+    u8_t discarded;
+
+    for (;; order++) {
+        // check if we are at the root block (no buddies left)
+        if (block->pool_order == order)
+            return heap_insert_block(heap, block, order);
+
+        // calculate buddy
+        buddy = BUDDYOF(block, order);
+
+        // buddy is used, of different order, or on the freelist of another heap, so we can't merge
+        if (buddy->used || buddy->order != order || buddy->heap_id != heap->id)
+            return heap_insert_block(heap, block, order);
+
+        // merge blocks: remove buddy from its freelist.
+        heap_remove_block(heap, buddy, order);
+
+        // merged block stays discarded only if both halves were
+        discarded = block->mode & buddy->mode & BLOCK_MODE_DISCARDED;
+
+        // check if buddy is lower address than block (means it is of higher order), if so, swap them
+        block = (buddy < block) ? buddy : block;
+        block->mode = (block->mode & ~BLOCK_MODE_DISCARDED) | discarded;
+    }
+}
+
+// Returns cached blocks of a slab to the buddies until only keep of them are left
+static nil_t heap_slab_flush(heap_p heap, i64_t slab, i64_t keep) {
+    block_p block;
+
+    while (heap->slabs_count[slab] > keep) {
+        block = heap->slabs[slab];
+        heap->slabs[slab] = block->next;
+        heap->slabs_count[slab]--;
+        heap_free_block(heap, block, slab + MIN_BLOCK_ORDER);
+    }
+}
+
+static nil_t heap_free_local(heap_p heap, block_p block, i64_t order) {
+    i64_t slab;
+
+    LIVE_ADD(heap, -BSIZEOF(order));
+
+    // Small blocks go back to the slab, half of it returns to the buddies once it grows too big
+    if (order <= SLAB_MAX_ORDER) {
+        slab = order - MIN_BLOCK_ORDER;
+        block->next = heap->slabs[slab];
+        heap->slabs[slab] = block;
+
+        if (++heap->slabs_count[slab] > (SLAB_CACHE_SIZE >> order))
+            heap_slab_flush(heap, slab, SLAB_CACHE_SIZE >> (order + 1));
+
+        return;
+    }
+
+    heap_free_block(heap, block, order);
+}
+
+// Executors are indexed by their heap ids, NULL if the owner is gone or not there yet
+static heap_p heap_owner(i64_t id) {
+    runtime_p runtime = runtime_get();
+
+    if (id >= SERVE_HEAP_ID)
+        return serve_heap(id);
+
+    if (runtime == NULL || runtime->pool == NULL || id >= runtime->pool->executors_count)
+        return NULL;
+
+    return runtime->pool->executors[id].heap;
+}
+
+// Any thread may push (MPSC), so the head is swapped in with a CAS; the owner takes the whole list at once
+static nil_t heap_remote_push(heap_p heap, block_p block) {
+    block_p head = __atomic_load_n(&heap->remote_blocks, __ATOMIC_RELAXED);
+
+    do {
+        block->next = head;
+    } while (!__atomic_compare_exchange_n(&heap->remote_blocks, &head, block, B8_TRUE, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+// Must be called by the owner of the heap (or with the owner parked)
+static nil_t heap_drain(heap_p heap) {
+    block_p block, next;
+
+    block = __atomic_exchange_n(&heap->remote_blocks, NULL, __ATOMIC_ACQUIRE);
+
+    while (block != NULL) {
+        next = block->next;
+        block->heap_id = heap->id;
+        heap_free_local(heap, block, block->order);
+        block = next;
+    }
+}
+
 __attribute__((hot)) nil_t heap_free(raw_p ptr) {
-    block_p block, buddy;
-    i64_t fd, res;
-    i64_t order;
+    block_p block;
+    i64_t fd, res, order;
     c8_t filename[64];
-    heap_p heap = VM->heap;  // Cache heap pointer
+    heap_p owner, heap = VM->heap;  // Cache heap pointer
 
     if (ptr == NULL || ptr == NULL_OBJ)
         return;
@@ -345,6 +765,16 @@ __attribute__((hot)) nil_t heap_free(raw_p ptr) {
     block = RAW2BLOCK(ptr);
     order = block->order;
 
+    // Temporaries go away with their arena
+    if (block->mode & BLOCK_MODE_ARENA)
+        return;
+
+    // Untagged even with the profiler off, so that it stays consistent when switched back on
+    if (block->tag != 0) {
+        heap_prof_add(block->tag, 0, 0, -BSIZEOF(order));
+        block->tag = 0;
+    }
+
     // Validate block metadata - detect memory corruption or invalid pointers
     // backed should only be 0 or 1, order should be >= MIN_BLOCK_ORDER for heap blocks
     if (block->backed != B8_FALSE && block->backed != B8_TRUE) {
@@ -357,6 +787,7 @@ __attribute__((hot)) nil_t heap_free(raw_p ptr) {
 
     // Return block to the system and close file if it is file-backed
     if (block->backed) {
+        LIVE_ADD(heap, -BSIZEOF(order));
         fd = (i64_t)block->pool;
         heap_remove_pool(block, BSIZEOF(order));
         // Get filename before closing - ignore errors as file may already be gone
@@ -368,35 +799,30 @@ __attribute__((hot)) nil_t heap_free(raw_p ptr) {
         return;
     }
 
-    if (heap->id != 0 && block->heap_id != heap->id) {
-        block->next = heap->foreign_blocks;
-        heap->foreign_blocks = block;
-        return;
-    }
+    // Workers hand blocks of other heaps to their owners, the main heap takes anything but what the
+    // readers own: unlike executors, they keep running between pool runs
+    if (block->heap_id != heap->id && (heap->id != 0 || block->heap_id >= SERVE_HEAP_ID)) {
+        owner = heap_owner(block->heap_id);
 
-    for (;; order++) {
-        // check if we are at the root block (no buddies left)
-        if (block->pool_order == order)
-            return heap_insert_block(heap, block, order);
-
-        // calculate buddy
-        buddy = BUDDYOF(block, order);
-
-        // buddy is used, or buddy is of different order, so we can't merge
-        if (buddy->used || buddy->order != order)
-            return heap_insert_block(heap, block, order);
-
-        // merge blocks: remove buddy from its freelist.
-        heap_remove_block(heap, buddy, order);
+        if (owner != NULL) {
+            heap_remote_push(owner, block);
+            return;
+        }
 
-        // check if buddy is lower address than block (means it is of higher order), if so, swap them
-        block = (buddy < block) ? buddy : block;
+        if (heap->id != 0) {
+            block->next = heap->foreign_blocks;
+            heap->foreign_blocks = block;
+            return;
+        }
     }
+
+    heap_free_local(heap, block, order);
 }
 
 __attribute__((hot)) raw_p heap_realloc(raw_p ptr, i64_t new_size) {
     block_p block;
     i64_t i, old_size, cap, order;
+    u8_t tag;
     raw_p new_ptr;
     heap_p heap = VM->heap;  // Cache heap pointer
 
@@ -408,6 +834,15 @@ __attribute__((hot)) raw_p heap_realloc(raw_p ptr, i64_t new_size) {
     cap = BLOCKSIZE(new_size);
     order = ORDEROF(cap);
 
+    if (block->mode & BLOCK_MODE_ARENA) {
+        new_ptr = heap_alloc(new_size);
+
+        if (new_ptr != NULL)
+            memcpy(new_ptr, ptr, ((i64_t)block->pool < new_size) ? (i64_t)block->pool : new_size);
+
+        return new_ptr;
+    }
+
     if (block->order == order)
         return ptr;
 
@@ -421,13 +856,24 @@ __attribute__((hot)) raw_p heap_realloc(raw_p ptr, i64_t new_size) {
         }
 
         memcpy(new_ptr, ptr, old_size - sizeof(struct obj_t));
+        tag = block->tag;
         heap_free(ptr);
 
+        // The object moves, its type keeps the bytes
+        if (tag != 0) {
+            block = RAW2BLOCK(new_ptr);
+            block->tag = tag;
+            heap_prof_add(tag, 0, BSIZEOF(block->order), BSIZEOF(block->order));
+        }
+
         return new_ptr;
     }
 
     // shrink
     i = block->order;
+    LIVE_ADD(heap, BSIZEOF(order) - BSIZEOF(i));
+    if (block->tag != 0)
+        heap_prof_add(block->tag, 0, 0, BSIZEOF(order) - BSIZEOF(i));
     block->order = order;
     heap_split_block(heap, block, order, i);
 
@@ -445,6 +891,12 @@ i64_t heap_gc(nil_t) {
     block_p block, next;
     heap_p h = VM->heap;  // Cache heap pointer
 
+    heap_drain(h);
+
+    // Cached small blocks pin their pools, give them back first
+    for (i = 0; i < SLAB_ORDERS; i++)
+        heap_slab_flush(h, i, 0);
+
     for (i = MAX_BLOCK_ORDER; i <= MAX_POOL_ORDER; i++) {
         block = h->freelist[i];
         size = BSIZEOF(i);
@@ -465,6 +917,243 @@ i64_t heap_gc(nil_t) {
     return total;
 }
 
+// Returns idle memory of a heap to the OS: fully free pools beyond keep bytes are unmapped, large free blocks of
+// pools still in use get their pages discarded (all but the first one, it holds the block header)
+i64_t heap_scavenge(heap_p heap, i64_t keep) {
+    i64_t i, size, total = 0;
+    block_p block, next;
+
+    for (i = MAX_POOL_ORDER; i >= SCAVENGE_MIN_ORDER; i--) {
+        block = heap->freelist[i];
+        size = BSIZEOF(i);
+
+        while (block) {
+            next = block->next;
+
+            if (block->backed || (block->mode & BLOCK_MODE_DISCARDED)) {
+                block = next;
+                continue;
+            }
+
+            if (i == block->pool_order && keep >= size) {
+                keep -= size;
+            } else if (i == block->pool_order) {
+                heap_remove_block(heap, block, i);
+
+                if (block->mode & BLOCK_MODE_HUGE)
+                    heap->memstat.huge -= size;
+                if (block->mode & BLOCK_MODE_THP)
+                    heap->memstat.thp -= size;
+
+                mmap_free(block, size);
+                heap->memstat.system -= size;
+                heap->memstat.heap -= size;
+                total += size;
+            } else if (mmap_discard((u8_t *)block + RAY_PAGE_SIZE, size - RAY_PAGE_SIZE) == 0) {
+                block->mode |= BLOCK_MODE_DISCARDED;
+                total += size - RAY_PAGE_SIZE;
+            }
+
+            block = next;
+        }
+    }
+
+    return total;
+}
+
+// Called from the event loop of the main thread, executors are parked in between pool runs so their heaps
+// can be walked from here
+i64_t heap_scavenge_tick(i64_t now) {
+    i64_t i, total;
+    pool_p pool;
+
+    if (__SCAVENGE_INTERVAL <= 0)
+        return -1;
+
+    if (now >= __SCAVENGE_NEXT) {
+        pool = runtime_get()->pool;
+        total = heap_scavenge(VM->heap, __SCAVENGE_KEEP);
+
+        for (i = 1; i < pool->executors_count; i++)
+            total += heap_scavenge(pool->executors[i].heap, 0);
+
+        if (total > 0)
+            LOG_DEBUG("Scavenger returned %lld bytes to the OS", total);
+
+        VM->heap->memstat.scav += total;
+        __SCAVENGE_NEXT = now + __SCAVENGE_INTERVAL;
+    }
+
+    return __SCAVENGE_NEXT - now;
+}
+
+nil_t heap_set_limit(i64_t bytes) { __QUERY_LIMIT = (bytes > 0) ? bytes : 0; }
+
+i64_t heap_get_limit(nil_t) { return __QUERY_LIMIT; }
+
+nil_t heap_set_soft_limit(i64_t bytes) { __SPILL_SOFT = bytes; }
+
+static i64_t heap_live(nil_t) {
+    i64_t i, total = 0;
+    pool_p pool = (runtime_get() != NULL) ? runtime_get()->pool : NULL;
+
+    if (pool == NULL)
+        return VM->heap->live;
+
+    for (i = 0; i < pool->executors_count; i++)
+        total += __atomic_load_n(&pool->executors[i].heap->live, __ATOMIC_RELAXED);
+
+    return total;
+}
+
+// Nested evaluations (load, eval) stay within the budget of the outermost query
+nil_t heap_query_begin(nil_t) {
+    if (!HEAP_IN_QUERY(VM->heap) || __QUERY_DEPTH++ > 0 || __QUERY_LIMIT == 0)
+        return;
+
+    __QUERY_MARK = heap_live();
+    __QUERY_OVER = B8_FALSE;
+}
+
+nil_t heap_query_end(nil_t) {
+    if (HEAP_IN_QUERY(VM->heap) && __QUERY_DEPTH > 0)
+        __QUERY_DEPTH--;
+}
+
+i64_t heap_query_used(nil_t) {
+    return (__QUERY_DEPTH > 0 && HEAP_IN_QUERY(VM->heap)) ? heap_live() - __QUERY_MARK : 0;
+}
+
+i64_t heap_query_left(nil_t) {
+    i64_t left;
+
+    if (__QUERY_LIMIT == 0 || !HEAP_IN_QUERY(VM->heap))
+        return -1;
+
+    left = __QUERY_LIMIT - heap_query_used();
+
+    return (left > 0) ? left : 0;
+}
+
+b8_t heap_query_over(nil_t) { return HEAP_IN_QUERY(VM->heap) && __atomic_load_n(&__QUERY_OVER, __ATOMIC_RELAXED); }
+
+nil_t heap_arena_begin(nil_t) {
+    if (HEAP_IN_QUERY(VM->heap))
+        __ARENA_DEPTH++;
+}
+
+// Executors are parked by now, so their arenas are released from here as well. Their freelists went
+// to the main heap after the last pool run, so the chunks go there too, to coalesce with their buddies
+nil_t heap_arena_end(nil_t) {
+    i64_t i;
+    heap_p heap, dest;
+    block_p chunk, next;
+    pool_p pool;
+
+    if (!HEAP_IN_QUERY(VM->heap) || __ARENA_DEPTH == 0 || --__ARENA_DEPTH > 0)
+        return;
+
+    pool = runtime_get()->pool;
+    dest = VM->heap;
+
+    for (i = 0; i < pool->executors_count; i++) {
+        heap = pool->executors[i].heap;
+        chunk = heap->arena;
+
+        while (chunk != NULL) {
+            next = chunk->next;
+            LIVE_ADD(heap, -BSIZEOF(ARENA_CHUNK_ORDER));
+            heap_free_block(dest, chunk, ARENA_CHUNK_ORDER);
+            chunk = next;
+        }
+
+        heap->arena = NULL;
+        heap->arena_ptr = NULL;
+        heap->arena_end = NULL;
+    }
+}
+
+nil_t heap_temp_begin(nil_t) { VM->heap->temps++; }
+
+nil_t heap_temp_end(nil_t) { VM->heap->temps--; }
+
+nil_t heap_prof_set(b8_t on) { __PROF = on; }
+
+b8_t heap_prof_get(nil_t) { return __PROF; }
+
+// Objects are tagged by their constructors, tagging again moves the object to its final type (dicts, tables)
+nil_t heap_prof_tag(raw_p ptr, i8_t type) {
+    block_p block;
+    i64_t size;
+
+    if (!__PROF || ptr == NULL)
+        return;
+
+    block = RAW2BLOCK(ptr);
+    if ((block->mode & BLOCK_MODE_ARENA) || block->backed)
+        return;
+
+    size = BSIZEOF(block->order);
+
+    if (block->tag != 0)
+        heap_prof_add(block->tag, -1, -size, -size);
+
+    block->tag = (u8_t)type ^ 0x80;
+    heap_prof_add(block->tag, 1, size, size);
+}
+
+// Sites are keyed by the address of the builtin being called, the slots are claimed by the main thread only
+i64_t heap_prof_enter(i64_t site) {
+    i64_t i, n, prev;
+
+    prev = __atomic_load_n(&__PROF_SITE, __ATOMIC_RELAXED);
+
+    if (!__PROF || VM->heap->id != 0)
+        return prev;
+
+    i = (site >> 4) & (PROF_SITES - 1);
+
+    for (n = 0; n < PROF_SITES; n++, i = (i + 1) & (PROF_SITES - 1)) {
+        if (i == 0)
+            continue;
+
+        if (__PROF_KEYS[i] == site)
+            break;
+
+        if (__PROF_KEYS[i] == 0) {
+            __PROF_KEYS[i] = site;
+            break;
+        }
+    }
+
+    __atomic_store_n(&__PROF_SITE, (n < PROF_SITES) ? i : 0, __ATOMIC_RELAXED);
+
+    return prev;
+}
+
+nil_t heap_prof_leave(i64_t prev) {
+    if (__atomic_load_n(&__PROF_SITE, __ATOMIC_RELAXED) == prev || VM->heap->id != 0)
+        return;
+
+    __atomic_store_n(&__PROF_SITE, prev, __ATOMIC_RELAXED);
+}
+
+nil_t heap_prof_types(heap_prof_t stats[256]) { memcpy(stats, __PROF_TYPES, sizeof(__PROF_TYPES)); }
+
+i64_t heap_prof_sites(i64_t sites[PROF_SITES], heap_prof_t stats[PROF_SITES]) {
+    i64_t i, n = 0;
+
+    for (i = 0; i < PROF_SITES; i++) {
+        if (__PROF_SITES[i].count == 0)
+            continue;
+
+        sites[n] = __PROF_KEYS[i];
+        stats[n++] = __PROF_SITES[i];
+    }
+
+    return n;
+}
+
 nil_t heap_borrow(heap_p heap) {
     i64_t i;
     heap_p h = VM->heap;  // Cache heap pointer (source heap)
@@ -481,6 +1170,7 @@ nil_t heap_borrow(heap_p heap) {
 
         heap->freelist[i]->next = NULL;
         heap->freelist[i]->prev = NULL;
+        heap->freelist[i]->heap_id = heap->id;
         heap->avail |= BSIZEOF(i);
     }
 }
@@ -501,28 +1191,34 @@ nil_t heap_merge(heap_p heap) {
 
     heap->foreign_blocks = NULL;
 
+    // The worker is parked, whatever is left in its queue goes back through the main heap
+    block = __atomic_exchange_n(&heap->remote_blocks, NULL, __ATOMIC_ACQUIRE);
+    while (block != NULL) {
+        last = block;
+        block = block->next;
+        last->heap_id = h->id;
+        heap_free(BLOCK2RAW(last));
+    }
+
+    heap_drain(h);
+
+    // Slab blocks are coalesced within the worker heap before its freelists are handed over
+    for (i = 0; i < SLAB_ORDERS; i++)
+        heap_slab_flush(heap, i, 0);
+
+    // Free blocks are freed again into the main heap, so that halves left on different heaps coalesce there
     for (i = MIN_BLOCK_ORDER; i <= MAX_POOL_ORDER; i++) {
         block = heap->freelist[i];
-        last = NULL;
 
         while (block != NULL) {
             last = block;
             block = block->next;
+            heap_free_block(h, last, i);
         }
 
-        if (last != NULL) {
-            last->next = h->freelist[i];
-
-            if (h->freelist[i] != NULL)
-                h->freelist[i]->prev = last;
-
-            h->freelist[i] = heap->freelist[i];
-
-            heap->freelist[i] = NULL;
-        }
+        heap->freelist[i] = NULL;
     }
 
-    h->avail |= heap->avail;
     heap->avail = 0;
 }
 
@@ -537,11 +1233,14 @@ memstat_t heap_memstat(nil_t) {
     for (i = MIN_BLOCK_ORDER; i <= MAX_POOL_ORDER; i++) {
         block = h->freelist[i];
         while (block) {
-            h->memstat.free += BLOCKSIZE(i);
+            h->memstat.free += BSIZEOF(i);
             block = block->next;
         }
     }
 
+    for (i = 0; i < SLAB_ORDERS; i++)
+        h->memstat.free += h->slabs_count[i] * BSIZEOF(i + MIN_BLOCK_ORDER);
+
     return h->memstat;
 }
 
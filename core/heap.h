@@ -30,27 +30,50 @@
 #define MIN_BLOCK_ORDER 5   // 2^5 = 32B
 #define MAX_BLOCK_ORDER 25  // 2^25 = 32MB
 #define MAX_POOL_ORDER 38   // 2^38 = 256GB
+#define SLAB_MAX_ORDER 8    // 2^8 = 256B, smaller blocks are served from the slab caches
+#define SLAB_ORDERS (SLAB_MAX_ORDER - MIN_BLOCK_ORDER + 1)
+#define SCAVENGE_MIN_ORDER 21  // 2^21 = 2MB, smallest free block the scavenger returns to the OS
+#define ARENA_CHUNK_ORDER 22   // 2^22 = 4MB, query arenas grow by chunks of this size
+#define PROF_SITES 256         // allocation sites tracked by the profiler, the rest is counted as top level
+
+// Block modes
+#define BLOCK_MODE_HUGE 0x1       // pool root: backed by reserved huge pages
+#define BLOCK_MODE_DISCARDED 0x2  // free block: pages already returned to the OS
+#define BLOCK_MODE_ARENA 0x4      // bump allocated from a query arena, released with it
+#define BLOCK_MODE_THP 0x8        // pool root: advised to transparent huge pages
 
 // Memory modes
 #define MMOD_INTERNAL 0xff
 #define MMOD_EXTERNAL_SIMPLE 0xfd
 #define MMOD_EXTERNAL_COMPOUND 0xfe
 #define MMOD_EXTERNAL_SERIALIZED 0xfa
+#define MMOD_EXTERNAL_VIEW 0xfb  // vector living in a received message buffer
 
 typedef struct memstat_t {
     i64_t system;  // system memory used
     i64_t heap;    // total heap memory
     i64_t free;    // free heap memory
+    i64_t huge;    // heap memory in reserved huge page pools
+    i64_t thp;     // heap memory advised to transparent huge pages, which need not be backed by them
+    i64_t scav;    // memory returned to the OS by the scavenger
+    i64_t spill;   // heap memory in file backed pools
 } memstat_t;
 
+typedef struct heap_prof_t {
+    i64_t count;  // allocations made
+    i64_t bytes;  // bytes allocated
+    i64_t live;   // bytes still held (object types only)
+    i64_t peak;   // highest live bytes seen
+} heap_prof_t;
+
 typedef struct block_t {
     u8_t order;
     u8_t used;
     u8_t pool_order;
-    u8_t mode;
+    u8_t mode;  // BLOCK_MODE_* flags
     u16_t heap_id;
     b8_t backed;  // backed by a file
-    b8_t pad;
+    u8_t tag;  // object type ^ 0x80 while the profiler tracks the block, 0 otherwise
     struct block_t *pool;
     struct block_t *prev;
     struct block_t *next;
@@ -61,7 +84,15 @@ typedef struct heap_t {
     block_p freelist[MAX_POOL_ORDER + 2];  // free list of blocks by order
     i64_t avail;                           // mask of available blocks by order
     block_p foreign_blocks;                // foreign blocks (to be freed by the owner)
+    block_p remote_blocks;                 // blocks of this heap freed by other threads, drained by the owner
     block_p backed_blocks;                 // backed blocks (to be unmapped)
+    block_p slabs[SLAB_ORDERS];            // cached small blocks by order, taken from the buddies in batches
+    i64_t slabs_count[SLAB_ORDERS];        // number of cached blocks by order
+    i64_t live;                            // bytes handed out minus bytes freed through this heap
+    block_p arena;                         // chunks of the query arena
+    u8_t *arena_ptr;                       // bump pointer into the current chunk
+    u8_t *arena_end;
+    i64_t temps;                           // > 0 while allocations are query temporaries
     memstat_t memstat;
     c8_t swap_path[64];  // swap directory path
 } *heap_p;
@@ -76,6 +107,27 @@ raw_p heap_realloc(raw_p ptr, i64_t size);
 nil_t heap_free(raw_p ptr);
 nil_t heap_unmap(raw_p ptr, i64_t size);
 i64_t heap_gc(nil_t);
+i64_t heap_scavenge(heap_p heap, i64_t keep);
+i64_t heap_scavenge_tick(i64_t now);  // ms until the next pass, -1 when the scavenger is off
+nil_t heap_set_limit(i64_t bytes);
+i64_t heap_get_limit(nil_t);
+nil_t heap_set_soft_limit(i64_t bytes);  // 0 turns spilling of large pools off
+nil_t heap_query_begin(nil_t);
+nil_t heap_query_end(nil_t);
+i64_t heap_query_used(nil_t);
+i64_t heap_query_left(nil_t);  // -1 when queries are not limited
+b8_t heap_query_over(nil_t);
+nil_t heap_arena_begin(nil_t);
+nil_t heap_arena_end(nil_t);
+nil_t heap_temp_begin(nil_t);
+nil_t heap_temp_end(nil_t);
+nil_t heap_prof_set(b8_t on);
+b8_t heap_prof_get(nil_t);
+nil_t heap_prof_tag(raw_p ptr, i8_t type);
+i64_t heap_prof_enter(i64_t site);  // returns the site to restore with heap_prof_leave
+nil_t heap_prof_leave(i64_t prev);
+nil_t heap_prof_types(heap_prof_t stats[256]);                  // indexed by (u8_t)type
+i64_t heap_prof_sites(i64_t sites[PROF_SITES], heap_prof_t stats[PROF_SITES]);  // number of sites
 nil_t heap_borrow(heap_p heap);
 nil_t heap_merge(heap_p heap);
 memstat_t heap_memstat(nil_t);
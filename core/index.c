@@ -31,6 +31,7 @@
 #include "unary.h"
 #include "string.h"
 #include "pool.h"
+#include "spill.h"
 #include "def.h"
 
 const i64_t MAX_RANGE = 1 << 20;
@@ -1651,6 +1652,8 @@ obj_p index_group_chunk_local(i64_t len, i64_t offset, __group_chunk_ctx_t *ctx)
     hash = ctx->hash;
     cmp = ctx->cmp;
 
+    // The table never leaves the grouping, it can live in the query arena
+    heap_temp_begin();
     ht = ht_oa_create(len, TYPE_I64);
     groups = 0;
 
@@ -1684,6 +1687,8 @@ obj_p index_group_chunk_local(i64_t len, i64_t offset, __group_chunk_ctx_t *ctx)
         }
     }
 
+    heap_temp_end();
+
     ctx->local_groups[offset > 0 ? 1 : 0] = groups;  // Store in appropriate slot based on chunk
     ctx->local_hts[offset > 0 ? 1 : 0] = ht;
 
@@ -1700,6 +1705,78 @@ obj_p index_group_chunk_remap(i64_t len, i64_t offset, i64_t *out, i64_t *remap)
     return NULL_OBJ;
 }
 
+// In-memory hash grouping cost per row, and the partitions limit for spilled grouping
+#define INDEX_GROUP_ROW_BYTES 32
+#define INDEX_GROUP_SPILL_PARTS 256
+
+// Out-of-core grouping for inputs over the spill budget: (key, row) pairs are scattered into
+// hash partitions on disk and every partition is grouped on its own, with out[] receiving the
+// first row of each group. Those are then turned into dense ids in order of first appearance,
+// matching the in-memory grouping. Returns -1 if spilling failed.
+static i64_t index_group_spill(i64_t keys[], i64_t filter[], i64_t out[], i64_t len, hash_f hash, cmp_f cmp) {
+    i64_t i, p, parts, cnt, idx, g, rec[2];
+    i64_t *k, *v, *r;
+    spill_p spills[INDEX_GROUP_SPILL_PARTS] = {NULL};
+    obj_p ht;
+
+    parts = 2;
+    while (parts < INDEX_GROUP_SPILL_PARTS && len * INDEX_GROUP_ROW_BYTES / parts > spill_get_budget())
+        parts *= 2;
+
+    for (p = 0; p < parts; p++) {
+        spills[p] = spill_create();
+        if (spills[p] == NULL)
+            goto fail;
+    }
+
+    for (i = 0; i < len; i++) {
+        rec[0] = filter ? keys[filter[i]] : keys[i];
+        rec[1] = i;
+        p = (hash(rec[0], NULL) >> 32) & (parts - 1);
+        if (spill_write(spills[p], rec, sizeof(rec)) == -1)
+            goto fail;
+    }
+
+    for (p = 0; p < parts; p++) {
+        cnt = spills[p]->size / sizeof(rec);
+        if (cnt > 0) {
+            r = (i64_t *)spill_map(spills[p]);
+            if (r == NULL)
+                goto fail;
+
+            ht = ht_oa_create(cnt, TYPE_I64);
+            for (i = 0; i < cnt; i++) {
+                idx = ht_oa_tab_next_with(&ht, r[i * 2], hash, cmp, NULL);
+                k = AS_I64(AS_LIST(ht)[0]);
+                v = AS_I64(AS_LIST(ht)[1]);
+
+                if (k[idx] == NULL_I64) {
+                    k[idx] = r[i * 2];
+                    v[idx] = r[i * 2 + 1];
+                }
+
+                out[r[i * 2 + 1]] = v[idx];
+            }
+            drop_obj(ht);
+        }
+
+        spill_destroy(spills[p]);
+        spills[p] = NULL;
+    }
+
+    // The first row of a group never follows the rows of it
+    for (i = 0, g = 0; i < len; i++)
+        out[i] = (out[i] == i) ? g++ : out[out[i]];
+
+    return g;
+
+fail:
+    for (p = 0; p < parts; p++)
+        spill_destroy(spills[p]);
+
+    return -1;
+}
+
 i64_t index_group_distribute(i64_t keys[], i64_t filter[], i64_t out[], i64_t len, hash_f hash, cmp_f cmp) {
     i64_t i, j, parts, groups, chunk, last_chunk;
     i64_t idx, n, *k, *v, *remap;
@@ -1709,12 +1786,19 @@ i64_t index_group_distribute(i64_t keys[], i64_t filter[], i64_t out[], i64_t le
     obj_p ht, merged_ht, res;
     __group_chunk_ctx_t ctx;
 
+    if (spill_exceeds(len * INDEX_GROUP_ROW_BYTES)) {
+        groups = index_group_spill(keys, filter, out, len, hash, cmp);
+        if (groups >= 0)
+            return groups;
+    }
+
     pool = pool_get();
     parts = pool_split_by(pool, len, 0);
     groups = 0;
 
     // Single-threaded path
     if (parts == 1) {
+        heap_temp_begin();
         ht = ht_oa_create(len, TYPE_I64);
 
         if (filter) {
@@ -1748,6 +1832,7 @@ i64_t index_group_distribute(i64_t keys[], i64_t filter[], i64_t out[], i64_t le
         }
 
         drop_obj(ht);
+        heap_temp_end();
         return groups;
     }
 
@@ -1791,6 +1876,7 @@ i64_t index_group_distribute(i64_t keys[], i64_t filter[], i64_t out[], i64_t le
 
     // Phase 2: Merge local hash tables sequentially to assign global group IDs
     // This is O(total_unique_keys) which is typically much smaller than O(n)
+    heap_temp_begin();
     merged_ht = ht_oa_create(len, TYPE_I64);
     groups = 0;
 
@@ -1837,6 +1923,7 @@ i64_t index_group_distribute(i64_t keys[], i64_t filter[], i64_t out[], i64_t le
     }
 
     drop_obj(merged_ht);
+    heap_temp_end();
 
     return groups;
 }
@@ -40,6 +40,7 @@
 #include "compose.h"
 #include "items.h"
 #include "ipc.h"
+#include "serve.h"
 #include "parse.h"
 
 obj_p ray_hopen(obj_p *x, i64_t n) {
@@ -63,9 +64,11 @@ obj_p ray_hopen(obj_p *x, i64_t n) {
         timeout = x[1]->i64;
     }
 
-    // Allow only in main thread
-    if (!ray_is_main_thread())
+    // Allow only in main thread, a reader leaves the request to it
+    if (!ray_is_main_thread()) {
+        serve_rerun();
         return err_nyi(0);
+    }
 
     // Open socket
     if (sock_addr_from_str(AS_C8(x[0]), x[0]->len, &addr) != -1) {
@@ -96,9 +99,11 @@ obj_p ray_hopen(obj_p *x, i64_t n) {
 }
 
 obj_p ray_hclose(obj_p x) {
-    // Allow only in main thread
-    if (!ray_is_main_thread())
+    // Allow only in main thread, a reader leaves the request to it
+    if (!ray_is_main_thread()) {
+        serve_rerun();
         return err_nyi(0);
+    }
 
     switch (x->type) {
         case -TYPE_I32:
@@ -112,6 +117,195 @@ obj_p ray_hclose(obj_p x) {
     }
 }
 
+obj_p ray_defer(obj_p *x, i64_t n) {
+    i64_t id, token;
+    obj_p v;
+
+    UNUSED(x);
+
+    if (n > 0)
+        return err_arity(0, n);
+
+    // The connection is the main thread's, a reader leaves the request to it
+    if (serve_rerun())
+        return NULL_OBJ;
+
+    id = ipc_defer(&token);
+    if (id == -1)
+        return err_domain();
+
+    // (handle token): the connection and which of its deferred requests to answer
+    v = I64(2);
+    AS_I64(v)[0] = id;
+    AS_I64(v)[1] = token;
+
+    return v;
+}
+
+obj_p ray_respond(obj_p *x, i64_t n) {
+    c8_t msg[256];
+    i64_t l;
+    obj_p v;
+
+    if (n < 2 || n > 3)
+        return err_arity(2, n);
+
+    if (x[0]->type != TYPE_I64)
+        return err_type(TYPE_I64, x[0]->type, 0);
+
+    if (x[0]->len != 2)
+        return err_length(2, x[0]->len);
+
+    if (!ray_is_main_thread()) {
+        serve_rerun();
+        return err_nyi(0);
+    }
+
+    // (respond h "message" true) answers with an error
+    if (n == 3) {
+        if (x[2]->type != -TYPE_B8)
+            return err_type(-TYPE_B8, x[2]->type, 0);
+
+        if (x[2]->b8) {
+            if (x[1]->type != TYPE_C8)
+                return err_type(TYPE_C8, x[1]->type, 0);
+
+            l = (x[1]->len < (i64_t)sizeof(msg)) ? x[1]->len : (i64_t)sizeof(msg) - 1;
+            memcpy(msg, AS_C8(x[1]), l);
+            msg[l] = '\0';
+            v = err_user(msg);
+            l = ipc_respond(runtime_get()->poll, AS_I64(x[0])[0], AS_I64(x[0])[1], v);
+            drop_obj(v);
+            return (l == -1) ? err_domain() : NULL_OBJ;
+        }
+    }
+
+    if (ipc_respond(runtime_get()->poll, AS_I64(x[0])[0], AS_I64(x[0])[1], x[1]) == -1)
+        return err_domain();
+
+    return NULL_OBJ;
+}
+
+obj_p ray_request(obj_p x, obj_p y) {
+    i64_t corr;
+
+    if (x->type != -TYPE_I64)
+        return err_type(-TYPE_I64, x->type, 0);
+
+    if (!ray_is_main_thread()) {
+        serve_rerun();
+        return err_nyi(0);
+    }
+
+    corr = ipc_request(runtime_get()->poll, x->i64, y);
+    if (corr == -1)
+        return err_os();
+
+    return i64(corr);
+}
+
+obj_p ray_await(obj_p x, obj_p y) {
+    i64_t i, l;
+    obj_p v, res;
+
+    if (x->type != -TYPE_I64)
+        return err_type(-TYPE_I64, x->type, 0);
+
+    if (!ray_is_main_thread()) {
+        serve_rerun();
+        return err_nyi(0);
+    }
+
+    switch (y->type) {
+        case -TYPE_I64:
+            return ipc_await(runtime_get()->poll, x->i64, y->i64);
+        case TYPE_I64:
+            l = y->len;
+            res = LIST(l);
+            for (i = 0; i < l; i++) {
+                v = ipc_await(runtime_get()->poll, x->i64, AS_I64(y)[i]);
+                if (IS_ERR(v)) {
+                    res->len = i;
+                    drop_obj(res);
+                    return v;
+                }
+                AS_LIST(res)[i] = v;
+            }
+            return res;
+        default:
+            return err_type(-TYPE_I64, y->type, 0);
+    }
+}
+
+obj_p ray_hqueue(obj_p *x, i64_t n) {
+    i64_t i, policy;
+
+    if (n != 1 && n != 4)
+        return err_arity(4, n);
+
+    if (x[0]->type != -TYPE_I64)
+        return err_type(-TYPE_I64, x[0]->type, 0);
+
+    if (!ray_is_main_thread()) {
+        serve_rerun();
+        return err_nyi(0);
+    }
+
+    if (n == 1)
+        return ipc_queue(runtime_get()->poll, x[0]->i64, -1, 0, 0);
+
+    if (x[1]->type != -TYPE_I64)
+        return err_type(-TYPE_I64, x[1]->type, 0);
+    if (x[2]->type != -TYPE_I64)
+        return err_type(-TYPE_I64, x[2]->type, 0);
+    if (x[3]->type != -TYPE_SYMBOL)
+        return err_type(-TYPE_SYMBOL, x[3]->type, 0);
+
+    if (x[1]->i64 < 0 || x[2]->i64 < 0)
+        return err_domain();
+
+    for (i = 0, policy = -1; i < 3; i++)
+        if (x[3]->i64 == symbols_intern(IPC_POLICIES[i], strlen(IPC_POLICIES[i])))
+            policy = i;
+
+    if (policy == -1)
+        return err_value(x[3]->i64);
+
+    return ipc_queue(runtime_get()->poll, x[0]->i64, x[1]->i64, x[2]->i64, policy);
+}
+
+obj_p ray_stream(obj_p *x, i64_t n) {
+    if (n != 3 && n != 4)
+        return err_arity(4, n);
+
+    if (x[0]->type != -TYPE_I64)
+        return err_type(-TYPE_I64, x[0]->type, 0);
+    if (x[2]->type != -TYPE_I64)
+        return err_type(-TYPE_I64, x[2]->type, 0);
+
+    if (x[2]->i64 < 1)
+        return err_domain();
+
+    if (n == 4) {
+        switch (x[3]->type) {
+            case TYPE_LAMBDA:
+            case TYPE_UNARY:
+            case TYPE_BINARY:
+            case TYPE_VARY:
+                break;
+            default:
+                return err_type(TYPE_LAMBDA, x[3]->type, 0);
+        }
+    }
+
+    if (!ray_is_main_thread()) {
+        serve_rerun();
+        return err_nyi(0);
+    }
+
+    return ipc_stream(runtime_get()->poll, x[0]->i64, x[1], x[2]->i64, (n == 4) ? x[3] : NULL_OBJ);
+}
+
 obj_p ray_read(obj_p x) {
     i64_t sz, rs = 0;
     i64_t fd, size, c = 0;
@@ -233,9 +427,11 @@ obj_p io_write(i64_t fd, u8_t msg_type, obj_p obj) {
         default:
             // send ipc msg
 
-            // Allow only in main thread
-            if (!ray_is_main_thread())
+            // Allow only in main thread, a reader leaves the request to it
+            if (!ray_is_main_thread()) {
+                serve_rerun();
                 return err_nyi(0);
+            }
 
             return ipc_send(runtime_get()->poll, fd, obj, msg_type);
     }
@@ -460,75 +656,51 @@ obj_p parse_csv_range(i8_t types[], i64_t num_types, str_p buf, i64_t size, i64_
     return NULL_OBJ;  // Success
 }
 
-obj_p parse_csv_lines(i8_t *types, i64_t num_types, str_p buf, i64_t size, i64_t total_lines, obj_p cols, c8_t sep) {
-    obj_p err, res = NULL_OBJ;
-    i64_t i, l, batch_size, num_batches, lines_per_batch, start_line, end_line, lines_in_batch;
-    str_p batch_start, batch_end;
-    pool_p pool = runtime_get()->pool;
+typedef struct csv_morsel_ctx_t {
+    i8_t *types;
+    i64_t num_types;
+    str_p *starts;  // start of every line, plus the end of the last one
+    obj_p cols;
+    c8_t sep;
+} csv_morsel_ctx_t;
 
-    num_batches = pool_split_by(pool, total_lines, 0);
+static obj_p parse_csv_morsel(i64_t len, i64_t offset, raw_p arg) {
+    csv_morsel_ctx_t *ctx = (csv_morsel_ctx_t *)arg;
 
-    if (num_batches == 1)
-        return parse_csv_range(types, num_types, buf, size, total_lines, 0, cols, sep);
+    return parse_csv_range(ctx->types, ctx->num_types, ctx->starts[offset],
+                           ctx->starts[offset + len] - ctx->starts[offset], len, offset, ctx->cols, ctx->sep);
+}
 
-    pool_prepare(pool);
-
-    // --- PAGE-ALIGNED CHUNKING ---
-    i64_t page_size = RAY_PAGE_SIZE;
-    // Estimate average line length (avoid div by zero)
-    i64_t avg_line_len = size / (total_lines ? total_lines : 1);
-    i64_t lines_per_page = (avg_line_len > 0) ? (page_size / avg_line_len) : 1;
-    if (lines_per_page == 0)
-        lines_per_page = 1;
-    lines_per_batch = (total_lines + num_batches - 1) / num_batches;
-    // round up to nearest multiple of lines_per_page
-    lines_per_batch = ((lines_per_batch + lines_per_page - 1) / lines_per_page) * lines_per_page;
-
-    for (start_line = 0; start_line < total_lines; start_line = end_line) {
-        end_line = start_line + lines_per_batch;
-        if (end_line > total_lines)
-            end_line = total_lines;
-        lines_in_batch = end_line - start_line;
-
-        // Now calculate the actual buffer positions for start_line and end_line
-        batch_start = buf;
-        for (i = 0; i < start_line && batch_start < (buf + size); ++i)
-            batch_start = (str_p)memchr(batch_start, '\n', size - (batch_start - buf)) + 1;
-
-        batch_end = batch_start;
-        for (i = 0; i < lines_in_batch && batch_end < (buf + size); ++i) {
-            batch_end = (str_p)memchr(batch_end, '\n', size - (batch_end - buf));
-            if (batch_end == NULL) {
-                batch_end = buf + size;  // Handle the last line in the buffer
-                break;
-            } else {
-                ++batch_end;  // Move past the newline to include the full line
-            }
-        }
+obj_p parse_csv_lines(i8_t *types, i64_t num_types, str_p buf, i64_t size, i64_t total_lines, obj_p cols, c8_t sep) {
+    obj_p starts, res;
+    i64_t i, avg_line_len;
+    str_p pos, end;
+    csv_morsel_ctx_t ctx;
+    pool_p pool = runtime_get()->pool;
 
-        // Handle cases where lines are fewer than expected or parsing issues
-        if (batch_start == NULL || batch_end == NULL || batch_start >= batch_end)
-            break;
+    if (pool_split_by(pool, total_lines, 0) == 1)
+        return parse_csv_range(types, num_types, buf, size, total_lines, 0, cols, sep);
 
-        batch_size = batch_end - batch_start;
-        pool_add_task(pool, (raw_p)parse_csv_range, 8, types, num_types, batch_start, batch_size, lines_in_batch,
-                      start_line, cols, sep);
+    // Index line starts once, so lines can be handed out in morsels of any size
+    starts = I64(total_lines + 1);
+    end = buf + size;
+    pos = buf;
+    for (i = 0; i < total_lines && pos < end; i++) {
+        ((str_p *)AS_I64(starts))[i] = pos;
+        pos = (str_p)memchr(pos, '\n', end - pos);
+        pos = (pos == NULL) ? end : pos + 1;
     }
 
-    res = pool_run(pool);
-
-    l = res->len;
-    for (i = 0; i < l; i++) {
-        if (IS_ERR(AS_LIST(res)[i])) {
-            err = clone_obj(AS_LIST(res)[i]);
-            drop_obj(res);
-            return err;
-        }
-    }
+    // Lines are fewer than expected
+    total_lines = i;
+    ((str_p *)AS_I64(starts))[total_lines] = pos;
 
-    drop_obj(res);
+    ctx = (csv_morsel_ctx_t){types, num_types, (str_p *)AS_I64(starts), cols, sep};
+    avg_line_len = size / (total_lines ? total_lines : 1);
+    res = pool_run_morsels(pool, total_lines, avg_line_len, B8_FALSE, (raw_p)parse_csv_morsel, 3, 0, NULL, NULL, &ctx);
+    drop_obj(starts);
 
-    return NULL_OBJ;  // Success
+    return res;
 }
 
 static i64_t symbol_from_str_trimmed(str_p src, i64_t len) {
@@ -28,6 +28,12 @@
 
 obj_p ray_hopen(obj_p *x, i64_t n);
 obj_p ray_hclose(obj_p x);
+obj_p ray_defer(obj_p *x, i64_t n);
+obj_p ray_respond(obj_p *x, i64_t n);
+obj_p ray_request(obj_p x, obj_p y);
+obj_p ray_await(obj_p x, obj_p y);
+obj_p ray_hqueue(obj_p *x, i64_t n);
+obj_p ray_stream(obj_p *x, i64_t n);
 obj_p ray_read(obj_p x);
 obj_p ray_write(obj_p x, obj_p y);
 obj_p ray_read_csv(obj_p *x, i64_t n);
@@ -30,6 +30,25 @@
 #include "log.h"
 #include "heap.h"
 #include "error.h"
+#include "compress.h"
+#include "pubsub.h"
+#include "shm.h"
+#include "os.h"
+#include "ops.h"
+#include "items.h"
+#include "vary.h"
+
+// Payloads (bytes) from this size on are compressed for peers that read them, 0 means never
+static i64_t __IPC_COMPRESS = 0;
+
+nil_t ipc_set_compress(i64_t bytes) { __IPC_COMPRESS = (bytes > 0) ? bytes : 0; }
+
+lit_p IPC_POLICIES[3] = {"drop", "block", "disconnect"};
+
+// Sync request being evaluated on the main thread (-1 - none), and the token its handler deferred the response with (0 - none)
+static i64_t __IPC_REQUEST = -1;
+static i64_t __IPC_DEFERRED = 0;
+static i64_t __IPC_TOKEN = 0;  // last token given to a deferred request
 
 // Windows uses IOCP implementation in iocp.c for IPC handling
 // This file provides the Unix (epoll/kqueue) implementation
@@ -45,6 +64,12 @@ i64_t ipc_listen(poll_p poll, i64_t port) {
     return poll_listen(poll, port);
 }
 
+i64_t ipc_listen_local(poll_p poll, lit_p path) {
+    UNUSED(poll);
+    UNUSED(path);
+    return -1;
+}
+
 i64_t ipc_open(poll_p poll, sock_addr_t *addr, i64_t timeout) {
     i64_t fd, id;
     u8_t buf[2] = {RAYFORCE_VERSION, 0x00};
@@ -113,8 +138,88 @@ obj_p ipc_send(poll_p poll, i64_t id, obj_p msg, u8_t msgtype) {
         return ipc_send_async(poll, id, msg);
 }
 
+nil_t ipc_on_served(poll_p poll, serve_job_p job) {
+    UNUSED(poll);
+    serve_job_destroy(job);
+}
+
+i64_t ipc_request(poll_p poll, i64_t id, obj_p msg) {
+    UNUSED(poll);
+    UNUSED(id);
+    UNUSED(msg);
+    return -1;
+}
+
+obj_p ipc_await(poll_p poll, i64_t id, i64_t corr) {
+    UNUSED(poll);
+    UNUSED(id);
+    UNUSED(corr);
+    return err_nyi(0);
+}
+
+obj_p ipc_stream(poll_p poll, i64_t id, obj_p msg, i64_t rows, obj_p fn) {
+    UNUSED(poll);
+    UNUSED(id);
+    UNUSED(msg);
+    UNUSED(rows);
+    UNUSED(fn);
+    return err_nyi(0);
+}
+
+i64_t ipc_defer(i64_t *token) {
+    UNUSED(token);
+    return -1;
+}
+
+i64_t ipc_respond(poll_p poll, i64_t id, i64_t token, obj_p msg) {
+    UNUSED(poll);
+    UNUSED(id);
+    UNUSED(token);
+    UNUSED(msg);
+    return -1;
+}
+
+obj_p ipc_queue(poll_p poll, i64_t id, i64_t bytes, i64_t msgs, i64_t policy) {
+    UNUSED(poll);
+    UNUSED(id);
+    UNUSED(bytes);
+    UNUSED(msgs);
+    UNUSED(policy);
+    return err_nyi(0);
+}
+
 #else  // Unix implementation
 
+static option_t ipc_stream_more(poll_p poll, selector_p selector);
+
+// Send queue limits of new connections, taken from the environment on first use
+static b8_t __IPC_QUEUE_SET = B8_FALSE;
+static i64_t __IPC_QUEUE_BYTES = 0;
+static i64_t __IPC_QUEUE_MSGS = 0;
+static poll_policy_t __IPC_QUEUE_POLICY = POLL_POLICY_DROP;
+
+static nil_t ipc_queue_limits(selector_p selector) {
+    c8_t buf[32];
+
+    if (!__IPC_QUEUE_SET) {
+        if (os_get_var("IPC_QUEUE_MB", buf, sizeof(buf)) != -1) {
+            i64_from_str(buf, strlen(buf), &__IPC_QUEUE_BYTES);
+            __IPC_QUEUE_BYTES <<= 20;
+        }
+        if (os_get_var("IPC_QUEUE_MSGS", buf, sizeof(buf)) != -1)
+            i64_from_str(buf, strlen(buf), &__IPC_QUEUE_MSGS);
+        if (os_get_var("IPC_QUEUE_POLICY", buf, sizeof(buf)) != -1) {
+            if (strcmp(buf, IPC_POLICIES[POLL_POLICY_BLOCK]) == 0)
+                __IPC_QUEUE_POLICY = POLL_POLICY_BLOCK;
+            else if (strcmp(buf, IPC_POLICIES[POLL_POLICY_DISCONNECT]) == 0)
+                __IPC_QUEUE_POLICY = POLL_POLICY_DISCONNECT;
+        }
+        __IPC_QUEUE_SET = B8_TRUE;
+    }
+
+    poll_tx_limit(selector, __IPC_QUEUE_BYTES, __IPC_QUEUE_MSGS, __IPC_QUEUE_POLICY);
+}
+
 // ============================================================================
 // Listener Management
 // ============================================================================
@@ -132,6 +237,19 @@ option_t ipc_listener_accept(poll_p poll, selector_p selector) {
         ctx = (ipc_ctx_p)heap_alloc(sizeof(struct ipc_ctx_t));
         ctx->name = string_from_str("ipc", 4);
         ctx->msgtype = MSG_TYPE_RESP;
+        ctx->aligned = B8_FALSE;
+        ctx->compress = B8_FALSE;
+        ctx->local = (selector->data != NULL);  // unix listeners keep their path
+        ctx->corr = NULL_I64;
+        ctx->next = 0;
+        ctx->pending = NULL_OBJ;
+        ctx->job = NULL;
+        ctx->backlog = NULL_OBJ;
+        ctx->deferred = NULL_OBJ;
+        ctx->ready = NULL_OBJ;
+        ctx->chunk = 0;
+        ctx->chunked = NULL_OBJ;
+        ctx->stream = NULL_OBJ;
 
         registry.fd = fd;
         registry.type = SELECTOR_TYPE_SOCKET;
@@ -143,6 +261,8 @@ option_t ipc_listener_accept(poll_p poll, selector_p selector) {
         registry.read_fn = ipc_read_handshake;
         registry.recv_fn = sock_recv;
         registry.send_fn = sock_send;
+        registry.sendv_fn = sock_sendv;
+        registry.write_fn = ipc_stream_more;
         registry.data_fn = ipc_on_data;
         registry.data = ctx;
 
@@ -160,7 +280,14 @@ option_t ipc_listener_accept(poll_p poll, selector_p selector) {
 
 nil_t ipc_listener_close(poll_p poll, selector_p selector) {
     UNUSED(poll);
-    UNUSED(selector);
+    obj_p path = (obj_p)selector->data;
+
+    // a unix socket listener removes its file, abstract ones have none
+    if (path != NULL) {
+        if (AS_C8(path)[0] != '@')
+            unlink(AS_C8(path));
+        drop_obj(path);
+    }
 }
 
 i64_t ipc_listen(poll_p poll, i64_t port) {
@@ -188,6 +315,35 @@ i64_t ipc_listen(poll_p poll, i64_t port) {
     return poll_register(poll, &registry);
 }
 
+i64_t ipc_listen_local(poll_p poll, lit_p path) {
+    i64_t fd, id;
+    struct poll_registry_t registry = ZERO_INIT_STRUCT;
+
+    if (poll == NULL)
+        return -1;
+
+    fd = sock_listen_local(path);
+    if (fd == -1)
+        return -1;
+
+    registry.fd = fd;
+    registry.type = SELECTOR_TYPE_SOCKET;
+    registry.events = POLL_EVENT_READ | POLL_EVENT_ERROR | POLL_EVENT_HUP;
+    registry.recv_fn = NULL;
+    registry.read_fn = ipc_listener_accept;
+    registry.close_fn = ipc_listener_close;
+    registry.error_fn = NULL;
+    registry.data = cstring_from_str(path, strlen(path));
+
+    LOG_DEBUG("Registering listener on unix:%s", path);
+
+    id = poll_register(poll, &registry);
+    if (id == -1)
+        drop_obj((obj_p)registry.data);
+
+    return id;
+}
+
 // ============================================================================
 // User Callback Management
 // ============================================================================
@@ -219,6 +375,175 @@ nil_t ipc_call_usr_cb(poll_p poll, selector_p selector, lit_p sym, i64_t len) {
     }
 }
 
+// ============================================================================
+// Shared Memory Connections
+// ============================================================================
+
+/*
+ * A shared memory connection is a selector polling our doorbell, reading and writing
+ * the rings, while the unix socket it was set up over stays registered as its link:
+ * the kernel tells us through it when the peer is gone, whichever way it went.
+ */
+
+static nil_t ipc_shm_on_close(poll_p poll, selector_p selector) {
+    shm_p shm = shm_get(selector->fd);
+    i64_t link;
+
+    ipc_on_close(poll, selector);
+
+    if (shm == NULL)
+        return;
+
+    link = shm->link;
+    shm_destroy(shm);
+    if (link != -1)
+        poll_deregister(poll, link);
+}
+
+static nil_t ipc_shm_link_close(poll_p poll, selector_p selector) { poll_deregister(poll, (i64_t)selector->data); }
+
+// Registers the rings as a connection taking over ctx, and turns the socket selector into its link
+static i64_t ipc_shm_register(poll_p poll, shm_p shm, i64_t link, ipc_ctx_p ctx) {
+    i64_t id;
+    selector_p selector;
+    struct poll_registry_t registry = ZERO_INIT_STRUCT;
+
+    registry.fd = shm->fd;
+    registry.type = SELECTOR_TYPE_SOCKET;
+    registry.events = POLL_EVENT_READ | POLL_EVENT_ERROR | POLL_EVENT_EDGE;
+    registry.recv_fn = shm_recv;
+    registry.send_fn = shm_send;
+    registry.write_fn = ipc_stream_more;
+    registry.read_fn = ipc_read_header;
+    registry.data_fn = ipc_on_data;
+    registry.close_fn = ipc_shm_on_close;
+    registry.error_fn = ipc_on_error;
+    registry.data = ctx;
+
+    id = poll_register(poll, &registry);
+    if (id == -1)
+        return -1;
+
+    selector = poll_get_selector(poll, id);
+    ipc_queue_limits(selector);
+    poll_rx_buf_request(poll, selector, ISIZEOF(struct ipc_header_t));
+
+    shm->link = link;
+    selector = poll_get_selector(poll, link);
+    if (selector->rx.buf != NULL)
+        poll_rx_buf_release(poll, selector);
+    selector->rx.recv_fn = NULL;
+    selector->rx.read_fn = NULL;
+    selector->tx.write_fn = NULL;
+    selector->data_fn = NULL;
+    selector->close_fn = ipc_shm_link_close;
+    selector->data = (raw_p)id;
+
+    return id;
+}
+
+// Server side: the client hands its rings and doorbells over right behind the handshake, reads them once they came
+static option_t ipc_shm_accept(poll_p poll, selector_p selector) {
+    i64_t fds[3], id, own, n;
+    shm_p shm;
+    poll_buffer_p buf;
+
+    n = sock_recv_fds(selector->fd, fds, 3);
+    if (n == -1)
+        return option_error(err_os());
+
+    // not here yet, the socket becomes readable when they are
+    if (n == 0)
+        return option_none();
+
+    LOG_DEBUG("Shared memory rings received on connection %lld", selector->id);
+
+    shm = shm_attach(fds);
+    if (shm == NULL)
+        return option_error(err_os());
+
+    own = shm->fd;
+    id = ipc_shm_register(poll, shm, selector->id, (ipc_ctx_p)selector->data);
+    if (id == -1) {
+        shm_destroy(shm);
+        close(own);
+        return option_error(err_os());
+    }
+
+    // the client starts writing the rings once it has the response
+    buf = poll_buf_create(1);
+    buf->data[0] = RAYFORCE_VERSION;
+    poll_send_buf(poll, selector, buf);
+
+    ipc_call_usr_cb(poll, poll_get_selector(poll, id), ".z.po", 5);
+
+    return option_none();
+}
+
+// Client side: the socket is connected, hand the rings over and switch to them
+static i64_t ipc_open_shm(poll_p poll, i64_t fd) {
+    i64_t fds[3], id, own, link;
+    shm_p shm;
+    ipc_ctx_p ctx;
+    struct poll_registry_t registry = ZERO_INIT_STRUCT;
+    u8_t buf[3] = {RAYFORCE_VERSION, IPC_HANDSHAKE_SHM, 0x00};
+
+    shm = shm_create(fds);
+    if (shm == NULL) {
+        sock_close(fd);
+        return -1;
+    }
+
+    own = shm->fd;
+    if (sock_send(fd, buf, 3) == -1 || sock_send_fds(fd, fds, 3) == -1 || sock_recv(fd, buf, 1) == -1) {
+        close(fds[0]);
+        shm_destroy(shm);
+        close(own);
+        sock_close(fd);
+        return -1;
+    }
+
+    close(fds[0]);
+    sock_set_nonblocking(fd, B8_TRUE);
+
+    ctx = (ipc_ctx_p)heap_alloc(sizeof(struct ipc_ctx_t));
+    ctx->name = string_from_str("ipc", 4);
+    ctx->aligned = B8_FALSE;
+    ctx->compress = B8_FALSE;
+    ctx->local = B8_FALSE;
+    ctx->msgtype = MSG_TYPE_RESP;
+    ctx->corr = NULL_I64;
+    ctx->next = 0;
+    ctx->pending = NULL_OBJ;
+    ctx->job = NULL;
+    ctx->backlog = NULL_OBJ;
+    ctx->deferred = NULL_OBJ;
+    ctx->ready = NULL_OBJ;
+    ctx->chunk = 0;
+    ctx->chunked = NULL_OBJ;
+    ctx->stream = NULL_OBJ;
+
+    // the socket is only watched for the peer going away
+    registry.fd = fd;
+    registry.type = SELECTOR_TYPE_SOCKET;
+    registry.events = POLL_EVENT_READ | POLL_EVENT_ERROR | POLL_EVENT_HUP | POLL_EVENT_RDHUP | POLL_EVENT_EDGE;
+
+    link = poll_register(poll, &registry);
+    id = (link == -1) ? -1 : ipc_shm_register(poll, shm, link, ctx);
+    if (id == -1) {
+        if (link == -1)
+            sock_close(fd);
+        else
+            poll_deregister(poll, link);
+        drop_obj(ctx->name);
+        heap_free(ctx);
+        shm_destroy(shm);
+        close(own);
+    }
+
+    return id;
+}
+
 // ============================================================================
 // Connection Management
 // ============================================================================
@@ -238,6 +563,9 @@ i64_t ipc_open(poll_p poll, sock_addr_t *addr, i64_t timeout) {
     if (fd == -1)
         return -1;
 
+    if (addr->shm)
+        return ipc_open_shm(poll, fd);
+
     if (sock_send(fd, buf, 2) == -1)
         return -1;
 
@@ -250,13 +578,30 @@ i64_t ipc_open(poll_p poll, sock_addr_t *addr, i64_t timeout) {
 
     ctx = (ipc_ctx_p)heap_alloc(sizeof(struct ipc_ctx_t));
     ctx->name = string_from_str("ipc", 4);
+    ctx->aligned = B8_FALSE;
+    ctx->compress = B8_FALSE;
+    ctx->local = B8_FALSE;
+    ctx->msgtype = MSG_TYPE_RESP;
+    ctx->corr = NULL_I64;
+    ctx->next = 0;
+    ctx->pending = NULL_OBJ;
+    ctx->job = NULL;
+    ctx->backlog = NULL_OBJ;
+    ctx->deferred = NULL_OBJ;
+    ctx->ready = NULL_OBJ;
+    ctx->chunk = 0;
+    ctx->chunked = NULL_OBJ;
+    ctx->stream = NULL_OBJ;
 
     registry.fd = fd;
     registry.type = SELECTOR_TYPE_SOCKET;
     registry.events = POLL_EVENT_READ | POLL_EVENT_ERROR | POLL_EVENT_HUP;
     registry.recv_fn = sock_recv;
     registry.send_fn = sock_send;
+    registry.sendv_fn = sock_sendv;
+    registry.write_fn = ipc_stream_more;
     registry.read_fn = ipc_read_header;
+    registry.data_fn = ipc_on_data;
     registry.close_fn = ipc_on_close;
     registry.error_fn = ipc_on_error;
     registry.data = ctx;
@@ -267,6 +612,7 @@ i64_t ipc_open(poll_p poll, sock_addr_t *addr, i64_t timeout) {
 
     // request rx buffer
     selector = poll_get_selector(poll, id);
+    ipc_queue_limits(selector);
     if (poll_rx_buf_request(poll, selector, ISIZEOF(struct ipc_header_t)) == -1) {
         poll_deregister(poll, id);
         return -1;
@@ -291,6 +637,16 @@ option_t ipc_read_handshake(poll_p poll, selector_p selector) {
     }
 
     if (selector->rx.buf->offset > 0 && selector->rx.buf->data[selector->rx.buf->offset - 1] == '\0') {
+        // the fds come in ancillary data of the next byte, which only a unix socket carries
+        if (((ipc_ctx_p)selector->data)->local && selector->rx.buf->offset > 2 &&
+            selector->rx.buf->data[1] == IPC_HANDSHAKE_SHM) {
+            LOG_DEBUG("Shared memory handshake received on connection %lld", selector->id);
+            poll_rx_buf_release(poll, selector);
+            selector->rx.recv_fn = NULL;
+            selector->rx.read_fn = ipc_shm_accept;
+            return option_some(NULL);
+        }
+
         LOG_DEBUG("Handshake received, sending response");
 
         // send handshake response (single byte version)
@@ -340,22 +696,82 @@ option_t ipc_read_header(poll_p poll, selector_p selector) {
     LOG_DEBUG("Switching to message reading mode");
     selector->rx.read_fn = ipc_read_msg;
     ctx->msgtype = msgtype;
+    if (header->flags & SERDE_FLAG_ALIGNED)
+        ctx->aligned = B8_TRUE;
+    if (header->flags & SERDE_FLAG_COMPRESS)
+        ctx->compress = B8_TRUE;
 
     return option_some(NULL);
 }
 
+// Compressed messages are inflated into a scratch buffer and decoded from there
+static obj_p ipc_inflate_msg(u8_t *data, i64_t size) {
+    i64_t len;
+    u8_t *raw;
+    obj_p res;
+
+    len = decompress_frame_size(data, size);
+    if (len < 0)
+        return err_domain();
+
+    raw = (u8_t *)heap_alloc(len);
+    if (raw == NULL)
+        return err_os();
+
+    if (decompress_frame(data, size, raw, len) != len) {
+        heap_free(raw);
+        return err_domain();
+    }
+
+    res = de_raw(raw, &len);
+    heap_free(raw);
+
+    return res;
+}
+
 option_t ipc_read_msg(poll_p poll, selector_p selector) {
     UNUSED(poll);
 
-    i64_t size;
+    i64_t size, head;
     obj_p res;
     ipc_header_t *header;
+    poll_buffer_p buf;
+    ipc_ctx_p ctx;
 
     LOG_DEBUG("Reading message from connection %lld", selector->id);
-    header = (ipc_header_t *)selector->rx.buf->data;
+    ctx = (ipc_ctx_p)selector->data;
+    buf = selector->rx.buf;
+    header = (ipc_header_t *)buf->data;
     size = header->size;
+    head = ISIZEOF(struct ipc_header_t);
     LOG_DEBUG("Message size: %lld", size);
-    res = de_raw(selector->rx.buf->data + ISIZEOF(struct ipc_header_t), &size);
+
+    ctx->corr = NULL_I64;
+    ctx->chunk = 0;
+    if ((header->flags & SERDE_FLAG_CORRELATED) && size >= SERDE_CORR_SIZE) {
+        ctx->corr = ((i64_t *)(buf->data + head))[0];
+        ctx->chunk = ((i64_t *)(buf->data + head))[1];
+        head += SERDE_CORR_SIZE;
+        size -= SERDE_CORR_SIZE;
+    }
+
+    // A request for a table in parts, looked up again when it is answered
+    if (ctx->msgtype == MSG_TYPE_SYNC && ctx->corr != NULL_I64 && ctx->chunk > 0) {
+        if (ctx->chunked == NULL_OBJ)
+            ctx->chunked = I64(0);
+        push_raw(&ctx->chunked, &ctx->corr);
+        push_raw(&ctx->chunked, &ctx->chunk);
+    }
+
+    if (header->flags & SERDE_FLAG_COMPRESSED)
+        res = ipc_inflate_msg(buf->data + head, size);
+    else {
+        // Aligned payloads are used in place, the buffer goes with them if any were
+        buf->views = 1;
+        res = de_raw_view(buf->data + head, &size, &buf->views);
+        if (--buf->views > 0)
+            selector->rx.buf = NULL;
+    }
     LOG_DEBUG("Message read");
 
     // Prepare for the next message
@@ -394,55 +810,545 @@ obj_p ipc_process_msg(poll_p poll, selector_p selector, obj_p msg) {
     return res;
 }
 
-nil_t ipc_send_msg(poll_p poll, selector_p selector, obj_p msg, u8_t msgtype) {
-    i64_t size;
-    poll_buffer_p buf;
-    ipc_header_t *header;
+static inline i64_t ipc_head_size(i64_t corr) {
+    return ISIZEOF(struct ipc_header_t) + ((corr != NULL_I64) ? SERDE_CORR_SIZE : 0);
+}
 
-    LOG_TRACE("Serializing message");
-    size = size_obj(msg);
-    buf = poll_buf_create(ISIZEOF(struct ipc_header_t) + size);
+// Fills in the header and, for a message with a correlation id, the block after it
+static nil_t ipc_put_header(u8_t *dst, u8_t flags, u8_t msgtype, i64_t size, i64_t corr) {
+    ipc_header_t *header;
+    i64_t *block;
+
+    if (corr != NULL_I64) {
+        block = (i64_t *)(dst + ISIZEOF(struct ipc_header_t));
+        block[0] = corr;
+        block[1] = 0;
+        flags |= SERDE_FLAG_CORRELATED;
+        size += SERDE_CORR_SIZE;
+    }
 
-    header = (ipc_header_t *)buf->data;
+    header = (ipc_header_t *)dst;
     header->prefix = SERDE_PREFIX;
     header->version = RAYFORCE_VERSION;
-    header->flags = 0x00;
+    header->flags = flags;
     header->endian = 0x00;
     header->msgtype = msgtype;
     header->size = size;
+}
+
+/*
+ * Large fixed-width vectors are not copied into the message: the serialized
+ * stream is split around their payloads, which are queued by reference
+ * (held until sent) and gathered with the rest into vectored sends.
+ * For a peer that can take them, the payloads are also padded to be used
+ * in place on its side.
+ */
+static poll_buffer_p ipc_split_msg(obj_p msg, i64_t size, u8_t msgtype, i64_t corr, b8_t aligned) {
+    i64_t i, at, end, skip, len, head;
+    obj_p data;
+    struct ser_refs_t refs;
+    poll_buffer_p first, last, buf;
+
+    refs.n = 0;
+    refs.k = 0;
+    refs.aligned = aligned;
+    refs.pad = 0;
+    refs.skip = 0;
+    skip = ser_refs(msg, &refs);
+    if (skip == 0)
+        return NULL;
+
+    head = ipc_head_size(corr);
+    data = vector(TYPE_U8, head + size - skip + refs.pad);
+    refs.base = AS_U8(data) + head;
+    len = ser_raw_split(refs.base, msg, &refs);
+
+    ipc_put_header(AS_U8(data), SERDE_FLAG_ALIGNED | SERDE_FLAG_COMPRESS, msgtype, len + skip, corr);
+
+    first = last = NULL;
+    for (i = 0, at = 0; i <= refs.n; i++) {
+        end = head + ((i < refs.n) ? refs.offs[i] : len);
+        if (end > at) {
+            buf = poll_buf_ref(clone_obj(data), at, end);
+            last = (last == NULL) ? (first = buf) : (last->next = buf);
+        }
+        at = end;
+
+        if (i < refs.n) {
+            buf = poll_buf_ref(clone_obj(refs.objs[i]), 0, refs.objs[i]->len * size_of_type(refs.objs[i]->type));
+            last = (last == NULL) ? (first = buf) : (last->next = buf);
+        }
+    }
+
+    drop_obj(data);
+
+    return first;
+}
+
+/*
+ * Serializes with the column filters on and compresses the stream as a frame of blocks,
+ * which the pool handles in parallel. Returns NULL when that does not make it smaller.
+ */
+static poll_buffer_p ipc_compress_msg(obj_p msg, i64_t size, u8_t msgtype, i64_t corr) {
+    i64_t len, bound, head;
+    u8_t *raw;
+    struct ser_refs_t refs = ZERO_INIT_STRUCT;
+    poll_buffer_p buf;
+
+    raw = (u8_t *)heap_alloc(size);
+    if (raw == NULL)
+        return NULL;
+
+    refs.base = raw;
+    refs.filter = B8_TRUE;
+    len = ser_raw_split(raw, msg, &refs);
+
+    head = ipc_head_size(corr);
+    bound = compress_frame_bound(len);
+    buf = poll_buf_create(head + bound);
+    if (buf == NULL) {
+        heap_free(raw);
+        return NULL;
+    }
+
+    size = compress_frame(raw, len, buf->data + head, bound);
+    heap_free(raw);
+
+    if (size < 0 || size >= len) {
+        poll_buf_destroy(buf);
+        return NULL;
+    }
+
+    ipc_put_header(buf->data, SERDE_FLAG_ALIGNED | SERDE_FLAG_COMPRESS | SERDE_FLAG_COMPRESSED, msgtype, size, corr);
+    buf->size = head + size;
+
+    LOG_DEBUG("Compressed message of size %lld to %lld", len, size);
+
+    return buf;
+}
+
+// Serializes a message with its header into bytes every peer reads, to be queued on many connections
+obj_p ipc_pack_msg(obj_p msg, u8_t msgtype) {
+    i64_t size, head;
+    obj_p data;
+
+    size = size_obj(msg);
+    head = ipc_head_size(NULL_I64);
+    data = vector(TYPE_U8, head + size);
+    ipc_put_header(AS_U8(data), SERDE_FLAG_ALIGNED | SERDE_FLAG_COMPRESS, msgtype, size, NULL_I64);
+    ser_raw(AS_U8(data) + head, msg);
+
+    return data;
+}
+
+static poll_buffer_p ipc_build_msg(ipc_ctx_p ctx, obj_p msg, u8_t msgtype, i64_t corr) {
+    i64_t size, head;
+    poll_buffer_p buf;
+
+    LOG_TRACE("Serializing message");
+    size = size_obj(msg);
+    buf = NULL;
+
+    if (ctx->compress && __IPC_COMPRESS > 0 && size >= __IPC_COMPRESS)
+        buf = ipc_compress_msg(msg, size, msgtype, corr);
+
+    if (buf == NULL && size >= SER_REF_MIN)
+        buf = ipc_split_msg(msg, size, msgtype, corr, ctx->aligned);
+
+    if (buf == NULL) {
+        head = ipc_head_size(corr);
+        buf = poll_buf_create(head + size);
+        ipc_put_header(buf->data, SERDE_FLAG_ALIGNED | SERDE_FLAG_COMPRESS, msgtype, size, corr);
+        ser_raw(buf->data + head, msg);
+    }
+
+    LOG_DEBUG("Serialized message of size %lld", size);
+
+    return buf;
+}
+
+// Puts the second word of the correlation block into a message built with one
+static nil_t ipc_set_chunk(poll_buffer_p buf, i64_t chunk) {
+    ((i64_t *)(POLL_BUF_DATA(buf) + buf->offset + ISIZEOF(struct ipc_header_t)))[1] = chunk;
+}
+
+/*
+ * A table asked for in parts goes out as its schema (the table without rows)
+ * and then blocks of rows, each a list of columns. Every part carries the
+ * correlation id of the request, and the number of rows still to come after
+ * it, 0 on the last one. Blocks are made while the send queue is below the
+ * stream window, and again from the write events as the peer takes them.
+ */
+static option_t ipc_stream_more(poll_p poll, selector_p selector) {
+    i64_t n, rows;
+    obj_p range, block;
+    poll_buffer_p buf;
+    ipc_ctx_p ctx;
+
+    ctx = (ipc_ctx_p)selector->data;
+
+    while (ctx->stream != NULL_OBJ && poll_tx_size(selector) < IPC_STREAM_WINDOW) {
+        n = ops_count(ctx->stream);
+        rows = (n - ctx->stream_at < ctx->stream_rows) ? n - ctx->stream_at : ctx->stream_rows;
+
+        range = I64(2);
+        AS_I64(range)[0] = ctx->stream_at;
+        AS_I64(range)[1] = rows;
+        block = ray_take(ctx->stream, range);
+        drop_obj(range);
+
+        ctx->stream_at += rows;
+        if (IS_ERR(block))
+            ctx->stream_at = n;
+
+        buf = ipc_build_msg(ctx, IS_ERR(block) ? block : AS_LIST(block)[1], MSG_TYPE_RESP, ctx->stream_corr);
+        ipc_set_chunk(buf, n - ctx->stream_at);
+        drop_obj(block);
+
+        if (ctx->stream_at == n) {
+            drop_obj(ctx->stream);
+            ctx->stream = NULL_OBJ;
+        }
+
+        // A part that did not go out leaves the peer waiting for the rest forever
+        if (poll_send_buf(poll, selector, buf) == -1) {
+            LOG_WARN("Part of a streamed table to selector %lld was not sent, shutting it down", selector->id);
+            drop_obj(ctx->stream);
+            ctx->stream = NULL_OBJ;
+            poll_shutdown(selector);
+        }
+    }
+
+    return option_some(NULL);
+}
+
+// Starts streaming the response to a request that asked for it in parts, FALSE if it goes whole
+static b8_t ipc_stream_start(poll_p poll, selector_p selector, obj_p msg, i64_t corr) {
+    i64_t i, l, rows, *chunked;
+    obj_p range, schema;
+    poll_buffer_p buf;
+    ipc_ctx_p ctx;
+
+    ctx = (ipc_ctx_p)selector->data;
+    if (ctx->chunked == NULL_OBJ)
+        return B8_FALSE;
+
+    chunked = AS_I64(ctx->chunked);
+    l = ctx->chunked->len;
+    for (i = 0; i < l && chunked[i] != corr; i += 2)
+        ;
+
+    if (i == l)
+        return B8_FALSE;
+
+    rows = chunked[i + 1];
+    remove_idx(&ctx->chunked, i + 1);
+    remove_idx(&ctx->chunked, i);
+
+    // Anything but a table larger than a part goes whole, so does a table while another one is streamed
+    if (msg->type != TYPE_TABLE || ops_count(msg) <= rows || ctx->stream != NULL_OBJ)
+        return B8_FALSE;
+
+    range = I64(2);
+    AS_I64(range)[0] = 0;
+    AS_I64(range)[1] = 0;
+    schema = ray_take(msg, range);
+    drop_obj(range);
+    if (IS_ERR(schema)) {
+        drop_obj(schema);
+        return B8_FALSE;
+    }
+
+    buf = ipc_build_msg(ctx, schema, MSG_TYPE_RESP, corr);
+    ipc_set_chunk(buf, ops_count(msg));
+    drop_obj(schema);
+    if (poll_send_buf(poll, selector, buf) == -1) {
+        poll_shutdown(selector);
+        return B8_TRUE;
+    }
+
+    ctx->stream = clone_obj(msg);
+    ctx->stream_corr = corr;
+    ctx->stream_rows = rows;
+    ctx->stream_at = 0;
+    ipc_stream_more(poll, selector);
 
-    ser_raw(buf->data + ISIZEOF(struct ipc_header_t), msg);
-    LOG_DEBUG("Sending message of size %lld", size);
+    return B8_TRUE;
+}
+
+nil_t ipc_send_msg(poll_p poll, selector_p selector, obj_p msg, u8_t msgtype, i64_t corr) {
+    poll_buffer_p buf;
+
+    if (msgtype == MSG_TYPE_RESP && corr != NULL_I64 && ipc_stream_start(poll, selector, msg, corr))
+        return;
+
+    buf = ipc_build_msg((ipc_ctx_p)selector->data, msg, msgtype, corr);
+
+    LOG_DEBUG("Sending message");
     poll_send_buf(poll, selector, buf);
     LOG_DEBUG("Message sent");
 }
 
+// Evaluates a message on the main thread and answers it if it is a sync request, unless its handler deferred that
+static nil_t ipc_eval_msg(poll_p poll, selector_p selector, obj_p msg, u8_t msgtype, i64_t corr) {
+    i64_t request, deferred;
+    obj_p v;
+    ipc_ctx_p ctx;
+
+    ctx = (ipc_ctx_p)selector->data;
+
+    // A handler may wait on another connection meanwhile, which can bring in a request of its own
+    request = __IPC_REQUEST;
+    deferred = __IPC_DEFERRED;
+    __IPC_REQUEST = (msgtype == MSG_TYPE_SYNC) ? selector->id : -1;
+    __IPC_DEFERRED = 0;
+
+    poll_set_usr_fd(selector->id);
+    v = ipc_process_msg(poll, selector, msg);
+    poll_set_usr_fd(0);
+
+    if (msgtype == MSG_TYPE_SYNC) {
+        if (__IPC_DEFERRED != 0) {
+            if (ctx->deferred == NULL_OBJ)
+                ctx->deferred = I64(0);
+            push_raw(&ctx->deferred, &__IPC_DEFERRED);
+            push_raw(&ctx->deferred, &corr);
+        } else
+            ipc_send_msg(poll, selector, v, MSG_TYPE_RESP, corr);
+    }
+
+    __IPC_REQUEST = request;
+    __IPC_DEFERRED = deferred;
+
+    drop_obj(v);
+}
+
+// Keeps a correlated response until it is awaited, a plain one has nobody left to take it
+static nil_t ipc_keep_ready(ipc_ctx_p ctx, obj_p res) {
+    if (ctx->corr == NULL_I64) {
+        LOG_DEBUG("Dropping a response nobody waits for");
+        drop_obj(res);
+        return;
+    }
+
+    if (ctx->ready == NULL_OBJ)
+        ctx->ready = LIST(0);
+
+    push_obj(&ctx->ready, vn_list(3, i64(ctx->corr), res, i64(ctx->chunk)));
+}
+
+// Takes the kept response to the given request, NULL if it has not come yet, and the rows of it still to come
+static obj_p ipc_take_ready(ipc_ctx_p ctx, i64_t corr) {
+    i64_t i, l;
+    obj_p res, *ready;
+
+    if (ctx->ready == NULL_OBJ)
+        return NULL;
+
+    ready = AS_LIST(ctx->ready);
+    l = ctx->ready->len;
+    for (i = 0; i < l; i++) {
+        if (AS_LIST(ready[i])[0]->i64 == corr) {
+            res = clone_obj(AS_LIST(ready[i])[1]);
+            ctx->chunk = AS_LIST(ready[i])[2]->i64;
+            remove_idx(&ctx->ready, i);
+            return res;
+        }
+    }
+
+    return NULL;
+}
+
+// A deferred request without a correlation id holds back the ones behind it, the client tells responses apart by order
+static b8_t ipc_held(ipc_ctx_p ctx) {
+    i64_t i, l;
+
+    if (ctx->deferred == NULL_OBJ)
+        return B8_FALSE;
+
+    // Deferred entries are (token, correlation id) pairs
+    l = ctx->deferred->len;
+    for (i = 1; i < l; i += 2) {
+        if (AS_I64(ctx->deferred)[i] == NULL_I64)
+            return B8_TRUE;
+    }
+
+    return B8_FALSE;
+}
+
+// Hands a sync request to the readers, one at a time per connection, or evaluates it here
+static nil_t ipc_run_sync(poll_p poll, selector_p selector, obj_p msg, i64_t corr) {
+    ipc_ctx_p ctx = (ipc_ctx_p)selector->data;
+
+    if (serve_enabled() && !IS_ERR(msg) && !is_null(msg))
+        ctx->job = serve_submit(msg, ctx->name, selector->id, corr);
+    else
+        ipc_eval_msg(poll, selector, msg, MSG_TYPE_SYNC, corr);
+}
+
+// Runs the sync requests that waited, for as long as none is being served or holds the rest back
+static nil_t ipc_run_backlog(poll_p poll, selector_p selector) {
+    i64_t corr;
+    obj_p next, msg;
+    ipc_ctx_p ctx = (ipc_ctx_p)selector->data;
+
+    // Backlog entries are (correlation id, request) pairs
+    while (ctx->job == NULL && !ipc_held(ctx) && ctx->backlog != NULL_OBJ && ctx->backlog->len > 0) {
+        next = AS_LIST(ctx->backlog)[0];
+        corr = AS_LIST(next)[0]->i64;
+        msg = clone_obj(AS_LIST(next)[1]);
+        remove_idx(&ctx->backlog, 0);
+        ipc_run_sync(poll, selector, msg, corr);
+    }
+}
+
 option_t ipc_on_data(poll_p poll, selector_p selector, raw_p data) {
     UNUSED(poll);
 
     LOG_TRACE("Received data from connection %lld", selector->id);
 
     ipc_ctx_p ctx;
-    obj_p v, res;
+    obj_p res;
 
     ctx = (ipc_ctx_p)selector->data;
     res = (obj_p)data;
 
-    poll_set_usr_fd(selector->id);
-    v = ipc_process_msg(poll, selector, res);
-    poll_set_usr_fd(0);
+    // Responses nobody waits on right now: correlated ones are kept until awaited
+    if (ctx->msgtype == MSG_TYPE_RESP) {
+        ipc_keep_ready(ctx, res);
+        return option_some(NULL);
+    }
 
-    // Send a response if the message is a synchronous request
-    if (ctx->msgtype == MSG_TYPE_SYNC)
-        ipc_send_msg(poll, selector, v, MSG_TYPE_RESP);
+    // Sync requests wait behind the one a reader serves or a plain deferred one, so that the responses keep their order
+    if (ctx->msgtype == MSG_TYPE_SYNC && (ctx->job != NULL || ipc_held(ctx))) {
+        if (ctx->backlog == NULL_OBJ)
+            ctx->backlog = LIST(0);
+        push_obj(&ctx->backlog, vn_list(2, i64(ctx->corr), res));
+        return option_some(NULL);
+    }
 
-    drop_obj(v);
+    if (ctx->msgtype == MSG_TYPE_SYNC) {
+        ipc_run_sync(poll, selector, res, ctx->corr);
+        ipc_run_backlog(poll, selector);
+    } else
+        ipc_eval_msg(poll, selector, res, ctx->msgtype, ctx->corr);
 
     return option_some(NULL);
 }
 
+nil_t ipc_on_served(poll_p poll, serve_job_p job) {
+    selector_p selector;
+    ipc_ctx_p ctx;
+
+    // The connection is gone, nobody waits for the result
+    if (job->id == -1) {
+        serve_job_destroy(job);
+        return;
+    }
+
+    selector = poll_get_selector(poll, job->id);
+    ctx = (ipc_ctx_p)selector->data;
+    ctx->job = NULL;
+
+    // A request that writes or needs the connections runs again on the main thread, against the live globals
+    if (job->rerun)
+        ipc_eval_msg(poll, selector, clone_obj(job->msg), MSG_TYPE_SYNC, job->corr);
+    else
+        ipc_send_msg(poll, selector, job->res, MSG_TYPE_RESP, job->corr);
+
+    serve_job_destroy(job);
+    ipc_run_backlog(poll, selector);
+}
+
+i64_t ipc_defer(i64_t *token) {
+    if (__IPC_REQUEST == -1)
+        return -1;
+
+    // deferring twice in one handler names the same request
+    if (__IPC_DEFERRED == 0)
+        __IPC_DEFERRED = ++__IPC_TOKEN;
+
+    *token = __IPC_DEFERRED;
+
+    return __IPC_REQUEST;
+}
+
+i64_t ipc_respond(poll_p poll, i64_t id, i64_t token, obj_p msg) {
+    i64_t i, l, corr, *pending;
+    selector_p selector;
+    ipc_ctx_p ctx;
+
+    selector = poll_get_selector(poll, id);
+    if (selector == NULL || selector->data_fn != ipc_on_data)
+        return -1;
+
+    ctx = (ipc_ctx_p)selector->data;
+    if (ctx->deferred == NULL_OBJ)
+        return -1;
+
+    // Deferred entries are (token, correlation id) pairs, answered in whatever order the handlers get to them
+    pending = AS_I64(ctx->deferred);
+    l = ctx->deferred->len;
+    for (i = 0; i < l; i += 2) {
+        if (pending[i] == token)
+            break;
+    }
+
+    if (i == l)
+        return -1;
+
+    corr = pending[i + 1];
+    memmove(pending + i, pending + i + 2, (l - i - 2) * ISIZEOF(i64_t));
+    ctx->deferred->len = l - 2;
+    ipc_send_msg(poll, selector, msg, MSG_TYPE_RESP, corr);
+
+    // the requests held back behind a plain one can go on now, unless one of the connection is still evaluated
+    if (corr == NULL_I64 && __IPC_REQUEST != id)
+        ipc_run_backlog(poll, selector);
+
+    return 0;
+}
+
+obj_p ipc_queue(poll_p poll, i64_t id, i64_t bytes, i64_t msgs, i64_t policy) {
+    selector_p selector;
+    poll_queue_t *queue;
+    obj_p keys, vals;
+
+    selector = poll_get_selector(poll, id);
+    if (selector == NULL || selector->data_fn != ipc_on_data)
+        return err_index(id, 0);
+
+    if (bytes != -1)
+        poll_tx_limit(selector, bytes, msgs, (poll_policy_t)policy);
+
+    queue = &selector->tx.queue;
+
+    keys = SYMBOL(8);
+    ins_sym(&keys, 0, "bytes");
+    ins_sym(&keys, 1, "msgs");
+    ins_sym(&keys, 2, "peak-bytes");
+    ins_sym(&keys, 3, "peak-msgs");
+    ins_sym(&keys, 4, "dropped");
+    ins_sym(&keys, 5, "max-bytes");
+    ins_sym(&keys, 6, "max-msgs");
+    ins_sym(&keys, 7, "policy");
+
+    vals = LIST(8);
+    AS_LIST(vals)[0] = i64(queue->bytes);
+    AS_LIST(vals)[1] = i64(queue->msgs);
+    AS_LIST(vals)[2] = i64(queue->peak_bytes);
+    AS_LIST(vals)[3] = i64(queue->peak_msgs);
+    AS_LIST(vals)[4] = i64(queue->dropped);
+    AS_LIST(vals)[5] = i64(queue->max_bytes);
+    AS_LIST(vals)[6] = i64(queue->max_msgs);
+    AS_LIST(vals)[7] = symbol(IPC_POLICIES[queue->policy], strlen(IPC_POLICIES[queue->policy]));
+
+    return dict(keys, vals);
+}
+
 nil_t ipc_on_open(poll_p poll, selector_p selector) {
     LOG_DEBUG("Connection opened, requesting handshake buffer");
+    ipc_queue_limits(selector);
     // request the minimal handshake buffer
     poll_rx_buf_request(poll, selector, 2);
 }
@@ -470,6 +1376,16 @@ nil_t ipc_on_close(poll_p poll, selector_p selector) {
     // Free context
     ctx = (ipc_ctx_p)selector->data;
     if (ctx != NULL) {
+        // A reader may still be busy with a request of this connection, its job is dropped once done
+        if (ctx->job != NULL)
+            ctx->job->id = -1;
+        pubsub_drop(selector->id);
+        drop_obj(ctx->backlog);
+        drop_obj(ctx->deferred);
+        drop_obj(ctx->ready);
+        drop_obj(ctx->pending);
+        drop_obj(ctx->chunked);
+        drop_obj(ctx->stream);
         drop_obj(ctx->name);
         heap_free(ctx);
     }
@@ -479,12 +1395,57 @@ nil_t ipc_on_close(poll_p poll, selector_p selector) {
 // Message Sending
 // ============================================================================
 
-obj_p ipc_send(poll_p poll, i64_t id, obj_p msg, u8_t msgtype) {
-    selector_p selector;
+/*
+ * Blocks until the response to the request with the given correlation id comes,
+ * NULL_I64 standing for a plain sync request. Responses to other correlated
+ * requests are kept for their own await, requests are handled as they come.
+ */
+static obj_p ipc_wait(poll_p poll, selector_p selector, i64_t corr) {
     option_t result;
     obj_p res;
     ipc_ctx_p ctx;
 
+    ctx = (ipc_ctx_p)selector->data;
+
+    for (;;) {
+        if (corr != NULL_I64) {
+            res = ipc_take_ready(ctx, corr);
+            if (res != NULL)
+                return res;
+        }
+
+        LOG_DEBUG("Waiting for response from connection %lld", selector->id);
+        result = poll_block_on(poll, selector);
+        LOG_DEBUG("Response received from connection %lld RESULT: %s", selector->id,
+                  option_is_some(&result) ? "some" : "none");
+
+        if (option_is_error(&result)) {
+            LOG_ERROR("Error occurred on connection %lld", selector->id);
+            return option_take(&result);
+        }
+
+        if (!option_is_some(&result) || result.value == NULL)
+            continue;
+
+        res = option_take(&result);
+
+        // A request of the peer is processed meanwhile
+        if (ctx->msgtype != MSG_TYPE_RESP) {
+            res = ipc_process_msg(poll, selector, res);
+            drop_obj(res);
+            continue;
+        }
+
+        if (ctx->corr == corr)
+            return res;
+
+        ipc_keep_ready(ctx, res);
+    }
+}
+
+obj_p ipc_send(poll_p poll, i64_t id, obj_p msg, u8_t msgtype) {
+    selector_p selector;
+
     LOG_DEBUG("Starting synchronous IPC send for id %lld", id);
 
     selector = poll_get_selector(poll, id);
@@ -493,35 +1454,145 @@ obj_p ipc_send(poll_p poll, i64_t id, obj_p msg, u8_t msgtype) {
         return err_os();
     }
 
+    ipc_send_msg(poll, selector, msg, msgtype, NULL_I64);
+
+    // wait for the response
+    if (msgtype == MSG_TYPE_SYNC)
+        return ipc_wait(poll, selector, NULL_I64);
+
+    return NULL_OBJ;
+}
+
+i64_t ipc_request(poll_p poll, i64_t id, obj_p msg) {
+    selector_p selector;
+    ipc_ctx_p ctx;
+
+    selector = poll_get_selector(poll, id);
+    if (selector == NULL || selector->data_fn != ipc_on_data)
+        return -1;
+
     ctx = (ipc_ctx_p)selector->data;
-    ipc_send_msg(poll, selector, msg, msgtype);
+    ipc_send_msg(poll, selector, msg, MSG_TYPE_SYNC, ++ctx->next);
 
-    res = NULL_OBJ;
+    if (ctx->pending == NULL_OBJ)
+        ctx->pending = I64(0);
+    push_raw(&ctx->pending, &ctx->next);
 
-    // wait for the response
-    if (msgtype == MSG_TYPE_SYNC) {
-        do {
-            LOG_DEBUG("Waiting for response from connection %lld", selector->id);
-            result = poll_block_on(poll, selector);
-            LOG_DEBUG("Response received from connection %lld RESULT: %s", selector->id,
-                      option_is_some(&result) ? "some" : "none");
-            if (option_is_some(&result) && result.value != NULL) {
-                res = option_take(&result);
-                // If the message is a response, break the loop
-                if (ctx->msgtype == MSG_TYPE_RESP)
-                    break;
-
-                // Process the request otherwise
-                res = ipc_process_msg(poll, selector, res);
-                drop_obj(res);
-            } else if (option_is_error(&result)) {
-                LOG_ERROR("Error occurred on connection %lld", selector->id);
-                return option_take(&result);
+    return ctx->next;
+}
+
+obj_p ipc_await(poll_p poll, i64_t id, i64_t corr) {
+    i64_t i;
+    selector_p selector;
+    ipc_ctx_p ctx;
+
+    selector = poll_get_selector(poll, id);
+    if (selector == NULL || selector->data_fn != ipc_on_data)
+        return err_os();
+
+    // Each request is awaited once, its response would never come again
+    ctx = (ipc_ctx_p)selector->data;
+    i = find_raw(ctx->pending, &corr);
+    if (i == NULL_I64)
+        return err_index(corr, ctx->next);
+
+    remove_idx(&ctx->pending, i);
+
+    return ipc_wait(poll, selector, corr);
+}
+
+/*
+ * Sends a sync request that asks for a table result in parts of the given
+ * number of rows. Without a function the parts are appended into the table
+ * as they come, with one each part is passed to it as a table, and the number
+ * of rows is returned. A result that comes whole is taken as one part.
+ */
+obj_p ipc_stream(poll_p poll, i64_t id, obj_p msg, i64_t rows, obj_p fn) {
+    i64_t i, l, corr, total;
+    obj_p part, keys, cols, res, err;
+    poll_buffer_p buf;
+    selector_p selector;
+    ipc_ctx_p ctx;
+
+    selector = poll_get_selector(poll, id);
+    if (selector == NULL || selector->data_fn != ipc_on_data)
+        return err_os();
+
+    ctx = (ipc_ctx_p)selector->data;
+    corr = ++ctx->next;
+    buf = ipc_build_msg(ctx, msg, MSG_TYPE_SYNC, corr);
+    ipc_set_chunk(buf, rows);
+    if (poll_send_buf(poll, selector, buf) == -1)
+        return err_os();
+
+    part = ipc_wait(poll, selector, corr);
+    if (IS_ERR(part) || ctx->chunk == 0) {
+        if (fn == NULL_OBJ || IS_ERR(part) || part->type != TYPE_TABLE)
+            return part;
+
+        total = ops_count(part);
+        res = ray_apply((obj_p[]){fn, part}, 2);
+        drop_obj(part);
+        if (IS_ERR(res))
+            return res;
+
+        drop_obj(res);
+        return i64(total);
+    }
+
+    // The first part is the schema, the rest are blocks of rows until none are left to come
+    total = ctx->chunk;
+    keys = clone_obj(AS_LIST(part)[0]);
+    cols = (fn == NULL_OBJ) ? clone_obj(AS_LIST(part)[1]) : NULL_OBJ;
+    drop_obj(part);
+    err = NULL_OBJ;
+
+    do {
+        part = ipc_wait(poll, selector, corr);
+        if (IS_ERR(part)) {
+            drop_obj(keys);
+            drop_obj(cols);
+            drop_obj(err);
+            return part;
+        }
+
+        // Once anything fails, the rest is only drained so the connection stays usable
+        if (err != NULL_OBJ) {
+            drop_obj(part);
+            continue;
+        }
+
+        if (fn == NULL_OBJ) {
+            l = cols->len;
+            for (i = 0; i < l && err == NULL_OBJ; i++) {
+                res = append_list(&AS_LIST(cols)[i], AS_LIST(part)[i]);
+                if (IS_ERR(res))
+                    err = res;
             }
-        } while (option_is_none(&result));
+            drop_obj(part);
+        } else {
+            part = table(clone_obj(keys), part);
+            res = ray_apply((obj_p[]){fn, part}, 2);
+            drop_obj(part);
+            if (IS_ERR(res))
+                err = res;
+            else
+                drop_obj(res);
+        }
+    } while (ctx->chunk > 0);
+
+    if (err != NULL_OBJ) {
+        drop_obj(keys);
+        drop_obj(cols);
+        return err;
     }
 
-    return res;
+    if (fn == NULL_OBJ)
+        return table(keys, cols);
+
+    drop_obj(keys);
+
+    return i64(total);
 }
 
 #endif  // !OS_WINDOWS
@@ -27,14 +27,37 @@
 #include "rayforce.h"
 #include "poll.h"
 #include "sock.h"
+#include "serve.h"
 
 #define MSG_TYPE_ASYN 0
 #define MSG_TYPE_SYNC 1
 #define MSG_TYPE_RESP 2
 
+// second handshake byte of a client that hands shared memory rings over right after it
+#define IPC_HANDSHAKE_SHM 0x01
+
+// bytes a connection may have queued before the next part of a streamed table is made
+#define IPC_STREAM_WINDOW (8ll * 1024 * 1024)
+
 typedef struct ipc_ctx_t {
     u8_t msgtype;
+    b8_t aligned;   // the peer decodes aligned payloads in place
+    b8_t compress;  // the peer reads compressed payloads
+    b8_t local;     // came by a unix domain socket, so may hand shared memory rings over
+    i64_t corr;       // correlation id of the message just read, NULL_I64 for none
+    i64_t next;       // last correlation id given to a request of ours
+    obj_p pending;    // correlation ids of our requests not awaited yet
     obj_p name;
+    serve_job_p job;  // sync request being evaluated by a reader
+    obj_p backlog;    // (correlation id, request) pairs that came in behind it, answered in order
+    obj_p deferred;   // (token, correlation id) pairs of the sync requests whose handlers deferred the response
+    obj_p ready;      // (correlation id, response, rows to come) of the responses that came before they were awaited
+    i64_t chunk;      // of the message just read: rows per part its request asks for, or rows of its response to come
+    obj_p chunked;    // (correlation id, rows per part) of the requests that asked for their table in parts
+    obj_p stream;     // table of the response being sent in parts
+    i64_t stream_corr;  // correlation id of its request
+    i64_t stream_rows;  // rows per part
+    i64_t stream_at;    // rows sent
 } *ipc_ctx_p;
 
 option_t ipc_read_handshake(poll_p poll, selector_p selector);
@@ -44,16 +67,47 @@ nil_t ipc_on_open(poll_p poll, selector_p selector);
 nil_t ipc_on_close(poll_p poll, selector_p selector);
 nil_t ipc_on_error(poll_p poll, selector_p selector);
 option_t ipc_on_data(poll_p poll, selector_p selector, raw_p data);
-nil_t ipc_send_msg(poll_p poll, selector_p selector, obj_p msg, u8_t msgtype);
+nil_t ipc_send_msg(poll_p poll, selector_p selector, obj_p msg, u8_t msgtype, i64_t corr);
 obj_p ipc_process_msg(poll_p poll, selector_p selector, obj_p msg);
+obj_p ipc_pack_msg(obj_p msg, u8_t msgtype);
+nil_t ipc_on_served(poll_p poll, serve_job_p job);
+
+// defer the response to the sync request being evaluated, returns its connection and sets the token
+// that names the request among the deferred ones, -1 outside of one
+i64_t ipc_defer(i64_t *token);
+
+// send the response to the deferred request of the connection with the token, -1 if it is not pending
+i64_t ipc_respond(poll_p poll, i64_t id, i64_t token, obj_p msg);
+
+// send queue of a connection: depth, high-water marks and limits, setting the limits first unless bytes is -1
+obj_p ipc_queue(poll_p poll, i64_t id, i64_t bytes, i64_t msgs, i64_t policy);
+
+// names of the send queue policies, by poll_policy_t
+extern lit_p IPC_POLICIES[3];
+
+// compress payloads of at least this many bytes, 0 turns compression off
+nil_t ipc_set_compress(i64_t bytes);
 
 // listen for incoming connections
 i64_t ipc_listen(poll_p poll, i64_t port);
 
+// listen on a unix domain socket, '@name' is an abstract one (Linux)
+i64_t ipc_listen_local(poll_p poll, lit_p path);
+
 // open a connection
 i64_t ipc_open(poll_p poll, sock_addr_t *addr, i64_t timeout);
 
 // send messages
 obj_p ipc_send(poll_p poll, i64_t id, obj_p msg, u8_t msgtype);
 
+// send a sync request without waiting, returns its correlation id or -1
+i64_t ipc_request(poll_p poll, i64_t id, obj_p msg);
+
+// wait for the response to a request sent with ipc_request
+obj_p ipc_await(poll_p poll, i64_t id, i64_t corr);
+
+// send a sync request whose table comes back in parts of the given number of rows, put together into one table,
+// or passed to fn one by one when it is not NULL_OBJ (the number of rows is returned then)
+obj_p ipc_stream(poll_p poll, i64_t id, obj_p msg, i64_t rows, obj_p fn);
+
 #endif  // IPC_H
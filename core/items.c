@@ -1147,7 +1147,7 @@ obj_p ray_value(obj_p x) {
     switch (x->type) {
         case TYPE_ENUM:
             k = ray_key(x);
-            sym = at_obj(runtime_get()->env.variables, k);
+            sym = at_obj(*env_variables(), k);
             drop_obj(k);
 
             e = ENUM_VAL(x);
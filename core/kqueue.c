@@ -28,6 +28,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <errno.h>
@@ -134,10 +135,13 @@ i64_t poll_register(poll_p poll, poll_registry_p registry) {
     selector->rx.read_fn = registry->read_fn;
     selector->tx.write_fn = registry->write_fn;
     selector->tx.send_fn = registry->send_fn;
+    selector->tx.sendv_fn = registry->sendv_fn;
     selector->data_fn = registry->data_fn;
     selector->data = registry->data;
     selector->rx.buf = NULL;
     selector->tx.buf = NULL;
+    selector->tx.tail = NULL;
+    poll_tx_init(selector);
 
     // Set up events
     if (registry->events & POLL_EVENT_READ) {
@@ -177,6 +181,7 @@ i64_t poll_register(poll_p poll, poll_registry_p registry) {
 i64_t poll_deregister(poll_p poll, i64_t id) {
     i64_t idx;
     selector_p selector;
+    poll_buffer_p buf;
     struct kevent ev[2];
 
     idx = freelist_pop(poll->selectors, id - SELECTOR_ID_OFFSET);
@@ -192,7 +197,16 @@ i64_t poll_deregister(poll_p poll, i64_t id) {
     close(selector->fd);
 
     heap_free(selector->rx.buf);
-    heap_free(selector->tx.buf);
+
+    while (selector->tx.buf != NULL) {
+        buf = selector->tx.buf->next;
+        poll_buf_destroy(selector->tx.buf);
+        selector->tx.buf = buf;
+    }
+    selector->tx.tail = NULL;
+
+    poll_tx_free(selector);
+
     heap_free(selector);
 
     return 0;
@@ -243,18 +257,27 @@ i64_t poll_recv(poll_p poll, selector_p selector) {
 i64_t poll_send(poll_p poll, selector_p selector) {
     UNUSED(poll);
 
-    i64_t size, total;
+    i64_t size, total, n;
     poll_buffer_p buf;
+    struct iovec iov[POLL_IOV_MAX];
     struct kevent ev;
 
     LOG_TRACE("Sending data to selector %lld", selector->id);
 
     total = 0;
 
-send_loop:
-    while (selector->tx.buf->offset < selector->tx.buf->size) {
-        size = selector->tx.send_fn(selector->fd, selector->tx.buf->data + selector->tx.buf->offset,
-                                    selector->tx.buf->size - selector->tx.buf->offset);
+    while (selector->tx.buf != NULL) {
+        // A message split around in-place payloads queues several buffers, gather them into one call
+        if (selector->tx.sendv_fn != NULL && selector->tx.buf->next != NULL) {
+            for (n = 0, buf = selector->tx.buf; buf != NULL && n < POLL_IOV_MAX; buf = buf->next, n++) {
+                iov[n].iov_base = POLL_BUF_DATA(buf) + buf->offset;
+                iov[n].iov_len = buf->size - buf->offset;
+            }
+            size = selector->tx.sendv_fn(selector->fd, iov, n);
+        } else {
+            buf = selector->tx.buf;
+            size = selector->tx.send_fn(selector->fd, POLL_BUF_DATA(buf) + buf->offset, buf->size - buf->offset);
+        }
 
         LOG_TRACE("Sent %lld bytes to selector %lld", size, selector->id);
 
@@ -273,19 +296,23 @@ send_loop:
             return 0;
         }
 
-        selector->tx.buf->offset += size;
-    }
-
-    total = selector->tx.buf->offset;
-
-    // switch to next buffer
-    LOG_TRACE("Switching to next buffer");
-    buf = selector->tx.buf->next;
-    heap_free(selector->tx.buf);
-    selector->tx.buf = buf;
+        total += size;
+        poll_tx_sent(selector, size);
 
-    if (selector->tx.buf != NULL)
-        goto send_loop;
+        // release the buffers sent completely
+        for (buf = selector->tx.buf; size > 0; buf = selector->tx.buf) {
+            n = buf->size - buf->offset;
+            if (size < n) {
+                buf->offset += size;
+                break;
+            }
+            size -= n;
+            selector->tx.buf = buf->next;
+            if (selector->tx.buf == NULL)
+                selector->tx.tail = NULL;
+            poll_buf_destroy(buf);
+        }
+    }
 
     // If we've sent all data, disable write events
     EV_SET(&ev, selector->fd, EVFILT_WRITE, EV_DISABLE, 0, 0, selector);
@@ -407,6 +434,10 @@ i64_t poll_run(poll_p poll) {
                     if (nbytes == 0)
                         break;
                 }
+
+                // let the owner queue more as the peer takes what was sent
+                if (selector->tx.write_fn != NULL)
+                    selector->tx.write_fn(poll, selector);
             }
 
         next_event:;
@@ -421,6 +452,7 @@ option_t poll_block_on(poll_p poll, selector_p selector) {
     i64_t nbytes, ret;
     struct kevent ev;
     struct timespec timeout;
+    struct pollfd pfd;
 
     LOG_TRACE("Blocking on selector id: %lld, fd: %lld", selector->id, selector->fd);
 
@@ -440,6 +472,19 @@ option_t poll_block_on(poll_p poll, selector_p selector) {
     timeout.tv_sec = 30;  // 30 seconds
     timeout.tv_nsec = 0;
 
+    // Flush what is still queued, the peer can not answer before the whole request is out
+    while (selector->tx.buf != NULL) {
+        pfd.fd = selector->fd;
+        pfd.events = POLLOUT;
+        if (poll(&pfd, 1, timeout.tv_sec * 1000) <= 0)
+            return option_error(err_os());
+
+        if (poll_send(poll, selector) == -1) {
+            poll_deregister(poll, selector->id);
+            return option_error(err_os());
+        }
+    }
+
     // Perform the read operation
     while (selector->rx.buf != NULL) {
         // Try to read first without blocking
@@ -2175,7 +2175,7 @@ obj_p ray_sq_sub_partial(obj_p x, obj_p y, i64_t len, i64_t offset) {
 
 obj_p unop_fold(raw_p op, obj_p x) {
     pool_p pool;
-    i64_t i, l, n;
+    i64_t l, n;
     obj_p v, res;
     obj_p (*unop)(obj_p);
     raw_p argv[3];
@@ -2203,19 +2203,7 @@ obj_p unop_fold(raw_p op, obj_p x) {
     if (n == 1)
         return ((obj_p(*)(obj_p, i64_t, i64_t))op)(x, l, 0);
 
-    i64_t chunk = pool_chunk_aligned(l, n, size_of_type(x->type));
-
-    pool_prepare(pool);
-    i64_t offset = 0;
-    for (i = 0; i < n - 1 && offset < l; i++) {
-        i64_t this_chunk = (offset + chunk <= l) ? chunk : (l - offset);
-        pool_add_task(pool, op, 3, x, this_chunk, offset);
-        offset += chunk;
-    }
-    if (offset < l)
-        pool_add_task(pool, op, 3, x, l - offset, offset);
-
-    v = pool_run(pool);
+    v = pool_run_morsels(pool, l, size_of_type(x->type), B8_TRUE, op, 3, 1, x, NULL, NULL);
     if (IS_ERR(v))
         return v;
 
@@ -2232,7 +2220,7 @@ obj_p unop_fold(raw_p op, obj_p x) {
 
 obj_p unop_map(raw_p op, obj_p x) {
     pool_p pool;
-    i64_t i, l, n, chunk;
+    i64_t l, n;
     obj_p v, out;
     obj_p (*unop)(obj_p);
 
@@ -2256,19 +2244,7 @@ obj_p unop_map(raw_p op, obj_p x) {
         return out;
     }
 
-    chunk = pool_chunk_aligned(l, n, size_of_type(x->type));
-
-    pool_prepare(pool);
-    i64_t offset = 0;
-    for (i = 0; i < n - 1 && offset < l; i++) {
-        i64_t this_chunk = (offset + chunk <= l) ? chunk : (l - offset);
-        pool_add_task(pool, op, 4, x, this_chunk, offset, out);
-        offset += chunk;
-    }
-    if (offset < l)
-        pool_add_task(pool, op, 4, x, l - offset, offset, out);
-
-    v = pool_run(pool);
+    v = pool_run_morsels(pool, l, size_of_type(x->type), B8_FALSE, op, 4, 1, x, NULL, NULL, out);
     if (IS_ERR(v))
         return v;
 
@@ -2279,7 +2255,7 @@ obj_p unop_map(raw_p op, obj_p x) {
 
 obj_p binop_map(raw_p op, obj_p x, obj_p y) {
     pool_p pool;
-    i64_t i, l, n;
+    i64_t l, n;
     obj_p v, out;
     i8_t t;
 
@@ -2320,19 +2296,7 @@ obj_p binop_map(raw_p op, obj_p x, obj_p y) {
         return out;
     }
 
-    i64_t chunk = pool_chunk_aligned(l, n, size_of_type(t));
-
-    pool_prepare(pool);
-    i64_t offset = 0;
-    for (i = 0; i < n - 1 && offset < l; i++) {
-        i64_t this_chunk = (offset + chunk <= l) ? chunk : (l - offset);
-        pool_add_task(pool, op, 5, x, y, this_chunk, offset, out);
-        offset += chunk;
-    }
-    if (offset < l)
-        pool_add_task(pool, op, 5, x, y, l - offset, offset, out);
-
-    v = pool_run(pool);
+    v = pool_run_morsels(pool, l, size_of_type(t), B8_FALSE, op, 5, 2, x, y, NULL, NULL, out);
     if (IS_ERR(v)) {
         out->len = 0;
         drop_obj(out);
@@ -2346,7 +2310,7 @@ obj_p binop_map(raw_p op, obj_p x, obj_p y) {
 
 obj_p binop_fold(raw_p op, obj_p x, obj_p y) {
     pool_p pool;
-    i64_t i, n, l;
+    i64_t n, l;
     obj_p v, res;
     raw_p argv[4];
 
@@ -2357,19 +2321,7 @@ obj_p binop_fold(raw_p op, obj_p x, obj_p y) {
     if (n == 1)
         return ((obj_p(*)(obj_p, obj_p, i64_t, i64_t))op)(x, y, l, 0);
 
-    i64_t chunk = pool_chunk_aligned(l, n, size_of_type(x->type));
-
-    pool_prepare(pool);
-    i64_t offset = 0;
-    for (i = 0; i < n - 1 && offset < l; i++) {
-        i64_t this_chunk = (offset + chunk <= l) ? chunk : (l - offset);
-        pool_add_task(pool, op, 4, x, y, this_chunk, offset);
-        offset += chunk;
-    }
-    if (offset < l)
-        pool_add_task(pool, op, 4, x, y, l - offset, offset);
-
-    v = pool_run(pool);
+    v = pool_run_morsels(pool, l, size_of_type(x->type), B8_TRUE, op, 4, 2, x, y, NULL, NULL);
     if (IS_ERR(v))
         return v;
 
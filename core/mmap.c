@@ -24,6 +24,12 @@
 #include "mmap.h"
 #include "util.h"
 
+static i64_t __MMAP_HUGE = MMAP_HUGE_OFF;
+
+nil_t mmap_set_huge(i64_t mode) { __MMAP_HUGE = (mode < MMAP_HUGE_OFF || mode > MMAP_HUGE_ALL) ? MMAP_HUGE_OFF : mode; }
+
+i64_t mmap_get_huge(nil_t) { return __MMAP_HUGE; }
+
 #if defined(OS_WINDOWS)
 
 raw_p mmap_stack(i64_t size) { return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE); }
@@ -91,6 +97,13 @@ i64_t mmap_commit(raw_p addr, i64_t size) {
     return 0;
 }
 
+i64_t mmap_discard(raw_p addr, i64_t size) {
+    if (VirtualAlloc(addr, size, MEM_RESET, PAGE_READWRITE) == NULL)
+        return -1;
+
+    return 0;
+}
+
 #elif defined(OS_LINUX)
 
 raw_p mmap_stack(i64_t size) {
@@ -108,12 +121,55 @@ raw_p mmap_alloc(i64_t size) {
     return ptr;
 }
 
+// Explicit huge pages come from the reserved hugetlb pool; when it is empty (or not configured) the pool is
+// mapped privately at a huge page boundary and offered to transparent huge pages instead
+raw_p mmap_alloc_huge(i64_t size, i64_t *pages) {
+    raw_p ptr;
+    i64_t head, tail;
+
+    *pages = MMAP_PAGES_SMALL;
+
+    if (__MMAP_HUGE == MMAP_HUGE_OFF || (size & (MMAP_HUGE_PAGE_SIZE - 1)) != 0)
+        return mmap_alloc(size);
+
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+
+    if (ptr != MAP_FAILED) {
+        *pages = MMAP_PAGES_HUGETLB;
+        return ptr;
+    }
+
+    ptr = mmap(NULL, size + MMAP_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+    if (ptr == MAP_FAILED)
+        return mmap_alloc(size);
+
+    // Trim the mapping down to an aligned range so that every 2MB extent can be backed by a huge page
+    head = (MMAP_HUGE_PAGE_SIZE - ((i64_t)ptr & (MMAP_HUGE_PAGE_SIZE - 1))) & (MMAP_HUGE_PAGE_SIZE - 1);
+    tail = MMAP_HUGE_PAGE_SIZE - head;
+
+    if (head > 0)
+        munmap(ptr, head);
+    if (tail > 0)
+        munmap((u8_t *)ptr + head + size, tail);
+
+    ptr = (u8_t *)ptr + head;
+    if (madvise(ptr, size, MADV_HUGEPAGE) == 0)
+        *pages = MMAP_PAGES_ADVISED;
+
+    return ptr;
+}
+
 raw_p mmap_file(i64_t fd, raw_p addr, i64_t size, i64_t offset) {
     raw_p ptr = mmap(addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE | MAP_NONBLOCK, fd, offset);
 
     if (ptr == MAP_FAILED)
         return NULL;
 
+    // Only takes effect where the kernel supports huge pages for file mappings, a no-op otherwise
+    if (__MMAP_HUGE == MMAP_HUGE_ALL && size >= MMAP_HUGE_PAGE_SIZE)
+        madvise(ptr, size, MADV_HUGEPAGE);
+
     return ptr;
 }
 
@@ -146,6 +202,15 @@ raw_p mmap_reserve(raw_p addr, i64_t size) {
 
 i64_t mmap_commit(raw_p addr, i64_t size) { return mprotect(addr, size, PROT_READ | PROT_WRITE); }
 
+// Pools are shared mappings unless they are huge: shmem pages are only released by MADV_REMOVE, private ones by
+// MADV_DONTNEED
+i64_t mmap_discard(raw_p addr, i64_t size) {
+    if (madvise(addr, size, MADV_REMOVE) == 0)
+        return 0;
+
+    return madvise(addr, size, MADV_DONTNEED);
+}
+
 #elif defined(OS_MACOS)
 
 #define MAP_ANON 0x1000
@@ -208,6 +273,8 @@ raw_p mmap_reserve(raw_p addr, i64_t size) {
 
 i64_t mmap_commit(raw_p addr, i64_t size) { return mprotect(addr, size, PROT_READ | PROT_WRITE); }
 
+i64_t mmap_discard(raw_p addr, i64_t size) { return madvise(addr, size, MADV_FREE); }
+
 #elif defined(OS_WASM)
 
 // WASM uses simple malloc/free since there's no traditional mmap
@@ -263,4 +330,20 @@ i64_t mmap_commit(raw_p addr, i64_t size) {
     return 0;
 }
 
+i64_t mmap_discard(raw_p addr, i64_t size) {
+    (void)addr;
+    (void)size;
+    // WASM memory can't be given back
+    return -1;
+}
+
+#endif
+
+#if !defined(OS_LINUX)
+
+raw_p mmap_alloc_huge(i64_t size, i64_t *pages) {
+    *pages = MMAP_PAGES_SMALL;
+    return mmap_alloc(size);
+}
+
 #endif
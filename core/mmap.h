@@ -26,6 +26,17 @@
 
 #include "rayforce.h"
 
+// Huge page modes
+#define MMAP_HUGE_OFF 0
+#define MMAP_HUGE_HEAP 1  // heap pools
+#define MMAP_HUGE_ALL 2   // heap pools and mapped column files
+#define MMAP_HUGE_PAGE_SIZE (2ll << 20)
+
+// Pages a huge page mapping got
+#define MMAP_PAGES_SMALL 0
+#define MMAP_PAGES_HUGETLB 1  // reserved huge pages
+#define MMAP_PAGES_ADVISED 2  // offered to transparent huge pages, which the kernel may or may not use
+
 raw_p mmap_stack(i64_t size);
 raw_p mmap_alloc(i64_t size);
 raw_p mmap_file(i64_t fd, raw_p addr, i64_t size, i64_t offset);
@@ -34,5 +45,9 @@ i64_t mmap_free(raw_p addr, i64_t size);
 i64_t mmap_sync(raw_p addr, i64_t size);
 raw_p mmap_reserve(raw_p addr, i64_t size);
 i64_t mmap_commit(raw_p addr, i64_t size);
+i64_t mmap_discard(raw_p addr, i64_t size);
+nil_t mmap_set_huge(i64_t mode);
+i64_t mmap_get_huge(nil_t);
+raw_p mmap_alloc_huge(i64_t size, i64_t *pages);
 
 #endif  // MMAP_H
@@ -41,6 +41,7 @@ extern struct obj_t __NULL_OBJECT;
 #define FN_AGGR 8
 #define FN_SPECIAL_FORM 16
 #define FN_GROUP_MAP 32
+#define FN_EFFECT 128  // acts outside of the evaluation: I/O, connections, the process, globals
 #define FN_ATOMIC_MASK (FN_LEFT_ATOMIC | FN_RIGHT_ATOMIC | FN_ATOMIC)
 
 // Object's attributes
@@ -54,6 +55,7 @@ extern struct obj_t __NULL_OBJECT;
 #define IS_EXTERNAL_SIMPLE(x) ((x)->mmod == MMOD_EXTERNAL_SIMPLE)
 #define IS_EXTERNAL_COMPOUND(x) ((x)->mmod == MMOD_EXTERNAL_COMPOUND)
 #define IS_EXTERNAL_SERIALIZED(x) ((x)->mmod == MMOD_EXTERNAL_SERIALIZED)
+#define IS_EXTERNAL_VIEW(x) ((x)->mmod == MMOD_EXTERNAL_VIEW)
 
 #define ISNANF64(x)                                                                                       \
     ({                                                                                                    \
@@ -243,6 +243,36 @@ obj_p ray_desc(obj_p x) {
     }
 }
 
+// Single pass sort of a table by several columns, NULL means fall back to per column passes
+static obj_p xsort_multi(obj_p x, obj_p y, i64_t asc) {
+    i64_t i, n = y->len;
+    obj_p cols, col, idx, res;
+
+    cols = LIST(n);
+    for (i = 0; i < n; i++) {
+        col = at_idx(y, i);
+        AS_LIST(cols)[i] = at_obj(x, col);
+        drop_obj(col);
+        if (IS_ERR(AS_LIST(cols)[i])) {
+            res = AS_LIST(cols)[i];
+            cols->len = i;
+            drop_obj(cols);
+            return res;
+        }
+    }
+
+    idx = ray_sort_multi(cols, asc);
+    drop_obj(cols);
+
+    if (idx == NULL || IS_ERR(idx))
+        return idx;
+
+    res = at_obj(x, idx);
+    drop_obj(idx);
+
+    return res;
+}
+
 obj_p ray_xasc(obj_p x, obj_p y) {
     obj_p idx, col, res;
 
@@ -271,6 +301,12 @@ obj_p ray_xasc(obj_p x, obj_p y) {
                 return clone_obj(x);
             }
 
+            if (n > 1) {
+                res = xsort_multi(x, y, 1);
+                if (res != NULL)
+                    return res;
+            }
+
             i64_t nrow = AS_LIST(AS_LIST(x)[1])[0]->len;
             obj_p idx = I64(nrow);
             i64_t* indices = AS_I64(idx);
@@ -359,6 +395,12 @@ obj_p ray_xdesc(obj_p x, obj_p y) {
                 return clone_obj(x);
             }
 
+            if (n > 1) {
+                res = xsort_multi(x, y, -1);
+                if (res != NULL)
+                    return res;
+            }
+
             i64_t nrow = AS_LIST(AS_LIST(x)[1])[0]->len;
             obj_p idx = I64(nrow);
             i64_t* indices = AS_I64(idx);
@@ -24,6 +24,11 @@
 #include "poll.h"
 #include "binary.h"
 #include "log.h"
+#include "shm.h"
+
+#if !defined(OS_WINDOWS) && !defined(OS_WASM)
+#include <sys/poll.h>
+#endif
 
 #if defined(OS_WINDOWS)
 #include "iocp.c"
@@ -63,11 +68,36 @@ poll_buffer_p poll_buf_create(i64_t size) {
     buf->next = NULL;
     buf->size = size;
     buf->offset = 0;
+    buf->obj = NULL;
 
     return buf;
 }
 
-nil_t poll_buf_destroy(poll_buffer_p buf) { heap_free(buf); }
+// Takes over a reference to obj and sends its bytes [offset, size) without copying them
+poll_buffer_p poll_buf_ref(obj_p obj, i64_t offset, i64_t size) {
+    poll_buffer_p buf;
+
+    buf = (poll_buffer_p)heap_alloc(ISIZEOF(struct poll_buffer_t));
+
+    if (buf == NULL) {
+        drop_obj(obj);
+        return NULL;
+    }
+
+    buf->next = NULL;
+    buf->size = size;
+    buf->offset = offset;
+    buf->obj = obj;
+
+    return buf;
+}
+
+nil_t poll_buf_destroy(poll_buffer_p buf) {
+    if (buf->obj != NULL)
+        drop_obj(buf->obj);
+
+    heap_free(buf);
+}
 
 // Buffer management functions - Unix platforms use poll_buffer_p, Windows uses different buffer model
 #if !defined(OS_WINDOWS)
@@ -127,12 +157,171 @@ i64_t poll_rx_buf_reset(poll_p poll, selector_p selector) {
     return 0;
 }
 
+nil_t poll_tx_init(selector_p selector) { memset(&selector->tx.queue, 0, sizeof(poll_queue_t)); }
+
+nil_t poll_tx_free(selector_p selector) {
+    heap_free(selector->tx.queue.ends);
+    selector->tx.queue.ends = NULL;
+}
+
+i64_t poll_tx_size(selector_p selector) { return selector->tx.queue.bytes; }
+
+nil_t poll_tx_limit(selector_p selector, i64_t bytes, i64_t msgs, poll_policy_t policy) {
+    selector->tx.queue.max_bytes = bytes;
+    selector->tx.queue.max_msgs = msgs;
+    selector->tx.queue.policy = policy;
+}
+
+// The messages whose last byte went out leave the ring
+nil_t poll_tx_sent(selector_p selector, i64_t size) {
+    poll_queue_t *queue = &selector->tx.queue;
+
+    queue->bytes -= size;
+    queue->sent += size;
+
+    while (queue->msgs > 0 && queue->ends[queue->head] <= queue->sent) {
+        queue->head = (queue->head + 1) % queue->cap;
+        queue->msgs--;
+    }
+}
+
+static nil_t poll_tx_queued(selector_p selector, i64_t size) {
+    i64_t i, cap, *ends;
+    poll_queue_t *queue = &selector->tx.queue;
+
+    if (queue->msgs == queue->cap) {
+        cap = (queue->cap == 0) ? 16 : queue->cap * 2;
+        ends = (i64_t *)heap_alloc(cap * ISIZEOF(i64_t));
+        for (i = 0; i < queue->msgs; i++)
+            ends[i] = queue->ends[(queue->head + i) % queue->cap];
+        heap_free(queue->ends);
+        queue->ends = ends;
+        queue->head = 0;
+        queue->cap = cap;
+    }
+
+    queue->bytes += size;
+    queue->ends[(queue->head + queue->msgs) % queue->cap] = queue->sent + queue->bytes;
+    queue->msgs++;
+
+    if (queue->bytes > queue->peak_bytes)
+        queue->peak_bytes = queue->bytes;
+    if (queue->msgs > queue->peak_msgs)
+        queue->peak_msgs = queue->msgs;
+}
+
+static inline b8_t poll_tx_full(poll_queue_t *queue, i64_t size) {
+    return (queue->max_bytes > 0 && queue->bytes > 0 && queue->bytes + size > queue->max_bytes) ||
+           (queue->max_msgs > 0 && queue->msgs >= queue->max_msgs);
+}
+
+nil_t poll_shutdown(selector_p selector) {
+    shm_p shm = shm_get(selector->fd);
+
+    // a shared memory connection polls an eventfd, there is no socket to shut down
+    if (shm != NULL)
+        shm_shutdown(shm);
+    else
+        shutdown(selector->fd, SHUT_RDWR);
+}
+
+// Waits up to timeout ms for the selector to take more, 0 on timeout
+static i64_t poll_tx_wait(selector_p selector, shm_p shm, i64_t timeout) {
+    struct pollfd pfd;
+    u64_t count;
+    i64_t n;
+
+    // a shared memory connection is rung on its doorbell once the peer made room, its eventfd is always writable
+    pfd.fd = selector->fd;
+    pfd.events = (shm != NULL) ? POLLIN : POLLOUT;
+    pfd.revents = 0;
+
+    n = poll(&pfd, 1, timeout);
+    if (n > 0 && shm != NULL && read(selector->fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+        return -1;
+
+    return n;
+}
+
+/*
+ * Sends what the peer takes until a message of the given size fits, FALSE if the
+ * connection failed or the peer took too little for POLL_DRAIN_TIMEOUT ms. The event
+ * loop waits meanwhile, so every other connection stalls until the peer catches up.
+ */
+static b8_t poll_tx_drain(poll_p poll, selector_p selector, i64_t size) {
+    shm_p shm = shm_get(selector->fd);
+    ray_clock_t start, now;
+    i64_t left, n;
+    b8_t ok = B8_TRUE;
+
+    ray_clock_get_time(&start);
+
+    while (poll_tx_full(&selector->tx.queue, size)) {
+        ray_clock_get_time(&now);
+        left = POLL_DRAIN_TIMEOUT - (i64_t)ray_clock_elapsed_ms(&start, &now);
+        n = (left > 0) ? poll_tx_wait(selector, shm, left) : 0;
+
+        if (n == -1 && errno == EINTR)
+            continue;
+
+        if (n <= 0 || poll_send(poll, selector) == -1) {
+            ok = B8_FALSE;
+            break;
+        }
+    }
+
+    // the doorbell was reset while waiting, ring it for whatever the peer sent meanwhile
+    if (shm != NULL)
+        shm_ring(shm);
+
+    return ok;
+}
+
+/*
+ * Queues a message, a chain of buffers, and sends what the peer takes right away.
+ * A message that would take the queue past its limits is dropped, waited for or
+ * makes the connection shut down, as its policy says; -1 is returned if it is not queued.
+ * A message is always let in when nothing is queued, however big it is.
+ */
 i64_t poll_send_buf(poll_p poll, selector_p selector, poll_buffer_p buf) {
-    // Attach the buffer to the end of the list
+    i64_t size;
+    poll_buffer_p tail, last;
+
+    for (size = 0, last = buf; last != NULL; last = last->next) {
+        size += last->size - last->offset;
+        if (last->next == NULL)
+            break;
+    }
+
+    if (poll_tx_full(&selector->tx.queue, size)) {
+        switch (selector->tx.queue.policy) {
+            case POLL_POLICY_BLOCK:
+                if (poll_tx_drain(poll, selector, size))
+                    break;
+                // fall through
+            case POLL_POLICY_DISCONNECT:
+                LOG_WARN("Send queue of selector %lld is full, shutting it down", selector->id);
+                poll_shutdown(selector);
+                // fall through
+            default:
+                selector->tx.queue.dropped++;
+                while (buf != NULL) {
+                    tail = buf->next;
+                    poll_buf_destroy(buf);
+                    buf = tail;
+                }
+                return -1;
+        }
+    }
+
+    poll_tx_queued(selector, size);
+
+    // Attach the buffers to the end of the list, only the new message is walked
     if (selector->tx.buf != NULL)
-        selector->tx.buf->next = buf;
+        selector->tx.tail->next = buf;
     else
         selector->tx.buf = buf;
+    selector->tx.tail = last;
 
     return poll_send(poll, selector);
 }
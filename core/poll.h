@@ -44,6 +44,8 @@ typedef struct repl_t *repl_p;
 #define MAX_EVENTS 1024
 #define BUF_SIZE 2048
 #define TX_QUEUE_SIZE 16
+#define POLL_IOV_MAX 128  // buffers gathered into one vectored send
+#define POLL_DRAIN_TIMEOUT 5000  // ms the block policy waits for a message to fit before it disconnects
 #define SELECTOR_ID_OFFSET 3  // shifts all selector ids by 2 to avoid 0, 1, 2 ids (stdin, stdout, stderr)
 
 // Forward declarations
@@ -61,19 +63,25 @@ typedef enum selector_type_t {
 
 // Function type definitions
 typedef i64_t (*poll_io_fn)(i64_t, u8_t *, i64_t);                              // Low level IO
+typedef i64_t (*poll_iov_fn)(i64_t, raw_p, i64_t);                               // Low level vectored IO
 typedef option_t (*poll_rdwr_fn)(struct poll_t *, struct selector_t *);         // High level IO
 typedef option_t (*poll_data_fn)(struct poll_t *, struct selector_t *, raw_p);  // Data callback
 typedef nil_t (*poll_evts_fn)(struct poll_t *, struct selector_t *);            // Event callbacks
 
 // Buffer structure (32-byte aligned for cache efficiency)
 typedef struct poll_buffer_t {
-    struct poll_buffer_t *next;
+    union {
+        struct poll_buffer_t *next;
+        i64_t views;  // rx buffer handed over to the vectors decoded in place from it
+    };
     i64_t size;
     i64_t offset;
-    i64_t _padding;  // align to 32 bytes
+    obj_p obj;  // when set, bytes [offset, size) of this object are sent instead of data
     u8_t data[];
 } *poll_buffer_p;
 
+#define POLL_BUF_DATA(b) ((b)->obj != NULL ? AS_U8((b)->obj) : (b)->data)
+
 // Platform-specific event definitions and structures
 #if defined(OS_WINDOWS)
 
@@ -186,6 +194,29 @@ typedef enum poll_events_t {
 } poll_events_t;
 #endif
 
+// What poll_send_buf does with a message that would take the tx queue past its limits
+typedef enum poll_policy_t {
+    POLL_POLICY_DROP = 0,        // the message is discarded
+    POLL_POLICY_BLOCK = 1,       // the caller waits for the queue to drain
+    POLL_POLICY_DISCONNECT = 2,  // the connection is shut down
+} poll_policy_t;
+
+// Depth and limits of a tx queue
+typedef struct poll_queue_t {
+    i64_t bytes;       // bytes queued, not sent yet
+    i64_t msgs;        // messages not sent completely
+    i64_t peak_bytes;  // high-water marks
+    i64_t peak_msgs;
+    i64_t dropped;     // messages discarded by the drop policy
+    i64_t max_bytes;   // limits, 0 for none
+    i64_t max_msgs;
+    poll_policy_t policy;
+    i64_t sent;   // bytes sent over the connection
+    i64_t head;   // oldest message in ends
+    i64_t cap;    // room in ends
+    i64_t *ends;  // ring of the values of sent at which the queued messages are out
+} poll_queue_t;
+
 typedef struct selector_t {
     i64_t fd;  // socket fd
     i64_t id;  // selector id
@@ -206,8 +237,11 @@ typedef struct selector_t {
 
     struct {
         poll_buffer_p buf;      // pointer to the buffer
+        poll_buffer_p tail;     // last buffer of the chain, where new messages are appended
         poll_io_fn send_fn;     // to be called when the selector is ready to send
+        poll_iov_fn sendv_fn;   // gathers several buffers into one send, optional
         poll_rdwr_fn write_fn;  // to be called when the selector is ready to send
+        poll_queue_t queue;     // depth and limits of the buf chain
     } tx;
 } *selector_p;
 
@@ -228,6 +262,7 @@ typedef struct poll_registry_t {
     poll_evts_fn error_fn;  // Handles errors
     poll_io_fn recv_fn;     // Called when ready to read
     poll_io_fn send_fn;     // Called when ready to send
+    poll_iov_fn sendv_fn;   // Sends an iovec array, optional
     poll_rdwr_fn read_fn;   // Processes received data
     poll_rdwr_fn write_fn;  // Processes data to be sent
     poll_data_fn data_fn;   // Processes retrieved data
@@ -253,6 +288,7 @@ nil_t poll_destroy(poll_p poll);
 i64_t poll_run(poll_p poll);
 selector_p poll_get_selector(poll_p poll, i64_t id);
 poll_buffer_p poll_buf_create(i64_t size);
+poll_buffer_p poll_buf_ref(obj_p obj, i64_t offset, i64_t size);
 nil_t poll_buf_destroy(poll_buffer_p buf);
 i64_t poll_rx_buf_request(poll_p poll, selector_p selector, i64_t size);
 i64_t poll_rx_buf_extend(poll_p poll, selector_p selector, i64_t size);
@@ -263,4 +299,16 @@ option_t poll_block_on(poll_p poll, selector_p selector);
 nil_t poll_exit(poll_p poll, i64_t code);
 nil_t poll_set_usr_fd(i64_t fd);
 
+#if !defined(OS_WINDOWS)
+// tx queue accounting, the backends report what they sent
+nil_t poll_tx_init(selector_p selector);
+nil_t poll_tx_sent(selector_p selector, i64_t size);
+nil_t poll_tx_free(selector_p selector);
+i64_t poll_tx_size(selector_p selector);
+nil_t poll_tx_limit(selector_p selector, i64_t bytes, i64_t msgs, poll_policy_t policy);
+
+// Shuts the connection down, the event loop closes it as if the peer had
+nil_t poll_shutdown(selector_p selector);
+#endif
+
 #endif  // POLL_H
@@ -30,10 +30,28 @@
 #include "heap.h"
 #include "eval.h"
 #include "string.h"
+#include "os.h"
 
 #define DEFAULT_MPMC_SIZE 2048
+#define POOL_SPIN_ROUNDS 32
 #define POOL_SPLIT_THRESHOLD (RAY_PAGE_SIZE * 4)
 #define GROUP_SPLIT_THRESHOLD 100000
+#define POOL_MORSEL_BYTES (RAY_PAGE_SIZE * 16)
+#define POOL_MORSELS_PER_EXECUTOR 4
+
+// Shared state of a morsel run: executors claim [cursor, cursor + morsel) until the input is exhausted
+typedef struct morsel_ctx_t {
+    cachepad_t pad0;
+    i64_t cursor;
+    cachepad_t pad1;
+    i64_t total_len;
+    i64_t morsel;
+    raw_p fn;
+    i64_t argc;
+    i64_t slot;  // argv index of the kernel's len argument, offset goes right after it
+    raw_p argv[8];
+    obj_p results;  // per-morsel results in input order, NULL_OBJ if they are dropped
+} *morsel_ctx_p;
 
 mpmc_p mpmc_create(i64_t size) {
     size = next_power_of_two_u64(size);
@@ -164,52 +182,77 @@ obj_p pool_call_task_fn(raw_p fn, i64_t argc, raw_p argv[]) {
     }
 }
 
+// Claims one task of the current run if there are any left
+static b8_t pool_claim(pool_p pool) {
+    i64_t n;
+
+    n = __atomic_load_n(&pool->claims, __ATOMIC_ACQUIRE);
+    while (n > 0) {
+        if (__atomic_compare_exchange_n(&pool->claims, &n, n - 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return B8_TRUE;
+    }
+
+    return B8_FALSE;
+}
+
+// Executes the tasks of the current run until none is left to claim, the one
+// completing the last task wakes up pool_run if it got parked
+static nil_t pool_drain(pool_p pool) {
+    task_data_t data;
+
+    while (pool_claim(pool)) {
+        data = mpmc_pop(pool->task_queue);
+        if (data.id == -1)
+            PANIC("Pool drain: claimed task is missing");
+
+        data.result = pool_call_task_fn(data.fn, data.argc, data.argv);
+        mpmc_push(pool->result_queue, data);
+
+        if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST) == 0 &&
+            __atomic_load_n(&pool->waiting, __ATOMIC_SEQ_CST)) {
+            mutex_lock(&pool->mutex);
+            cond_signal(&pool->done);
+            mutex_unlock(&pool->mutex);
+        }
+    }
+}
+
 raw_p executor_run(raw_p arg) {
     executor_t *executor = (executor_t *)arg;
-    task_data_t data;
-    i64_t i, tasks_count;
-    obj_p res;
+    pool_p pool = executor->pool;
+    i64_t i, rounds, spin, epoch;
     vm_p vm;
 
     // Create VM (which also creates heap) with pool pointer
-    vm = vm_create(executor->id, executor->pool);
+    vm = vm_create(executor->id, pool);
     vm->rc_sync = 1;  // Enable atomic RC for worker threads
 
+    epoch = __atomic_load_n(&pool->epoch, __ATOMIC_ACQUIRE);
+
     __atomic_store_n(&executor->heap, vm->heap, __ATOMIC_RELAXED);
-    __atomic_store_n(&executor->vm, vm, __ATOMIC_RELAXED);
+    __atomic_store_n(&executor->vm, vm, __ATOMIC_RELEASE);
 
     for (;;) {
-        mutex_lock(&executor->pool->mutex);
-        cond_wait(&executor->pool->run, &executor->pool->mutex);
+        // Spin for a while before parking, back to back runs are picked up without a futex round trip
+        spin = __atomic_load_n(&pool->spin_rounds, __ATOMIC_RELAXED);
+        for (i = 0, rounds = 0; i < spin && __atomic_load_n(&pool->epoch, __ATOMIC_ACQUIRE) == epoch; i++)
+            backoff_spin(&rounds);
 
-        if (executor->pool->state == RUN_STATE_STOPPED) {
-            mutex_unlock(&executor->pool->mutex);
-            break;
+        if (__atomic_load_n(&pool->epoch, __ATOMIC_ACQUIRE) == epoch) {
+            mutex_lock(&pool->mutex);
+            __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+            while (__atomic_load_n(&pool->epoch, __ATOMIC_SEQ_CST) == epoch)
+                cond_wait(&pool->run, &pool->mutex);
+            __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+            mutex_unlock(&pool->mutex);
         }
 
-        tasks_count = executor->pool->tasks_count;
-        mutex_unlock(&executor->pool->mutex);
-
-        // process tasks
-        for (i = 0; i < tasks_count; i++) {
-            data = mpmc_pop(executor->pool->task_queue);
+        epoch = __atomic_load_n(&pool->epoch, __ATOMIC_ACQUIRE);
 
-            // Nothing to do
-            if (data.id == -1)
-                break;
-
-            // execute task
-            res = pool_call_task_fn(data.fn, data.argc, data.argv);
-            data.result = res;
-            mpmc_push(executor->pool->result_queue, data);
-        }
+        if (__atomic_load_n(&pool->state, __ATOMIC_ACQUIRE) == RUN_STATE_STOPPED)
+            break;
 
-        if (i > 0) {
-            mutex_lock(&executor->pool->mutex);
-            executor->pool->done_count += i;
-            cond_signal(&executor->pool->done);
-            mutex_unlock(&executor->pool->mutex);
-        }
+        pool_drain(pool);
     }
 
     vm_destroy(__VM);
@@ -221,12 +264,18 @@ pool_p pool_create(i64_t thread_count) {
     i64_t i, rounds = 0;
     pool_p pool;
     vm_p vm;
+    c8_t buf[32];
 
     // thread_count includes main thread, so we allocate for all
     pool = (pool_p)heap_mmap(sizeof(struct pool_t) + (sizeof(executor_t) * thread_count));
     pool->executors_count = thread_count;
-    pool->done_count = 0;
     pool->tasks_count = 0;
+    pool->spin_rounds = POOL_SPIN_ROUNDS;
+    pool->epoch = 0;
+    pool->sleepers = 0;
+    pool->claims = 0;
+    pool->pending = 0;
+    pool->waiting = 0;
     pool->task_queue = mpmc_create(DEFAULT_MPMC_SIZE);
     pool->result_queue = mpmc_create(DEFAULT_MPMC_SIZE);
     pool->state = RUN_STATE_RUNNING;
@@ -234,6 +283,10 @@ pool_p pool_create(i64_t thread_count) {
     pool->run = cond_create();
     pool->done = cond_create();
 
+    // Spinning before parking can be tuned (or disabled with 0) for oversubscribed machines
+    if (os_get_var("POOL_SPIN", buf, sizeof(buf)) != -1)
+        i64_from_str(buf, strlen(buf), &pool->spin_rounds);
+
     // Executor[0] is the main thread - create VM directly here
     pool->executors[0].id = 0;
     pool->executors[0].pool = pool;
@@ -271,7 +324,8 @@ nil_t pool_destroy(pool_p pool) {
     i64_t i, n;
 
     mutex_lock(&pool->mutex);
-    pool->state = RUN_STATE_STOPPED;
+    __atomic_store_n(&pool->state, RUN_STATE_STOPPED, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&pool->epoch, 1, __ATOMIC_SEQ_CST);
     cond_broadcast(&pool->run);
     mutex_unlock(&pool->mutex);
 
@@ -307,7 +361,6 @@ nil_t pool_prepare(pool_p pool) {
     mutex_lock(&pool->mutex);
 
     pool->tasks_count = 0;
-    pool->done_count = 0;
 
     n = pool->executors_count;
     for (i = 0; i < n; i++) {
@@ -366,50 +419,47 @@ nil_t pool_add_task(pool_p pool, raw_p fn, i64_t argc, ...) {
 }
 
 obj_p pool_run(pool_p pool) {
-    i64_t i, n, tasks_count, executors_count;
+    i64_t i, n, rounds, spin, tasks_count, sync;
     obj_p e, res;
     task_data_t data;
 
     if (pool == NULL)
         PANIC("Pool run: pool is NULL");
 
-    mutex_lock(&pool->mutex);
-
+    // Readers serving queries keep the main thread synchronized, so restore rather than reset
+    sync = rc_sync_get();
     rc_sync_set(1);
 
     tasks_count = pool->tasks_count;
-    executors_count = pool->executors_count;
 
-    // wake up needed executors
-    if (executors_count < tasks_count) {
-        for (i = 0; i < executors_count; i++)
-            cond_signal(&pool->run);
-    } else
-        cond_broadcast(&pool->run);
+    // Publish the run: arm the latch, then let executors claim the tasks
+    __atomic_store_n(&pool->pending, tasks_count, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&pool->claims, tasks_count, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&pool->epoch, 1, __ATOMIC_SEQ_CST);
 
-    mutex_unlock(&pool->mutex);
+    // Spinning executors see the new epoch by themselves, only the parked ones need a wakeup
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        mutex_lock(&pool->mutex);
+        cond_broadcast(&pool->run);
+        mutex_unlock(&pool->mutex);
+    }
 
     // process tasks on self too
-    for (i = 0; i < tasks_count; i++) {
-        data = mpmc_pop(pool->task_queue);
+    pool_drain(pool);
 
-        // Nothing to do
-        if (data.id == -1)
-            break;
-
-        // execute task
-        res = pool_call_task_fn(data.fn, data.argc, data.argv);
-        data.result = res;
-        mpmc_push(pool->result_queue, data);
-    }
+    // wait for all tasks to be done
+    spin = __atomic_load_n(&pool->spin_rounds, __ATOMIC_RELAXED);
+    for (i = 0, rounds = 0; i < spin && __atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0; i++)
+        backoff_spin(&rounds);
 
     mutex_lock(&pool->mutex);
 
-    pool->done_count += i;
-
-    // wait for all tasks to be done
-    while (pool->done_count < tasks_count)
-        cond_wait(&pool->done, &pool->mutex);
+    if (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0) {
+        __atomic_store_n(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) > 0)
+            cond_wait(&pool->done, &pool->mutex);
+        __atomic_store_n(&pool->waiting, 0, __ATOMIC_RELAXED);
+    }
 
     // collect results
     res = LIST(tasks_count);
@@ -428,7 +478,7 @@ obj_p pool_run(pool_p pool) {
         heap_merge(pool->executors[i].heap);
     }
 
-    rc_sync_set(0);
+    rc_sync_set(sync);
 
     mutex_unlock(&pool->mutex);
 
@@ -444,6 +494,11 @@ obj_p pool_run(pool_p pool) {
     return res;
 }
 
+nil_t pool_set_spin(pool_p pool, i64_t rounds) {
+    if (pool != NULL)
+        __atomic_store_n(&pool->spin_rounds, (rounds > 0) ? rounds : 0, __ATOMIC_RELAXED);
+}
+
 i64_t pool_split_by(pool_p pool, i64_t input_len, i64_t groups_len) {
     if (pool == NULL || input_len < POOL_SPLIT_THRESHOLD)
         return 1;
@@ -480,9 +535,119 @@ i64_t pool_chunk_aligned(i64_t total_len, i64_t num_workers, i64_t elem_size) {
     return pages_per_chunk * elems_per_page;
 }
 
+// Morsel size for an input: a few morsels per executor so the fast ones can pick up the slack
+// of the slow ones, page aligned and capped to stay cache resident
+i64_t pool_morsel_size(pool_p pool, i64_t total_len, i64_t elem_size) {
+    i64_t size, limit;
+
+    if (elem_size <= 0)
+        elem_size = 1;
+
+    limit = POOL_MORSEL_BYTES / elem_size;
+    if (limit == 0)
+        limit = 1;
+
+    size = pool_chunk_aligned(total_len, pool_get_executors_count(pool) * POOL_MORSELS_PER_EXECUTOR, elem_size);
+    if (size < 1)
+        size = 1;
+
+    return (size < limit) ? size : limit;
+}
+
+static obj_p pool_morsel_worker(raw_p arg) {
+    morsel_ctx_p ctx = (morsel_ctx_p)arg;
+    raw_p argv[8];
+    i64_t len, offset;
+    obj_p res;
+
+    memcpy(argv, ctx->argv, sizeof(argv));
+
+    for (;;) {
+        offset = __atomic_fetch_add(&ctx->cursor, ctx->morsel, __ATOMIC_RELAXED);
+        if (offset >= ctx->total_len)
+            return NULL_OBJ;
+
+        len = ctx->total_len - offset;
+        if (len > ctx->morsel)
+            len = ctx->morsel;
+
+        argv[ctx->slot] = (raw_p)len;
+        argv[ctx->slot + 1] = (raw_p)offset;
+        res = pool_call_task_fn(ctx->fn, ctx->argc, argv);
+
+        if (IS_ERR(res)) {
+            // Nothing left to claim for the others
+            __atomic_store_n(&ctx->cursor, ctx->total_len, __ATOMIC_RELAXED);
+            return res;
+        }
+
+        if (ctx->results != NULL_OBJ)
+            AS_LIST(ctx->results)[offset / ctx->morsel] = res;
+        else
+            drop_obj(res);
+    }
+}
+
+// Runs fn over [0, total_len) in morsels claimed dynamically by all executors. fn takes argc
+// arguments passed after slot, with the morsel's len and offset substituted at argv[slot] and
+// argv[slot + 1]. Returns the list of morsel results in input order if collect is set
+obj_p pool_run_morsels(pool_p pool, i64_t total_len, i64_t elem_size, b8_t collect, raw_p fn, i64_t argc, i64_t slot,
+                       ...) {
+    i64_t i, n, morsels;
+    va_list args;
+    struct morsel_ctx_t ctx;
+    obj_p v;
+
+    if (pool == NULL)
+        PANIC("Pool run morsels: pool is NULL");
+
+    ctx.cursor = 0;
+    ctx.total_len = total_len;
+    ctx.morsel = pool_morsel_size(pool, total_len, elem_size);
+    ctx.fn = fn;
+    ctx.argc = argc;
+    ctx.slot = slot;
+    ctx.results = NULL_OBJ;
+
+    va_start(args, slot);
+
+    for (i = 0; i < argc; i++)
+        ctx.argv[i] = va_arg(args, raw_p);
+
+    va_end(args);
+
+    morsels = (total_len + ctx.morsel - 1) / ctx.morsel;
+
+    if (collect) {
+        ctx.results = LIST(morsels);
+        for (i = 0; i < morsels; i++)
+            AS_LIST(ctx.results)[i] = NULL_OBJ;
+    }
+
+    n = pool->executors_count;
+    if (n > morsels)
+        n = morsels;
+
+    pool_prepare(pool);
+
+    for (i = 0; i < n; i++)
+        pool_add_task(pool, (raw_p)pool_morsel_worker, 1, &ctx);
+
+    v = pool_run(pool);
+
+    if (IS_ERR(v)) {
+        drop_obj(ctx.results);
+        return v;
+    }
+
+    drop_obj(v);
+
+    return ctx.results;
+}
+
 nil_t pool_map(i64_t total_len, pool_map_fn fn, void *ctx) {
     pool_p pool;
-    i64_t i, n, chunk;
+    i64_t n;
     obj_p v;
 
     pool = pool_get();
@@ -493,14 +658,6 @@ nil_t pool_map(i64_t total_len, pool_map_fn fn, void *ctx) {
         return;
     }
 
-    chunk = total_len / n;
-    pool_prepare(pool);
-
-    for (i = 0; i < n - 1; i++)
-        pool_add_task(pool, (raw_p)fn, 3, (raw_p)chunk, (raw_p)(i * chunk), ctx);
-
-    pool_add_task(pool, (raw_p)fn, 3, (raw_p)(total_len - i * chunk), (raw_p)(i * chunk), ctx);
-
-    v = pool_run(pool);
+    v = pool_run_morsels(pool, total_len, sizeof(i64_t), B8_FALSE, (raw_p)fn, 3, 0, NULL, NULL, ctx);
     drop_obj(v);
 }
\ No newline at end of file
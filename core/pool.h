@@ -80,15 +80,23 @@ typedef struct executor_t {
 } executor_t;
 
 typedef struct pool_t {
-    mutex_t mutex;           // Mutex for condition variable
-    cond_t run;              // Condition variable for run VMs
-    cond_t done;             // Condition variable for signal that VM is done
+    mutex_t mutex;           // Mutex for condition variables
+    cond_t run;              // Condition variable for parked executors
+    cond_t done;             // Condition variable for parked pool_run
     run_state_t state;       // Pool's state
-    i64_t done_count;        // Number of done VMs
     i64_t executors_count;   // Number of executors
     i64_t tasks_count;       // Number of tasks
+    i64_t spin_rounds;       // Backoff rounds to spin before parking
     mpmc_p task_queue;       // Pool's task queue
     mpmc_p result_queue;     // Pool's result queue
+    cachepad_t pad0;
+    i64_t epoch;             // Bumped by every run, idle executors wait for it to change
+    i64_t sleepers;          // Number of executors parked on run
+    cachepad_t pad1;
+    i64_t claims;            // Tasks of the current run not claimed yet
+    i64_t pending;           // Countdown latch: tasks of the current run not done yet
+    i64_t waiting;           // pool_run is parked on done
+    cachepad_t pad2;
     executor_t executors[];  // Array of executors
 } *pool_p;
 
@@ -101,7 +109,11 @@ obj_p pool_call_task_fn(raw_p fn, i64_t argc, raw_p argv[]);
 obj_p pool_run(pool_p pool);
 i64_t pool_split_by(pool_p pool, i64_t input_len, i64_t groups_len);
 i64_t pool_get_executors_count(pool_p pool);
+nil_t pool_set_spin(pool_p pool, i64_t rounds);
 i64_t pool_chunk_aligned(i64_t total_len, i64_t num_workers, i64_t elem_size);
+i64_t pool_morsel_size(pool_p pool, i64_t total_len, i64_t elem_size);
+obj_p pool_run_morsels(pool_p pool, i64_t total_len, i64_t elem_size, b8_t collect, raw_p fn, i64_t argc, i64_t slot,
+                       ...);
 
 typedef obj_p (*pool_map_fn)(i64_t len, i64_t offset, void *ctx);
 nil_t pool_map(i64_t total_len, pool_map_fn fn, void *ctx);
@@ -0,0 +1,461 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+#include "pubsub.h"
+#include "ipc.h"
+#include "eval.h"
+#include "serve.h"
+#include "chrono.h"
+#include "runtime.h"
+#include "items.h"
+#include "compose.h"
+#include "order.h"
+#include "symbols.h"
+#include "string.h"
+#include "error.h"
+#include "ops.h"
+#include "os.h"
+#include "log.h"
+
+/*
+ * Tickerplant side of publish/subscribe. Subscribers of a table that ask for the same
+ * rows with the same batching share a topic: its pending rows are serialized once per
+ * batch, and the one payload is queued by reference on every subscriber's connection.
+ * A topic sends its batch once it holds `rows` rows, or `ms` after its first row came,
+ * whichever is first; with neither set every publish goes out as it comes.
+ * Subscribers get (upd "table" rows) as an async message.
+ */
+
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+
+obj_p ray_subscribe(obj_p *x, i64_t n) {
+    UNUSED(x);
+    UNUSED(n);
+    return err_nyi(0);
+}
+
+obj_p ray_unsubscribe(obj_p x) {
+    UNUSED(x);
+    return err_nyi(0);
+}
+
+obj_p ray_publish(obj_p x, obj_p y) {
+    UNUSED(x);
+    UNUSED(y);
+    return err_nyi(0);
+}
+
+i64_t pubsub_tick(i64_t now) {
+    UNUSED(now);
+    return TIMEOUT_INFINITY;
+}
+
+nil_t pubsub_drop(i64_t id) { UNUSED(id); }
+
+nil_t pubsub_destroy(nil_t) {}
+
+#else
+
+typedef struct pubsub_topic_t {
+    i64_t table;  // symbol of the table
+    obj_p syms;   // values of the sym column to pass, NULL_OBJ for all rows
+    i64_t ms;     // longest the first pending row waits, 0 for no limit
+    i64_t rows;   // rows that make a batch, 0 for no limit
+    obj_p subs;   // selector ids of the subscribers
+    obj_p batch;  // pending rows, NULL_OBJ for none
+    i64_t due;    // when the pending rows are sent at the latest
+} *pubsub_topic_p;
+
+static pubsub_topic_p *__PUBSUB_TOPICS = NULL;
+static i64_t __PUBSUB_COUNT = 0;
+static i64_t __PUBSUB_QUEUE = -1;  // bytes, taken from PUBSUB_QUEUE_MB on first use
+
+static i64_t pubsub_queue_limit(nil_t) {
+    c8_t buf[32];
+
+    if (__PUBSUB_QUEUE == -1) {
+        __PUBSUB_QUEUE = PUBSUB_QUEUE_MB;
+        if (os_get_var("PUBSUB_QUEUE_MB", buf, sizeof(buf)) != -1)
+            i64_from_str(buf, strlen(buf), &__PUBSUB_QUEUE);
+        __PUBSUB_QUEUE <<= 20;
+    }
+
+    return __PUBSUB_QUEUE;
+}
+
+// The IPC connection the running handler was called from, -1 outside of one
+static i64_t pubsub_caller(nil_t) {
+    obj_p *w;
+    selector_p selector;
+
+    w = resolve(symbols_intern(".z.w", 4));
+    if (w == NULL || (*w)->type != -TYPE_I64 || (*w)->i64 <= 0)
+        return -1;
+
+    selector = poll_get_selector(runtime_get()->poll, (*w)->i64);
+    if (selector == NULL || selector->data_fn != ipc_on_data)
+        return -1;
+
+    return (*w)->i64;
+}
+
+static nil_t pubsub_topic_destroy(pubsub_topic_p topic) {
+    drop_obj(topic->syms);
+    drop_obj(topic->subs);
+    drop_obj(topic->batch);
+    heap_free(topic);
+}
+
+// Takes syms over
+static pubsub_topic_p pubsub_topic(i64_t table, obj_p syms, i64_t ms, i64_t rows) {
+    i64_t i;
+    pubsub_topic_p topic;
+
+    for (i = 0; i < __PUBSUB_COUNT; i++) {
+        topic = __PUBSUB_TOPICS[i];
+        if (topic->table != table || topic->ms != ms || topic->rows != rows)
+            continue;
+        if ((topic->syms == NULL_OBJ || syms == NULL_OBJ) ? topic->syms != syms : cmp_obj(topic->syms, syms) != 0)
+            continue;
+
+        drop_obj(syms);
+        return topic;
+    }
+
+    topic = (pubsub_topic_p)heap_alloc(sizeof(struct pubsub_topic_t));
+    topic->table = table;
+    topic->syms = syms;
+    topic->ms = ms;
+    topic->rows = rows;
+    topic->subs = I64(0);
+    topic->batch = NULL_OBJ;
+    topic->due = 0;
+
+    __PUBSUB_TOPICS = (pubsub_topic_p *)heap_realloc(__PUBSUB_TOPICS, (__PUBSUB_COUNT + 1) * sizeof(pubsub_topic_p));
+    __PUBSUB_TOPICS[__PUBSUB_COUNT++] = topic;
+
+    return topic;
+}
+
+// Removes a subscriber from the topics of a table, or of all tables for NULL_I64, and the topics left without any
+static nil_t pubsub_remove(i64_t table, i64_t id) {
+    i64_t i, j;
+    pubsub_topic_p topic;
+
+    for (i = 0; i < __PUBSUB_COUNT; i++) {
+        topic = __PUBSUB_TOPICS[i];
+
+        if (table == NULL_I64 || topic->table == table) {
+            j = find_raw(topic->subs, &id);
+            if (j != NULL_I64)
+                remove_idx(&topic->subs, j);
+
+            if (topic->subs->len == 0) {
+                pubsub_topic_destroy(topic);
+                __PUBSUB_TOPICS[i] = NULL;
+            }
+        }
+    }
+
+    for (i = 0, j = 0; i < __PUBSUB_COUNT; i++)
+        if (__PUBSUB_TOPICS[i] != NULL)
+            __PUBSUB_TOPICS[j++] = __PUBSUB_TOPICS[i];
+
+    __PUBSUB_COUNT = j;
+}
+
+/*
+ * Sends the pending rows of a topic to its subscribers. A subscriber that has not taken
+ * in what was queued for it before is not sent more and is shut down, the event loop
+ * then closes it, which drops its subscriptions.
+ */
+static nil_t pubsub_flush(poll_p poll, pubsub_topic_p topic) {
+    i64_t i, l, id, limit;
+    lit_p name;
+    obj_p msg, data;
+    selector_p selector;
+
+    name = str_from_symbol(topic->table);
+    msg = vn_list(3, symbol("upd", 3), string_from_str(name, SYMBOL_STRLEN(topic->table)), topic->batch);
+    topic->batch = NULL_OBJ;
+    data = ipc_pack_msg(msg, MSG_TYPE_ASYN);
+    drop_obj(msg);
+
+    limit = pubsub_queue_limit();
+    l = topic->subs->len;
+
+    for (i = 0; i < l; i++) {
+        id = AS_I64(topic->subs)[i];
+        selector = poll_get_selector(poll, id);
+        if (selector == NULL)
+            continue;
+
+        if (poll_tx_size(selector) > limit) {
+            LOG_WARN("Subscriber %lld is too slow, dropping it", id);
+            poll_shutdown(selector);
+            continue;
+        }
+
+        poll_send_buf(poll, selector, poll_buf_ref(clone_obj(data), 0, data->len));
+    }
+
+    drop_obj(data);
+}
+
+obj_p ray_subscribe(obj_p *x, i64_t n) {
+    i64_t id, ms, rows;
+    obj_p syms, set;
+    pubsub_topic_p topic;
+
+    if (n < 1 || n > 4)
+        return err_arity(4, n);
+
+    if (x[0]->type != -TYPE_SYMBOL)
+        return err_type(-TYPE_SYMBOL, x[0]->type, 0);
+
+    if (n > 2 && x[2]->type != -TYPE_I64)
+        return err_type(-TYPE_I64, x[2]->type, 0);
+
+    if (n > 3 && x[3]->type != -TYPE_I64)
+        return err_type(-TYPE_I64, x[3]->type, 0);
+
+    if (n > 1 && !is_null(x[1]) && x[1]->type != -TYPE_SYMBOL && x[1]->type != TYPE_SYMBOL)
+        return err_type(TYPE_SYMBOL, x[1]->type, 0);
+
+    // The subscriptions are kept by the main thread, a reader leaves the request to it
+    if (!ray_is_main_thread()) {
+        serve_rerun();
+        return err_nyi(0);
+    }
+
+    id = pubsub_caller();
+    if (id == -1)
+        return err_domain();
+
+    ms = (n > 2) ? x[2]->i64 : 0;
+    rows = (n > 3) ? x[3]->i64 : 0;
+    if (ms < 0 || rows < 0)
+        return err_domain();
+
+    if (n < 2 || is_null(x[1]))
+        syms = NULL_OBJ;
+    else if (x[1]->type == -TYPE_SYMBOL) {
+        syms = SYMBOL(1);
+        AS_SYMBOL(syms)[0] = x[1]->i64;
+    } else {
+        // Topics are told apart by the set of syms, whatever order they were listed in
+        set = ray_distinct(x[1]);
+        if (IS_ERR(set))
+            return set;
+        syms = ray_asc(set);
+        drop_obj(set);
+        if (IS_ERR(syms))
+            return syms;
+    }
+
+    // A subscription of the connection to the same table is replaced
+    pubsub_remove(x[0]->i64, id);
+
+    topic = pubsub_topic(x[0]->i64, syms, ms, rows);
+    push_raw(&topic->subs, &id);
+
+    LOG_INFO("Connection %lld subscribed to %s", id, str_from_symbol(x[0]->i64));
+
+    return NULL_OBJ;
+}
+
+obj_p ray_unsubscribe(obj_p x) {
+    i64_t id;
+
+    if (x->type != -TYPE_SYMBOL)
+        return err_type(-TYPE_SYMBOL, x->type, 0);
+
+    if (!ray_is_main_thread()) {
+        serve_rerun();
+        return err_nyi(0);
+    }
+
+    id = pubsub_caller();
+    if (id == -1)
+        return err_domain();
+
+    pubsub_remove(x->i64, id);
+
+    return NULL_OBJ;
+}
+
+// Rows of a table that go to a topic, NULL_OBJ for none
+static obj_p pubsub_rows(pubsub_topic_p topic, obj_p table, obj_p col) {
+    obj_p mask, ids, rows;
+
+    if (topic->syms == NULL_OBJ)
+        return clone_obj(table);
+
+    mask = ray_in(col, topic->syms);
+    if (IS_ERR(mask))
+        return mask;
+
+    ids = ray_where(mask);
+    drop_obj(mask);
+    if (IS_ERR(ids))
+        return ids;
+
+    if (ids->len == 0) {
+        drop_obj(ids);
+        return NULL_OBJ;
+    }
+
+    rows = at_ids(table, AS_I64(ids), ids->len);
+    drop_obj(ids);
+
+    return rows;
+}
+
+/*
+ * The new batches of all the topics of the table are made before any of them is
+ * touched, so a publish that fails leaves every topic as it was.
+ */
+obj_p ray_publish(obj_p x, obj_p y) {
+    i64_t i, now;
+    obj_p col, part, batch, batches, res;
+    pubsub_topic_p topic;
+    poll_p poll;
+
+    if (x->type != -TYPE_SYMBOL)
+        return err_type(-TYPE_SYMBOL, x->type, 0);
+
+    if (y->type != TYPE_TABLE)
+        return err_type(TYPE_TABLE, y->type, 0);
+
+    if (!ray_is_main_thread()) {
+        serve_rerun();
+        return err_nyi(0);
+    }
+
+    poll = runtime_get()->poll;
+    now = get_time_millis();
+    col = NULL_OBJ;
+    res = NULL_OBJ;
+
+    // The sym column is looked up once for all the topics of the table
+    for (i = 0; i < __PUBSUB_COUNT; i++) {
+        topic = __PUBSUB_TOPICS[i];
+        if (topic->table == x->i64 && topic->syms != NULL_OBJ) {
+            col = at_sym(y, "sym", 3);
+            if (IS_ERR(col))
+                return col;
+            break;
+        }
+    }
+
+    batches = LIST(__PUBSUB_COUNT);
+    for (i = 0; i < __PUBSUB_COUNT; i++)
+        AS_LIST(batches)[i] = NULL_OBJ;
+
+    for (i = 0; i < __PUBSUB_COUNT; i++) {
+        topic = __PUBSUB_TOPICS[i];
+        if (topic->table != x->i64)
+            continue;
+
+        part = pubsub_rows(topic, y, col);
+        if (part == NULL_OBJ)
+            continue;
+
+        if (IS_ERR(part) || topic->batch == NULL_OBJ)
+            batch = part;
+        else {
+            batch = ray_concat(topic->batch, part);
+            drop_obj(part);
+        }
+
+        if (IS_ERR(batch)) {
+            res = batch;
+            break;
+        }
+
+        AS_LIST(batches)[i] = batch;
+    }
+
+    drop_obj(col);
+
+    if (res != NULL_OBJ) {
+        drop_obj(batches);
+        return res;
+    }
+
+    for (i = 0; i < __PUBSUB_COUNT; i++) {
+        batch = AS_LIST(batches)[i];
+        if (batch == NULL_OBJ)
+            continue;
+
+        topic = __PUBSUB_TOPICS[i];
+        if (topic->batch == NULL_OBJ)
+            topic->due = now + topic->ms;
+
+        drop_obj(topic->batch);
+        topic->batch = batch;
+        AS_LIST(batches)[i] = NULL_OBJ;
+
+        if ((topic->ms == 0 && topic->rows == 0) || (topic->rows > 0 && ops_count(topic->batch) >= topic->rows))
+            pubsub_flush(poll, topic);
+    }
+
+    drop_obj(batches);
+
+    return res;
+}
+
+i64_t pubsub_tick(i64_t now) {
+    i64_t i, next;
+    pubsub_topic_p topic;
+
+    next = TIMEOUT_INFINITY;
+
+    for (i = 0; i < __PUBSUB_COUNT; i++) {
+        topic = __PUBSUB_TOPICS[i];
+        if (topic->batch == NULL_OBJ || topic->ms == 0)
+            continue;
+
+        if (topic->due <= now)
+            pubsub_flush(runtime_get()->poll, topic);
+        else if (next == TIMEOUT_INFINITY || topic->due - now < next)
+            next = topic->due - now;
+    }
+
+    return next;
+}
+
+nil_t pubsub_drop(i64_t id) { pubsub_remove(NULL_I64, id); }
+
+nil_t pubsub_destroy(nil_t) {
+    i64_t i;
+
+    for (i = 0; i < __PUBSUB_COUNT; i++)
+        pubsub_topic_destroy(__PUBSUB_TOPICS[i]);
+
+    heap_free(__PUBSUB_TOPICS);
+    __PUBSUB_TOPICS = NULL;
+    __PUBSUB_COUNT = 0;
+}
+
+#endif
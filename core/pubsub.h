@@ -0,0 +1,49 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+#ifndef PUBSUB_H
+#define PUBSUB_H
+
+#include "rayforce.h"
+#include "poll.h"
+
+#define PUBSUB_QUEUE_MB 256  // a subscriber with more than this many bytes left to send is dropped
+
+// (subscribe 'table [syms] [ms] [rows]): subscribes the calling connection to the rows of a table
+obj_p ray_subscribe(obj_p *x, i64_t n);
+
+// (unsubscribe 'table): drops the subscriptions of the calling connection to a table
+obj_p ray_unsubscribe(obj_p x);
+
+// (publish 'table rows): hands rows of a table over to its subscribers
+obj_p ray_publish(obj_p x, obj_p y);
+
+// Sends the batches that are due, returns the time left to the next one or TIMEOUT_INFINITY
+i64_t pubsub_tick(i64_t now);
+
+// Forgets a closed connection
+nil_t pubsub_drop(i64_t id);
+
+nil_t pubsub_destroy(nil_t);
+
+#endif  // PUBSUB_H
@@ -190,6 +190,7 @@ nil_t query_ctx_init(query_ctx_p ctx) {
     ctx->group_index = NULL_OBJ;
     ctx->parent = vm->query_ctx;
     vm->query_ctx = ctx;
+    heap_arena_begin();
 }
 
 nil_t query_ctx_destroy(query_ctx_p ctx) {
@@ -203,6 +204,9 @@ nil_t query_ctx_destroy(query_ctx_p ctx) {
     drop_obj(ctx->query_fields);
     drop_obj(ctx->query_values);
     drop_obj(ctx->group_index);
+
+    // Nothing from the arena outlives the query, temporaries are dropped by now
+    heap_arena_end();
 }
 
 obj_p select_fetch_table(obj_p obj, query_ctx_p ctx) {
@@ -545,14 +549,14 @@ obj_p ray_select(obj_p obj) {
     obj_p res;
     struct query_ctx_t ctx;
 
-    query_ctx_init(&ctx);
-
     if (obj->type != TYPE_DICT)
         return err_type(0, 0, 0);
 
     if (AS_LIST(obj)[0]->type != TYPE_SYMBOL)
         return err_type(0, 0, 0);
 
+    query_ctx_init(&ctx);
+
     timeit_span_start("select");
 
     // Fetch table - ctx.table is set, resolve() will find columns via query_ctx
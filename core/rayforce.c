@@ -74,10 +74,13 @@ obj_p atom(i8_t type) {
     if (a == NULL)
         PANIC("oom");
 
+    heap_prof_tag(a, -type);
+
     a->mmod = MMOD_INTERNAL;
     a->type = -type;
     a->rc = 1;
     a->attrs = 0;
+    a->i64 = 0;  // casts read narrow atoms through wider fields, keep the payload zero extended
 
     return a;
 }
@@ -254,6 +257,8 @@ obj_p vector(i8_t type, i64_t len) {
     if (vec == NULL)
         return err_limit(data_size);
 
+    heap_prof_tag(vec, t);
+
     vec->mmod = MMOD_INTERNAL;
     vec->order = 0;  // Initialize order field to avoid uninitialized bytes
     vec->type = t;
@@ -293,6 +298,7 @@ obj_p vn_list(i64_t len, ...) {
     va_list args;
 
     l = (obj_p)heap_alloc(sizeof(struct obj_t) + sizeof(obj_p) * len);
+    heap_prof_tag(l, TYPE_LIST);
     l->mmod = MMOD_INTERNAL;
     l->type = TYPE_LIST;
     l->rc = 1;
@@ -314,6 +320,7 @@ obj_p dict(obj_p keys, obj_p vals) {
 
     d = vn_list(2, keys, vals);
     d->type = TYPE_DICT;
+    heap_prof_tag(d, TYPE_DICT);
 
     return d;
 }
@@ -323,6 +330,7 @@ obj_p table(obj_p keys, obj_p vals) {
 
     t = vn_list(2, keys, vals);
     t->type = TYPE_TABLE;
+    heap_prof_tag(t, TYPE_TABLE);
 
     return t;
 }
@@ -398,7 +406,9 @@ obj_p push_raw(obj_p* obj, raw_p val) {
         memcpy(new_obj->raw, (*obj)->raw, off);
         new_obj->mmod = MMOD_INTERNAL;
         new_obj->type = (*obj)->type;
+        new_obj->attrs = (*obj)->attrs;
         new_obj->rc = 1;
+        new_obj->len = (*obj)->len;
         drop_obj(*obj);
         *obj = new_obj;
     }
@@ -1027,6 +1037,27 @@ obj_p at_idx(obj_p obj, i64_t idx) {
     }
 }
 
+static inline b8_t at_ids_plain(i8_t type) {
+    switch (type) {
+        case TYPE_B8:
+        case TYPE_U8:
+        case TYPE_C8:
+        case TYPE_I16:
+        case TYPE_I32:
+        case TYPE_DATE:
+        case TYPE_TIME:
+        case TYPE_I64:
+        case TYPE_SYMBOL:
+        case TYPE_TIMESTAMP:
+        case TYPE_F64:
+        case TYPE_GUID:
+        case TYPE_LIST:
+            return B8_TRUE;
+        default:
+            return B8_FALSE;
+    }
+}
+
 static obj_p at_ids_partial(obj_p obj, i64_t ids[], i64_t len, i64_t offset, obj_p out) {
     i64_t i;
     u8_t *u8inp, *u8out;
@@ -1178,8 +1209,18 @@ obj_p at_ids(obj_p obj, i64_t ids[], i64_t len) {
         case TYPE_TABLE:
             xl = AS_LIST(obj)[0]->len;
             cols = LIST(xl);
+            pool = runtime_get()->pool;
+            n = (xl > 1) ? pool_split_by(pool, len, 0) : 1;
+
+            // Columns that can't be gathered in a shared pool round go first
             for (i = 0; i < xl; i++) {
-                k = at_ids(AS_LIST(AS_LIST(obj)[1])[i], ids, len);
+                v = AS_LIST(AS_LIST(obj)[1])[i];
+                if (n > 1 && at_ids_plain(v->type)) {
+                    AS_LIST(cols)[i] = NULL_OBJ;
+                    continue;
+                }
+
+                k = at_ids(v, ids, len);
 
                 // if (IS_ATOM(c))
                 //     c = ray_enlist(&c, 1);
@@ -1193,6 +1234,47 @@ obj_p at_ids(obj_p obj, i64_t ids[], i64_t len) {
                 ins_obj(&cols, i, k);
             }
 
+            if (n == 1)
+                return table(clone_obj(AS_LIST(obj)[0]), cols);
+
+            for (i = 0; i < xl; i++) {
+                if (AS_LIST(cols)[i] != NULL_OBJ)
+                    continue;
+
+                out = vector(AS_LIST(AS_LIST(obj)[1])[i]->type, len);
+                if (IS_ERR(out)) {
+                    // Not yet filled lists must not release their garbage
+                    for (m = 0; m < i; m++)
+                        if (AS_LIST(cols)[m]->type == TYPE_LIST)
+                            AS_LIST(cols)[m]->len = 0;
+                    drop_obj(cols);
+                    return out;
+                }
+
+                AS_LIST(cols)[i] = out;
+            }
+
+            // Gather all plain columns in a single pool round
+            pool_prepare(pool);
+            for (i = 0; i < xl; i++) {
+                v = AS_LIST(AS_LIST(obj)[1])[i];
+                if (!at_ids_plain(v->type))
+                    continue;
+
+                chunk = pool_chunk_aligned(len, n, size_of_type(v->type));
+                for (m = 0; m < len; m += chunk)
+                    pool_add_task(pool, at_ids_partial, 5, v, ids, (m + chunk <= len) ? chunk : len - m, m,
+                                  AS_LIST(cols)[i]);
+            }
+
+            res = pool_run(pool);
+            if (IS_ERR(res)) {
+                drop_obj(cols);
+                return res;
+            }
+
+            drop_obj(res);
+
             return table(clone_obj(AS_LIST(obj)[0]), cols);
         case TYPE_PARTEDB8:
         case TYPE_PARTEDU8:
@@ -2900,6 +2982,8 @@ nil_t __attribute__((hot)) drop_obj(obj_p obj) {
         default:
             if (IS_EXTERNAL_SIMPLE(obj))
                 runtime_fdmap_pop(runtime_get(), obj);
+            else if (IS_EXTERNAL_VIEW(obj))
+                de_view_release(obj);
             else if (IS_EXTERNAL_COMPOUND(obj)) {
                 runtime_fdmap_pop(runtime_get(), MAPLIST_KEY(obj));
                 runtime_fdmap_pop(runtime_get(), obj);
@@ -26,14 +26,18 @@
 #include "io.h"
 #include "string.h"
 #include "ipc.h"
+#include "serve.h"
+#include "pubsub.h"
 #include "dynlib.h"
 #include "heap.h"
+#include "spill.h"
+#include "mmap.h"
 
 // Global runtime reference
 runtime_p __RUNTIME = NULL;
 
 nil_t usage(nil_t) {
-    printf("%s%s%s", BOLD, YELLOW, "Usage: rayforce [-f file] [-p port] [-t timeit] [-c cores] [-r repl] [file]\n");
+    printf("%s%s%s", BOLD, YELLOW, "Usage: rayforce [-f file] [-p port|unix:path] [-t timeit] [-c cores] [-r repl] [-s spill MB] [-l query limit MB] [-g hugepages 0|1|2] [-z compress KB] [-w readers N] [file]\n");
     exit(EXIT_FAILURE);
 }
 
@@ -72,6 +76,36 @@ obj_p parse_cmdline(i32_t argc, str_p argv[]) {
                 push_sym(&keys, "timeit");
                 str = string_from_str(argv[opt], strlen(argv[opt]));
                 push_obj(&vals, str);
+            } else if (!user_defined && (strcmp(flag, "s") == 0 || strcmp(flag, "spill") == 0)) {
+                if (++opt >= argc)
+                    usage();
+                push_sym(&keys, "spill");
+                str = string_from_str(argv[opt], strlen(argv[opt]));
+                push_obj(&vals, str);
+            } else if (!user_defined && (strcmp(flag, "l") == 0 || strcmp(flag, "limit") == 0)) {
+                if (++opt >= argc)
+                    usage();
+                push_sym(&keys, "limit");
+                str = string_from_str(argv[opt], strlen(argv[opt]));
+                push_obj(&vals, str);
+            } else if (!user_defined && (strcmp(flag, "g") == 0 || strcmp(flag, "hugepages") == 0)) {
+                if (++opt >= argc)
+                    usage();
+                push_sym(&keys, "hugepages");
+                str = string_from_str(argv[opt], strlen(argv[opt]));
+                push_obj(&vals, str);
+            } else if (!user_defined && (strcmp(flag, "z") == 0 || strcmp(flag, "compress") == 0)) {
+                if (++opt >= argc)
+                    usage();
+                push_sym(&keys, "compress");
+                str = string_from_str(argv[opt], strlen(argv[opt]));
+                push_obj(&vals, str);
+            } else if (!user_defined && (strcmp(flag, "w") == 0 || strcmp(flag, "readers") == 0)) {
+                if (++opt >= argc)
+                    usage();
+                push_sym(&keys, "readers");
+                str = string_from_str(argv[opt], strlen(argv[opt]));
+                push_obj(&vals, str);
             } else if (!user_defined && (strcmp(flag, "r") == 0 || strcmp(flag, "repl") == 0)) {
                 if (++opt >= argc)
                     usage();
@@ -151,6 +185,7 @@ runtime_p runtime_create(i32_t argc, str_p argv[]) {
     __RUNTIME->symbols = symbols;
     __RUNTIME->env = env_create();
     __RUNTIME->fdmaps = dict(I64(0), LIST(0));
+    __RUNTIME->fdmaps_lock = mutex_create();
     __RUNTIME->args = NULL_OBJ;
     __RUNTIME->pool = pool;
     __RUNTIME->dynlibs = I64(0);
@@ -173,6 +208,38 @@ runtime_p runtime_create(i32_t argc, str_p argv[]) {
             timeit_activate(n);
         }
 
+        // memory budget (MB) for sort/group intermediates before they spill to disk
+        arg = runtime_get_arg("spill");
+        if (!is_null(arg)) {
+            i64_from_str(AS_C8(arg), arg->len, &n);
+            drop_obj(arg);
+            spill_set_budget(n << 20);
+        }
+
+        // memory budget (MB) of a single query, going over it fails the query with a limit error
+        arg = runtime_get_arg("limit");
+        if (!is_null(arg)) {
+            i64_from_str(AS_C8(arg), arg->len, &n);
+            drop_obj(arg);
+            heap_set_limit(n << 20);
+        }
+
+        // huge pages: 1 - heap pools, 2 - heap pools and mapped column files
+        arg = runtime_get_arg("hugepages");
+        if (!is_null(arg)) {
+            i64_from_str(AS_C8(arg), arg->len, &n);
+            drop_obj(arg);
+            mmap_set_huge(n);
+        }
+
+        // IPC payloads (KB) from which messages are compressed for peers that accept it
+        arg = runtime_get_arg("compress");
+        if (!is_null(arg)) {
+            i64_from_str(AS_C8(arg), arg->len, &n);
+            drop_obj(arg);
+            ipc_set_compress(n << 10);
+        }
+
         // load file
         arg = runtime_get_arg("file");
         if (!is_null(arg)) {
@@ -186,6 +253,15 @@ runtime_p runtime_create(i32_t argc, str_p argv[]) {
             drop_obj(res);
         }
 
+        // threads evaluating sync IPC requests off the main thread, started once the file is loaded
+        arg = runtime_get_arg("readers");
+        if (!is_null(arg)) {
+            i64_from_str(AS_C8(arg), arg->len, &n);
+            drop_obj(arg);
+            if (n > 0 && serve_init(__RUNTIME->poll, n, ipc_on_served) == -1)
+                printf("Failed to start %lld readers\n", n);
+        }
+
     } else {
         // Library/embedded mode (argc == 0)
         // Still create poll for async operations (connections, I/O plugins, etc.)
@@ -207,17 +283,27 @@ runtime_p runtime_create(i32_t argc, str_p argv[]) {
 i32_t runtime_run(nil_t) {
     i64_t port;
     obj_p arg;
+    sock_addr_t addr;
 
     if (!__RUNTIME->poll)
         return 0;
 
     arg = runtime_get_arg("port");
     if (!is_null(arg)) {
-        i64_from_str(AS_C8(arg), arg->len, &port);
-        drop_obj(arg);
-        if (ipc_listen(__RUNTIME->poll, port) == -1) {
-            printf("Failed to listen on port %lld\n", port);
-            return 1;
+        // -p unix:/path listens on a unix domain socket instead of a port
+        if (sock_addr_from_str(AS_C8(arg), arg->len, &addr) == 0 && addr.local) {
+            drop_obj(arg);
+            if (ipc_listen_local(__RUNTIME->poll, addr.ip) == -1) {
+                printf("Failed to listen on unix:%s\n", addr.ip);
+                return 1;
+            }
+        } else {
+            i64_from_str(AS_C8(arg), arg->len, &port);
+            drop_obj(arg);
+            if (ipc_listen(__RUNTIME->poll, port) == -1) {
+                printf("Failed to listen on port %lld\n", port);
+                return 1;
+            }
         }
     }
 
@@ -229,12 +315,15 @@ nil_t runtime_destroy(nil_t) {
     dynlib_p dl;
 
     drop_obj(__RUNTIME->args);
+    serve_destroy();
+    pubsub_destroy();
     if (__RUNTIME->poll)
         poll_destroy(__RUNTIME->poll);
     symbols_destroy(__RUNTIME->symbols);
     heap_unmap(__RUNTIME->symbols, sizeof(struct symbols_t));
     env_destroy(&__RUNTIME->env);
     drop_obj(__RUNTIME->fdmaps);
+    mutex_destroy(&__RUNTIME->fdmaps_lock);
     // destroy dynamic libraries
     l = __RUNTIME->dynlibs->len;
     for (i = 0; i < l; i++) {
@@ -265,7 +354,9 @@ nil_t runtime_fdmap_push(runtime_p runtime, obj_p assoc, obj_p fdmap) {
     obj_p id, r;
 
     id = i64((i64_t)assoc);
+    mutex_lock(&runtime->fdmaps_lock);
     r = set_obj(&runtime->fdmaps, id, fdmap);
+    mutex_unlock(&runtime->fdmaps_lock);
     drop_obj(id);
 
     if (IS_ERR(r)) {
@@ -278,7 +369,9 @@ obj_p runtime_fdmap_pop(runtime_p runtime, obj_p assoc) {
     obj_p id, fdmap;
 
     id = i64((i64_t)assoc);
+    mutex_lock(&runtime->fdmaps_lock);
     fdmap = remove_obj(&runtime->fdmaps, id);
+    mutex_unlock(&runtime->fdmaps_lock);
     drop_obj(id);
 
     return fdmap;
@@ -288,7 +381,9 @@ obj_p runtime_fdmap_get(runtime_p runtime, obj_p assoc) {
     obj_p id, fdmap;
 
     id = i64((i64_t)assoc);
+    mutex_lock(&runtime->fdmaps_lock);
     fdmap = at_obj(runtime->fdmaps, id);
+    mutex_unlock(&runtime->fdmaps_lock);
     drop_obj(id);
 
     return fdmap;
@@ -45,6 +45,7 @@ typedef struct runtime_t {
     symbols_p symbols;      // vector_symbols pool.
     poll_p poll;            // I/O event loop handle.
     obj_p fdmaps;           // File descriptors mappings.
+    mutex_t fdmaps_lock;    // Guards fdmaps, readers map and drop columns too.
     pool_p pool;            // Executors pool.
     obj_p dynlibs;          // Dynamic libraries.
 } *runtime_p;
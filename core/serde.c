@@ -27,6 +27,9 @@
 #include "lambda.h"
 #include "env.h"
 #include "error.h"
+#include "eval.h"
+#include "heap.h"
+#include "compress.h"
 
 i64_t size_of_type(i8_t type) {
     switch (type) {
@@ -163,9 +166,84 @@ i64_t size_obj(obj_p obj) {
     }
 }
 
-i64_t ser_raw(u8_t *buf, obj_p obj) {
+/*
+ * Collects the vectors whose payloads ser_raw_split leaves out of the buffer,
+ * in the order it meets them. Returns the number of bytes left out.
+ */
+i64_t ser_refs(obj_p obj, ser_refs_p refs) {
+    i64_t i, l, size;
+
+    switch (obj->type) {
+        case TYPE_B8:
+        case TYPE_U8:
+        case TYPE_I16:
+        case TYPE_I32:
+        case TYPE_DATE:
+        case TYPE_TIME:
+        case TYPE_I64:
+        case TYPE_TIMESTAMP:
+        case TYPE_F64:
+        case TYPE_GUID:
+            size = obj->len * size_of_type(obj->type);
+            if (size < SER_REF_MIN)
+                return 0;
+            if (refs->aligned)
+                refs->pad += 29;  // pad count and up to 28 bytes of padding
+            if (refs->n == SER_REFS_MAX)
+                return 0;
+            refs->objs[refs->n++] = obj;
+            return size;
+        case TYPE_LIST:
+            l = obj->len;
+            for (i = 0, size = 0; i < l; i++)
+                size += ser_refs(AS_LIST(obj)[i], refs);
+            return size;
+        case TYPE_TABLE:
+        case TYPE_DICT:
+            return ser_refs(AS_LIST(obj)[0], refs) + ser_refs(AS_LIST(obj)[1], refs);
+        default:
+            return 0;
+    }
+}
+
+// Skips the payload of a collected vector, noting where it belongs in the stream
+static b8_t ser_ref_take(ser_refs_p refs, obj_p obj, u8_t *buf) {
+    if (refs == NULL || refs->k == refs->n || refs->objs[refs->k] != obj)
+        return B8_FALSE;
+
+    refs->offs[refs->k++] = buf - refs->base;
+    refs->skip += obj->len * size_of_type(obj->type);
+
+    return B8_TRUE;
+}
+
+/*
+ * Pads a large payload to start at a 16-byte boundary of the stream, at least 24 bytes
+ * past its type byte: the receiver turns those into an object header and a pointer to
+ * its buffer and uses the payload in place. buf points right after the length.
+ */
+static u8_t *ser_align(ser_refs_p refs, obj_p obj, u8_t *buf) {
+    i64_t at, pad;
+
+    if (refs == NULL || !refs->aligned || obj->len * size_of_type(obj->type) < SER_REF_MIN)
+        return buf;
+
+    at = buf - ISIZEOF(i64_t) - 2 - refs->base + refs->skip;
+    pad = ALIGNUP(at + 24, 16) - at - ISIZEOF(i64_t) - 3;
+
+    buf[-ISIZEOF(i64_t) - 1] |= SERDE_ATTR_ALIGNED;
+    buf[0] = (u8_t)pad;
+    memset(buf + 1, 0, pad);
+
+    return buf + pad + 1;
+}
+
+i64_t ser_raw(u8_t *buf, obj_p obj) { return ser_raw_split(buf, obj, NULL); }
+
+i64_t ser_raw_split(u8_t *buf, obj_p obj, ser_refs_p refs) {
     i64_t i, l, c;
     str_p s;
+    u8_t *start = buf;
 
     buf[0] = obj->type;
     buf++;
@@ -210,10 +288,13 @@ i64_t ser_raw(u8_t *buf, obj_p obj) {
             l = obj->len;
             memcpy(buf, &l, ISIZEOF(i64_t));
             buf += ISIZEOF(i64_t);
+            buf = ser_align(refs, obj, buf);
+            if (ser_ref_take(refs, obj, buf))
+                return buf - start;
             for (i = 0; i < l; i++)
                 buf[i] = AS_U8(obj)[i];
 
-            return ISIZEOF(i8_t) + ISIZEOF(i64_t) + l * ISIZEOF(u8_t) + 1;
+            return buf - start + l * ISIZEOF(u8_t);
         case TYPE_C8:
             buf[0] = 0;  // attrs
             buf++;
@@ -229,6 +310,8 @@ i64_t ser_raw(u8_t *buf, obj_p obj) {
             l = obj->len;
             memcpy(buf, &l, ISIZEOF(i64_t));
             buf += ISIZEOF(i64_t);
+            if (ser_ref_take(refs, obj, buf))
+                return ISIZEOF(i8_t) + ISIZEOF(i64_t) + 1;
             for (i = 0; i < l; i++)
                 memcpy(buf + i * ISIZEOF(i16_t), &AS_I16(obj)[i], ISIZEOF(i16_t));
 
@@ -241,10 +324,13 @@ i64_t ser_raw(u8_t *buf, obj_p obj) {
             l = obj->len;
             memcpy(buf, &l, ISIZEOF(i64_t));
             buf += ISIZEOF(i64_t);
+            buf = ser_align(refs, obj, buf);
+            if (ser_ref_take(refs, obj, buf))
+                return buf - start;
             for (i = 0; i < l; i++)
                 memcpy(buf + i * ISIZEOF(i32_t), &AS_I32(obj)[i], ISIZEOF(i32_t));
 
-            return ISIZEOF(i8_t) + ISIZEOF(i64_t) + l * ISIZEOF(i32_t) + 1;
+            return buf - start + l * ISIZEOF(i32_t);
         case TYPE_I64:
         case TYPE_TIMESTAMP:
             buf[0] = 0;  // attrs
@@ -252,20 +338,34 @@ i64_t ser_raw(u8_t *buf, obj_p obj) {
             l = obj->len;
             memcpy(buf, &l, ISIZEOF(i64_t));
             buf += ISIZEOF(i64_t);
-            for (i = 0; i < l; i++)
-                memcpy(buf + i * ISIZEOF(i64_t), &AS_I64(obj)[i], ISIZEOF(i64_t));
-
-            return ISIZEOF(i8_t) + ISIZEOF(i64_t) + l * ISIZEOF(i64_t) + 1;
+            buf = ser_align(refs, obj, buf);
+            if (ser_ref_take(refs, obj, buf))
+                return buf - start;
+            if (refs != NULL && refs->filter) {
+                buf[-ISIZEOF(i64_t) - 1] |= SERDE_ATTR_DELTA;
+                compress_delta(AS_I64(obj), buf, l);
+            } else
+                for (i = 0; i < l; i++)
+                    memcpy(buf + i * ISIZEOF(i64_t), &AS_I64(obj)[i], ISIZEOF(i64_t));
+
+            return buf - start + l * ISIZEOF(i64_t);
         case TYPE_F64:
             buf[0] = 0;  // attrs
             buf++;
             l = obj->len;
             memcpy(buf, &l, ISIZEOF(i64_t));
             buf += ISIZEOF(i64_t);
-            for (i = 0; i < l; i++)
-                memcpy(buf + i * ISIZEOF(f64_t), &AS_F64(obj)[i], ISIZEOF(f64_t));
-
-            return ISIZEOF(i8_t) + ISIZEOF(i64_t) + l * ISIZEOF(f64_t) + 1;
+            buf = ser_align(refs, obj, buf);
+            if (ser_ref_take(refs, obj, buf))
+                return buf - start;
+            if (refs != NULL && refs->filter) {
+                buf[-ISIZEOF(i64_t) - 1] |= SERDE_ATTR_SHUFFLE;
+                compress_shuffle(AS_U8(obj), buf, l);
+            } else
+                for (i = 0; i < l; i++)
+                    memcpy(buf + i * ISIZEOF(f64_t), &AS_F64(obj)[i], ISIZEOF(f64_t));
+
+            return buf - start + l * ISIZEOF(f64_t);
         case TYPE_SYMBOL:
             buf[0] = 0;  // attrs
             buf++;
@@ -286,8 +386,11 @@ i64_t ser_raw(u8_t *buf, obj_p obj) {
             l = obj->len;
             memcpy(buf, &l, ISIZEOF(i64_t));
             buf += ISIZEOF(i64_t);
+            buf = ser_align(refs, obj, buf);
+            if (ser_ref_take(refs, obj, buf))
+                return buf - start;
             memcpy(buf, AS_C8(obj), l * ISIZEOF(guid_t));
-            return ISIZEOF(i8_t) + ISIZEOF(i64_t) + l * ISIZEOF(guid_t) + 1;
+            return buf - start + l * ISIZEOF(guid_t);
         case TYPE_LIST:
             buf[0] = 0;  // attrs
             buf++;
@@ -295,15 +398,15 @@ i64_t ser_raw(u8_t *buf, obj_p obj) {
             memcpy(buf, &l, ISIZEOF(i64_t));
             buf += ISIZEOF(i64_t);
             for (i = 0, c = 0; i < l; i++)
-                c += ser_raw(buf + c, AS_LIST(obj)[i]);
+                c += ser_raw_split(buf + c, AS_LIST(obj)[i], refs);
 
             return ISIZEOF(i8_t) + ISIZEOF(i64_t) + c + 1;
         case TYPE_TABLE:
         case TYPE_DICT:
             buf[0] = 0;  // attrs
             buf++;
-            c = ser_raw(buf, AS_LIST(obj)[0]);
-            c += ser_raw(buf + c, AS_LIST(obj)[1]);
+            c = ser_raw_split(buf, AS_LIST(obj)[0], refs);
+            c += ser_raw_split(buf + c, AS_LIST(obj)[1], refs);
             return ISIZEOF(i8_t) + c + 1;
         case TYPE_LAMBDA:
             buf[0] = 0;  // attrs
@@ -362,10 +465,53 @@ obj_p ser_obj(obj_p obj) {
     return buf;
 }
 
-obj_p de_raw(u8_t *buf, i64_t *len) {
+obj_p de_raw(u8_t *buf, i64_t *len) { return de_raw_view(buf, len, NULL); }
+
+// Drops the view's hold on the buffer it was decoded from, the last one frees it
+nil_t de_view_release(obj_p obj) {
+    i64_t *owner, rc;
+
+    owner = *(i64_t **)((u8_t *)obj - ISIZEOF(i64_t *));
+
+    if (LIKELY(!VM->rc_sync))
+        rc = --(*owner);
+    else
+        rc = __atomic_sub_fetch(owner, 1, __ATOMIC_RELAXED);
+
+    if (rc == 0)
+        heap_free(owner);
+}
+
+/*
+ * Turns an aligned payload into a vector that lives in the buffer: the object header
+ * goes over the 16 bytes in front of the payload, preceded by a pointer to the owner,
+ * a heap block counting its views in the first 8 bytes.
+ */
+static obj_p de_view(u8_t *buf, i8_t type, i64_t len, i64_t *owner) {
+    obj_p obj;
+
+    obj = (obj_p)(buf - ISIZEOF(struct obj_t));
+    *(i64_t **)((u8_t *)obj - ISIZEOF(i64_t *)) = owner;
+    obj->mmod = MMOD_EXTERNAL_VIEW;
+    obj->order = 0;
+    obj->type = type;
+    obj->attrs = 0;
+    obj->rc = 1;
+    obj->len = len;
+    (*owner)++;
+
+    return obj;
+}
+
+/*
+ * Same as de_raw, except that aligned fixed-width payloads become views of the buffer
+ * when owner is given, instead of being copied out.
+ */
+obj_p de_raw_view(u8_t *buf, i64_t *len, i64_t *owner) {
     i64_t i, l, c, id;
     obj_p obj, k, v;
     i8_t type;
+    u8_t attrs;
 
     if (*len == 0)
         return NULL_OBJ;
@@ -468,7 +614,8 @@ obj_p de_raw(u8_t *buf, i64_t *len) {
             if (*len < ISIZEOF(i64_t))
                 return err_domain();
 
-            buf++;  // skip attrs
+            attrs = buf[0];
+            buf++;
             memcpy(&l, buf, ISIZEOF(i64_t));
             buf += ISIZEOF(i64_t);
             (*len) -= ISIZEOF(i64_t) + 1;
@@ -477,6 +624,20 @@ obj_p de_raw(u8_t *buf, i64_t *len) {
             if (l > 1000000000)  // 1 billion elements is likely a corrupted value
                 return err_domain();
 
+            if ((attrs & SERDE_ATTR_ALIGNED) && type != TYPE_C8 && type != TYPE_SYMBOL && type != TYPE_LIST) {
+                if (*len < 1 || *len < buf[0] + 1)
+                    return err_domain();
+                c = buf[0] + 1;
+                buf += c;
+                (*len) -= c;
+
+                c = l * size_of_type(type);
+                if (owner != NULL && ((i64_t)buf & 15) == 0 && *len >= c) {
+                    (*len) -= c;
+                    return de_view(buf, type, l, owner);
+                }
+            }
+
             // Continue with type-specific handling
             switch (type) {
                 case TYPE_B8:
@@ -521,7 +682,10 @@ obj_p de_raw(u8_t *buf, i64_t *len) {
                     obj = I64(l);
                     if (IS_ERR(obj))
                         return obj;
-                    memcpy(AS_I64(obj), buf, l * ISIZEOF(i64_t));
+                    if (attrs & SERDE_ATTR_DELTA)
+                        decompress_delta(buf, AS_I64(obj), l);
+                    else
+                        memcpy(AS_I64(obj), buf, l * ISIZEOF(i64_t));
                     buf += l * ISIZEOF(i64_t);
                     (*len) -= l * ISIZEOF(i64_t);
                     obj->type = type;
@@ -532,7 +696,10 @@ obj_p de_raw(u8_t *buf, i64_t *len) {
                     obj = F64(l);
                     if (IS_ERR(obj))
                         return obj;
-                    memcpy(AS_F64(obj), buf, l * ISIZEOF(f64_t));
+                    if (attrs & SERDE_ATTR_SHUFFLE)
+                        decompress_shuffle(buf, AS_U8(obj), l);
+                    else
+                        memcpy(AS_F64(obj), buf, l * ISIZEOF(f64_t));
                     buf += l * ISIZEOF(f64_t);
                     (*len) -= l * ISIZEOF(f64_t);
                     return obj;
@@ -574,7 +741,7 @@ obj_p de_raw(u8_t *buf, i64_t *len) {
                         return obj;
                     c = *len;
                     for (i = 0; i < l; i++) {
-                        v = de_raw(buf + c - *len, len);
+                        v = de_raw_view(buf + c - *len, len, owner);
                         if (IS_ERR(v)) {
                             obj->len = i;
                             drop_obj(obj);
@@ -593,12 +760,12 @@ obj_p de_raw(u8_t *buf, i64_t *len) {
             buf++;  // skip attrs
             (*len) -= 1;
             c = *len;
-            k = de_raw(buf, len);
+            k = de_raw_view(buf, len, owner);
 
             if (IS_ERR(k))
                 return k;
 
-            v = de_raw(buf + c - *len, len);
+            v = de_raw_view(buf + c - *len, len, owner);
 
             if (IS_ERR(v)) {
                 drop_obj(k);
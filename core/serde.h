@@ -28,6 +28,14 @@
 #include "util.h"
 
 #define SERDE_PREFIX 0xcefadefa
+#define SERDE_FLAG_ALIGNED 0x01     // header flag: the sender reads aligned payloads, so they may be sent to it
+#define SERDE_FLAG_COMPRESS 0x02    // header flag: the sender reads compressed payloads
+#define SERDE_FLAG_COMPRESSED 0x04  // header flag: the payload is a compressed frame of the serialized object
+#define SERDE_FLAG_CORRELATED 0x08  // header flag: a correlation block precedes the payload
+#define SERDE_CORR_SIZE 16          // correlation block: request id and a reserved word, keeps payloads 16-byte aligned
+#define SERDE_ATTR_ALIGNED 0x80     // vector attrs: a pad count and padding precede the 16-byte aligned payload
+#define SERDE_ATTR_DELTA 0x40       // vector attrs: i64 payload holds the differences of consecutive values
+#define SERDE_ATTR_SHUFFLE 0x20     // vector attrs: f64 payload is split into 8 planes, one per byte position
 
 typedef struct ipc_header_t {
     u32_t prefix;  // marker
@@ -40,8 +48,28 @@ typedef struct ipc_header_t {
 
 RAY_ASSERT(sizeof(ipc_header_t) == 16, "ipc_header_t must be 16 bytes");
 
+#define SER_REF_MIN 65536  // vector payloads from this size on may be sent in place
+#define SER_REFS_MAX 62    // payloads left out of one message, keeps it within a single sendmsg
+
+// Vectors whose payloads are not copied by ser_raw_split, and where they go in the stream
+typedef struct ser_refs_t {
+    i64_t n;
+    i64_t k;
+    u8_t *base;
+    b8_t aligned;  // pad large payloads so the receiver can use them in place
+    b8_t filter;   // delta code i64 and shuffle f64 payloads, ahead of compression
+    i64_t pad;     // upper bound of the padding added
+    i64_t skip;    // payload bytes left out so far
+    obj_p objs[SER_REFS_MAX];
+    i64_t offs[SER_REFS_MAX];
+} *ser_refs_p;
+
 obj_p de_raw(u8_t *buf, i64_t *len);
+obj_p de_raw_view(u8_t *buf, i64_t *len, i64_t *owner);
+nil_t de_view_release(obj_p obj);
 i64_t ser_raw(u8_t *buf, obj_p obj);
+i64_t ser_raw_split(u8_t *buf, obj_p obj, ser_refs_p refs);
+i64_t ser_refs(obj_p obj, ser_refs_p refs);
 i64_t size_of_type(i8_t type);
 i64_t size_of(obj_p obj);
 i64_t size_obj(obj_p obj);
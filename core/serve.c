@@ -0,0 +1,405 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+#include "serve.h"
+#include "eval.h"
+#include "thread.h"
+#include "runtime.h"
+#include "error.h"
+#include "mmap.h"
+#include "log.h"
+
+/*
+ * Readers: threads with VMs and heaps of their own that evaluate sync requests off the
+ * main thread, which keeps doing the I/O and runs everything else, writes included.
+ * A request is evaluated against a snapshot of the globals taken when it is handed
+ * over; values are shared, so a write on the main thread copies rather than changes
+ * what a reader sees. A request that changes globals itself, or needs the connections,
+ * stops at the first such call and is run again on the main thread from the start, so
+ * writes and I/O only ever happen there, and once.
+ */
+
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+
+i64_t serve_init(poll_p poll, i64_t readers, serve_done_fn done_fn) {
+    UNUSED(poll);
+    UNUSED(readers);
+    UNUSED(done_fn);
+    return -1;
+}
+
+nil_t serve_destroy(nil_t) {}
+
+b8_t serve_enabled(nil_t) { return B8_FALSE; }
+
+heap_p serve_heap(i64_t id) {
+    UNUSED(id);
+    return NULL;
+}
+
+serve_job_p serve_submit(obj_p msg, obj_p name, i64_t id, i64_t corr) {
+    UNUSED(msg);
+    UNUSED(name);
+    UNUSED(id);
+    UNUSED(corr);
+    return NULL;
+}
+
+nil_t serve_job_destroy(serve_job_p job) { UNUSED(job); }
+
+b8_t serve_rerun(nil_t) { return B8_FALSE; }
+
+b8_t serve_aborted(nil_t) { return B8_FALSE; }
+
+#else
+
+#include <unistd.h>
+#include <fcntl.h>
+
+typedef struct reader_t {
+    i64_t id;
+    ray_thread_t handle;
+    vm_p vm;
+    heap_p heap;  // published by the reader once it is up
+} reader_t;
+
+typedef struct serve_t {
+    mutex_t mutex;
+    cond_t cond;
+    b8_t stop;
+    serve_job_p head;  // waiting for a reader
+    serve_job_p tail;
+    serve_job_p done;  // finished, newest first, for the main thread to pick up
+    i32_t wake[2];     // pipe, a byte is written to it whenever a job is done
+    i64_t selector;    // read end of the pipe in the poll
+    poll_p poll;
+    serve_done_fn done_fn;
+    i64_t busy;  // jobs handed over and not picked up yet, the main thread shares values with the readers meanwhile
+    i64_t count;
+    reader_t readers[];
+} *serve_p;
+
+static serve_p __SERVE = NULL;
+static __thread serve_job_p __SERVE_JOB = NULL;  // request the reader is busy with
+
+b8_t serve_enabled(nil_t) { return __SERVE != NULL; }
+
+heap_p serve_heap(i64_t id) {
+    serve_p serve = __SERVE;
+
+    if (serve == NULL || id < SERVE_HEAP_ID || id >= SERVE_HEAP_ID + serve->count)
+        return NULL;
+
+    return __atomic_load_n(&serve->readers[id - SERVE_HEAP_ID].heap, __ATOMIC_ACQUIRE);
+}
+
+nil_t serve_job_destroy(serve_job_p job) {
+    drop_obj(job->msg);
+    drop_obj(job->name);
+    drop_obj(job->env);
+    drop_obj(job->vals);
+    drop_obj(job->res);
+    heap_free(job);
+}
+
+// Takes the request over, the snapshot is taken right away
+serve_job_p serve_submit(obj_p msg, obj_p name, i64_t id, i64_t corr) {
+    serve_p serve = __SERVE;
+    serve_job_p job;
+    obj_p vars, s, v;
+
+    vars = runtime_get()->env.variables;
+
+    // The snapshot shares its values with a reader from now on
+    if (serve->busy++ == 0)
+        rc_sync_set(1);
+
+    job = (serve_job_p)heap_alloc(sizeof(struct serve_job_t));
+    job->next = NULL;
+    job->id = id;
+    job->corr = corr;
+    job->msg = msg;
+    job->name = clone_obj(name);
+    job->env = copy_obj(vars);
+    job->res = NULL_OBJ;
+    job->rerun = B8_FALSE;
+
+    // The handle of the connection, as the main thread would have set it
+    s = symbol(".z.w", 4);
+    v = set_obj(&job->env, s, i64(id));
+    drop_obj(s);
+    if (IS_ERR(v))
+        drop_obj(v);
+
+    job->vals = copy_obj(AS_LIST(job->env)[1]);
+
+    mutex_lock(&serve->mutex);
+    if (serve->tail == NULL)
+        serve->head = job;
+    else
+        serve->tail->next = job;
+    serve->tail = job;
+    cond_signal(&serve->cond);
+    mutex_unlock(&serve->mutex);
+
+    return job;
+}
+
+b8_t serve_rerun(nil_t) {
+    if (__SERVE_JOB == NULL)
+        return B8_FALSE;
+
+    __SERVE_JOB->rerun = B8_TRUE;
+    return B8_TRUE;
+}
+
+b8_t serve_aborted(nil_t) { return __SERVE_JOB != NULL && __SERVE_JOB->rerun; }
+
+// Any global added or set anew shows up as a value that is not the one taken
+static b8_t serve_wrote(serve_job_p job) {
+    i64_t i, l;
+    obj_p vals;
+
+    vals = AS_LIST(job->env)[1];
+    l = job->vals->len;
+
+    if (vals->type != TYPE_LIST || vals->len != l)
+        return B8_TRUE;
+
+    for (i = 0; i < l; i++)
+        if (AS_LIST(vals)[i] != AS_LIST(job->vals)[i])
+            return B8_TRUE;
+
+    return B8_FALSE;
+}
+
+static nil_t serve_eval(serve_job_p job) {
+    obj_p res;
+    vm_p vm = VM;
+
+    vm->env = job->env;
+    vm->locals = vn_list(2, LIST(0), LIST(0));
+    __SERVE_JOB = job;
+
+    if (job->msg->type == TYPE_C8)
+        res = ray_eval_str(job->msg, job->name);
+    else
+        res = eval_obj(job->msg);
+
+    __SERVE_JOB = NULL;
+    vm->env = NULL_OBJ;
+    drop_obj(vm->locals);
+    vm->locals = NULL_OBJ;
+
+    job->rerun = job->rerun || serve_wrote(job);
+    if (job->rerun) {
+        drop_obj(res);
+        res = NULL_OBJ;
+    }
+
+    // Let go of the snapshot here, so that the main thread does not hold on to its values any longer
+    drop_obj(job->env);
+    drop_obj(job->vals);
+    job->env = NULL_OBJ;
+    job->vals = NULL_OBJ;
+    job->res = res;
+}
+
+static raw_p serve_reader_run(raw_p arg) {
+    reader_t *reader = (reader_t *)arg;
+    serve_p serve = __SERVE;
+    serve_job_p job, head;
+    vm_p vm;
+    u8_t b = 0;
+
+    vm = vm_create(SERVE_HEAP_ID + reader->id, NULL);
+    vm->rc_sync = 1;
+    reader->vm = vm;
+    __atomic_store_n(&reader->heap, vm->heap, __ATOMIC_RELEASE);
+
+    for (;;) {
+        mutex_lock(&serve->mutex);
+        while (!serve->stop && serve->head == NULL)
+            cond_wait(&serve->cond, &serve->mutex);
+
+        job = serve->head;
+        if (job == NULL) {
+            mutex_unlock(&serve->mutex);
+            break;
+        }
+
+        serve->head = job->next;
+        if (serve->head == NULL)
+            serve->tail = NULL;
+        mutex_unlock(&serve->mutex);
+
+        serve_eval(job);
+
+        head = __atomic_load_n(&serve->done, __ATOMIC_RELAXED);
+        do {
+            job->next = head;
+        } while (!__atomic_compare_exchange_n(&serve->done, &head, job, B8_TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+        // A full pipe is as good, the main thread has yet to drain it
+        if (write(serve->wake[1], &b, 1) == -1)
+            LOG_TRACE("Reader %lld: wake pipe is full", reader->id);
+    }
+
+    // The heap stays, the main thread takes it over in serve_destroy
+    return NULL;
+}
+
+// Hands the finished jobs over in the order they were done
+static option_t serve_on_wake(poll_p poll, selector_p selector) {
+    u8_t buf[64];
+    serve_job_p job, next, jobs;
+
+    while (read(selector->fd, buf, sizeof(buf)) > 0)
+        ;
+
+    job = __atomic_exchange_n(&__SERVE->done, NULL, __ATOMIC_ACQUIRE);
+    for (jobs = NULL; job != NULL; job = next) {
+        next = job->next;
+        job->next = jobs;
+        jobs = job;
+    }
+
+    // Once no reader holds any, the main thread goes back to plain RC, and to its executors
+    for (job = jobs; job != NULL; job = next) {
+        next = job->next;
+        if (--__SERVE->busy == 0)
+            rc_sync_set(0);
+        __SERVE->done_fn(poll, job);
+    }
+
+    return option_none();
+}
+
+i64_t serve_init(poll_p poll, i64_t readers, serve_done_fn done_fn) {
+    i64_t i;
+    serve_p serve;
+    struct poll_registry_t registry = ZERO_INIT_STRUCT;
+    i32_t fds[2];
+
+    if (readers <= 0 || __SERVE != NULL)
+        return -1;
+
+    if (readers > SERVE_READERS_MAX)
+        readers = SERVE_READERS_MAX;
+
+    if (pipe(fds) == -1)
+        return -1;
+
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    serve = (serve_p)heap_mmap(sizeof(struct serve_t) + sizeof(reader_t) * readers);
+    serve->mutex = mutex_create();
+    serve->cond = cond_create();
+    serve->stop = B8_FALSE;
+    serve->head = NULL;
+    serve->tail = NULL;
+    serve->done = NULL;
+    serve->wake[0] = fds[0];
+    serve->wake[1] = fds[1];
+    serve->poll = poll;
+    serve->done_fn = done_fn;
+    serve->busy = 0;
+    serve->count = readers;
+
+    registry.fd = fds[0];
+    registry.type = SELECTOR_TYPE_FILE;
+    registry.events = POLL_EVENT_READ;
+    registry.read_fn = serve_on_wake;
+    serve->selector = poll_register(poll, &registry);
+
+    if (serve->selector == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        mutex_destroy(&serve->mutex);
+        cond_destroy(&serve->cond);
+        heap_unmap(serve, sizeof(struct serve_t) + sizeof(reader_t) * readers);
+        return -1;
+    }
+
+    __SERVE = serve;
+
+    for (i = 0; i < readers; i++) {
+        serve->readers[i].id = i;
+        serve->readers[i].vm = NULL;
+        serve->readers[i].heap = NULL;
+        serve->readers[i].handle = ray_thread_create(serve_reader_run, &serve->readers[i]);
+    }
+
+    LOG_INFO("Serving sync requests on %lld readers", readers);
+
+    return readers;
+}
+
+nil_t serve_destroy(nil_t) {
+    i64_t i;
+    serve_p serve = __SERVE;
+    serve_job_p job, next;
+    vm_p vm;
+
+    if (serve == NULL)
+        return;
+
+    mutex_lock(&serve->mutex);
+    serve->stop = B8_TRUE;
+    cond_broadcast(&serve->cond);
+    mutex_unlock(&serve->mutex);
+
+    for (i = 0; i < serve->count; i++)
+        if (thread_join(serve->readers[i].handle) != 0)
+            LOG_ERROR("Serve destroy: failed to join reader %lld", i);
+
+    // The readers drain the queue before they stop, so only finished jobs are left
+    for (job = serve->done; job != NULL; job = next) {
+        next = job->next;
+        serve_job_destroy(job);
+    }
+
+    // Whatever the readers still own moves to the main heap
+    __SERVE = NULL;
+    for (i = 0; i < serve->count; i++) {
+        vm = serve->readers[i].vm;
+        if (vm == NULL)
+            continue;
+
+        heap_merge(vm->heap);
+        heap_destroy(vm->heap);
+        mmap_free(vm, sizeof(struct vm_t));
+    }
+
+    rc_sync_set(0);
+
+    poll_deregister(serve->poll, serve->selector);
+    close(serve->wake[0]);
+    close(serve->wake[1]);
+    mutex_destroy(&serve->mutex);
+    cond_destroy(&serve->cond);
+    heap_unmap(serve, sizeof(struct serve_t) + sizeof(reader_t) * serve->count);
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "rayforce.h"
+#include "poll.h"
+#include "heap.h"
+
+#define SERVE_READERS_MAX 64
+#define SERVE_HEAP_ID 1024  // heap ids of the readers start here, past any executor's
+
+// A sync request handed over to a reader, and what came out of it
+typedef struct serve_job_t {
+    struct serve_job_t *next;
+    i64_t id;    // selector of the connection, -1 once it went away
+    i64_t corr;  // correlation id of the request on its connection, NULL_I64 for none
+    obj_p msg;   // the request
+    obj_p name;  // source name for errors
+    obj_p env;   // snapshot of the globals the request is evaluated against
+    obj_p vals;  // values of the globals as taken, to tell whether the request changed any
+    obj_p res;   // result
+    b8_t rerun;  // the request changed globals or needs the main thread, so it has to be run there instead
+} *serve_job_p;
+
+// Called on the main thread for every finished job, which it then owns
+typedef nil_t (*serve_done_fn)(poll_p poll, serve_job_p job);
+
+i64_t serve_init(poll_p poll, i64_t readers, serve_done_fn done_fn);
+nil_t serve_destroy(nil_t);
+b8_t serve_enabled(nil_t);
+heap_p serve_heap(i64_t id);
+serve_job_p serve_submit(obj_p msg, obj_p name, i64_t id, i64_t corr);
+nil_t serve_job_destroy(serve_job_p job);
+
+// Called by what a reader cannot do: flags its request to be run again on the main thread, FALSE off a reader
+b8_t serve_rerun(nil_t);
+
+// TRUE on a reader once its request has to be run again, nothing of it goes on from there
+b8_t serve_aborted(nil_t);
+
+#endif  // SERVE_H
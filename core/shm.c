@@ -0,0 +1,385 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+#include <errno.h>
+#include "shm.h"
+#include "heap.h"
+#include "mmap.h"
+#include "string.h"
+#include "ops.h"
+#include "os.h"
+#include "log.h"
+
+/*
+ * Shared memory transport for processes on one host. The client maps a memfd holding
+ * two single producer/single consumer rings, one per direction, and hands it over to
+ * the server along with an eventfd doorbell for each side. The rings carry the same
+ * byte stream a socket would, so IPC framing works unchanged on top of them.
+ *
+ * A producer only rings the doorbell when the consumer had read everything before, as
+ * otherwise the consumer is still busy and will find the new bytes on its own. The
+ * consumer resets its doorbell when it finds the ring empty, and looks once more, so
+ * nothing that comes afterwards goes unnoticed. A producer short of room sets `blocked`
+ * and is rung by the consumer once it has read some.
+ */
+
+#if defined(OS_LINUX)
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct shm_ring_t {
+    i64_t head;  // bytes written so far, moved by the producer only
+    c8_t pad0[56];
+    i64_t tail;  // bytes read so far, moved by the consumer only
+    c8_t pad1[56];
+    i64_t blocked;  // the producer ran out of room and waits to be rung
+    i64_t closed;   // either side has gone away
+    i64_t size;     // of data, a power of two
+    c8_t pad2[40];
+    u8_t data[];
+} shm_ring_t;
+
+#define SHM_RING_HDR ISIZEOF(shm_ring_t)
+
+// connections by our doorbell, as recv/send only get the fd
+static shm_p *__SHM_FDS = NULL;
+static i64_t __SHM_LEN = 0;
+static i64_t __SHM_COUNT = 0;
+
+shm_p shm_get(i64_t fd) { return (fd >= 0 && fd < __SHM_LEN) ? __SHM_FDS[fd] : NULL; }
+
+static nil_t shm_bind(shm_p shm) {
+    i64_t l;
+
+    if (shm->fd >= __SHM_LEN) {
+        l = (shm->fd + 1) * 2;
+        __SHM_FDS = (shm_p *)heap_realloc(__SHM_FDS, l * sizeof(shm_p));
+        memset(__SHM_FDS + __SHM_LEN, 0, (l - __SHM_LEN) * sizeof(shm_p));
+        __SHM_LEN = l;
+    }
+
+    __SHM_FDS[shm->fd] = shm;
+    __SHM_COUNT++;
+}
+
+static nil_t shm_unbind(shm_p shm) {
+    __SHM_FDS[shm->fd] = NULL;
+
+    if (--__SHM_COUNT == 0) {
+        heap_free(__SHM_FDS);
+        __SHM_FDS = NULL;
+        __SHM_LEN = 0;
+    }
+}
+
+static nil_t shm_bell(i64_t fd) {
+    u64_t one = 1;
+
+    if (write(fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+        LOG_ERROR("Failed to ring doorbell %lld: %s", fd, strerror(errno));
+}
+
+// Bytes of each ring, a power of two from IPC_SHM_MB or SHM_RING_MB
+static i64_t shm_ring_size(nil_t) {
+    c8_t buf[32];
+    i64_t mb = SHM_RING_MB, size;
+
+    if (os_get_var("IPC_SHM_MB", buf, sizeof(buf)) != -1)
+        i64_from_str(buf, strlen(buf), &mb);
+
+    if (mb < 1)
+        mb = SHM_RING_MB;
+
+    for (size = 1 << 16; size < (mb << 20); size <<= 1)
+        ;
+
+    return size;
+}
+
+shm_p shm_create(i64_t fds[3]) {
+    i64_t mem, srv, cli, ring, size;
+    raw_p map;
+    shm_p shm;
+
+    ring = shm_ring_size();
+    size = 2 * (SHM_RING_HDR + ring);
+
+    mem = memfd_create("rayforce-ipc", MFD_CLOEXEC);
+    if (mem == -1)
+        return NULL;
+
+    if (ftruncate(mem, size) == -1 || (map = mmap_file_shared(mem, NULL, size, 0)) == NULL) {
+        close(mem);
+        return NULL;
+    }
+
+    srv = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    cli = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (srv == -1 || cli == -1) {
+        if (srv != -1)
+            close(srv);
+        if (cli != -1)
+            close(cli);
+        mmap_free(map, size);
+        close(mem);
+        return NULL;
+    }
+
+    // a fresh memfd reads as zeroes, so both rings start empty
+    shm = (shm_p)heap_alloc(sizeof(struct shm_t));
+    shm->tx = (shm_ring_t *)map;
+    shm->rx = (shm_ring_t *)((u8_t *)map + SHM_RING_HDR + ring);
+    shm->tx->size = ring;
+    shm->rx->size = ring;
+    shm->map = map;
+    shm->size = size;
+    shm->ring = ring;
+    shm->fd = cli;
+    shm->peer = srv;
+    shm->link = -1;
+    shm->down = B8_FALSE;
+    shm_bind(shm);
+
+    fds[0] = mem;
+    fds[1] = srv;
+    fds[2] = cli;
+
+    return shm;
+}
+
+shm_p shm_attach(i64_t fds[3]) {
+    struct stat st;
+    raw_p map = NULL;
+    i64_t ring;
+    shm_p shm;
+
+    if (fstat(fds[0], &st) == 0 && st.st_size > 2 * SHM_RING_HDR)
+        map = mmap_file_shared(fds[0], NULL, st.st_size, 0);
+
+    close(fds[0]);
+
+    // the client lays out two rings of the same power of two size
+    ring = (map != NULL) ? ((shm_ring_t *)map)->size : 0;
+    if (ring <= 0 || (ring & (ring - 1)) != 0 || 2 * (SHM_RING_HDR + ring) != st.st_size) {
+        if (map != NULL)
+            mmap_free(map, st.st_size);
+        close(fds[1]);
+        close(fds[2]);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    shm = (shm_p)heap_alloc(sizeof(struct shm_t));
+    shm->rx = (shm_ring_t *)map;
+    shm->tx = (shm_ring_t *)((u8_t *)map + SHM_RING_HDR + ring);
+    shm->map = map;
+    shm->size = st.st_size;
+    shm->ring = ring;
+    shm->fd = fds[1];
+    shm->peer = fds[2];
+    shm->link = -1;
+    shm->down = B8_FALSE;
+    shm_bind(shm);
+
+    return shm;
+}
+
+nil_t shm_destroy(shm_p shm) {
+    __atomic_store_n(&shm->tx->closed, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&shm->rx->closed, 1, __ATOMIC_SEQ_CST);
+    shm_bell(shm->peer);
+
+    close(shm->peer);
+    mmap_free(shm->map, shm->size);
+    shm_unbind(shm);
+    heap_free(shm);
+}
+
+nil_t shm_shutdown(shm_p shm) {
+    shm->down = B8_TRUE;
+    __atomic_store_n(&shm->tx->closed, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&shm->rx->closed, 1, __ATOMIC_SEQ_CST);
+    shm_bell(shm->peer);
+    shm_bell(shm->fd);
+}
+
+nil_t shm_ring(shm_p shm) { shm_bell(shm->fd); }
+
+i64_t shm_recv(i64_t fd, u8_t *buf, i64_t size) {
+    shm_p shm = shm_get(fd);
+    shm_ring_t *ring;
+    i64_t head, tail, n, off, first;
+    u64_t count;
+    b8_t reset = B8_FALSE;
+
+    if (shm == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (shm->down) {
+        errno = EPIPE;
+        return -1;
+    }
+
+    ring = shm->rx;
+    tail = ring->tail;
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    // Empty: reset the doorbell and look again, whatever is written after that rings it anew
+    if (head == tail) {
+        if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+            return -1;
+
+        reset = B8_TRUE;
+        head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+
+        if (head == tail) {
+            if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+                errno = EPIPE;
+                return -1;
+            }
+
+            errno = EAGAIN;
+            return 0;
+        }
+    }
+
+    // The peer moves head, a ring holding less than nothing or more than it fits is a broken peer
+    if (head - tail < 0 || head - tail > shm->ring) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    n = MINI64(head - tail, size);
+    off = tail & (shm->ring - 1);
+    first = MINI64(n, shm->ring - off);
+    memcpy(buf, ring->data + off, first);
+    memcpy(buf + first, ring->data, n - first);
+    __atomic_store_n(&ring->tail, tail + n, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&ring->blocked, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&ring->blocked, 0, __ATOMIC_SEQ_CST))
+        shm_bell(shm->peer);
+
+    // Bytes are left behind a doorbell we reset, so ring it for whoever waits on it next
+    if (reset && __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != tail + n)
+        shm_bell(fd);
+
+    return n;
+}
+
+i64_t shm_send(i64_t fd, u8_t *buf, i64_t size) {
+    shm_p shm = shm_get(fd);
+    shm_ring_t *ring;
+    i64_t head, tail, room, n, off, first;
+
+    if (shm == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    ring = shm->tx;
+    if (shm->down || __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+        errno = EPIPE;
+        return -1;
+    }
+
+    head = ring->head;
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    room = shm->ring - (head - tail);
+
+    // Full: ask to be rung once the consumer makes room, and look again in case it just did
+    if (room == 0) {
+        __atomic_store_n(&ring->blocked, 1, __ATOMIC_SEQ_CST);
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+        room = shm->ring - (head - tail);
+
+        if (room == 0) {
+            errno = EAGAIN;
+            return 0;
+        }
+    }
+
+    // The peer moves tail, past what we wrote or behind what the ring fits is a broken peer
+    if (room < 0 || room > shm->ring) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    n = MINI64(room, size);
+    off = head & (shm->ring - 1);
+    first = MINI64(n, shm->ring - off);
+    memcpy(ring->data + off, buf, first);
+    memcpy(ring->data, buf + first, n - first);
+    __atomic_store_n(&ring->head, head + n, __ATOMIC_SEQ_CST);
+
+    // The consumer had read everything before, it may be asleep
+    if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == head)
+        shm_bell(shm->peer);
+
+    return n;
+}
+
+#else
+
+shm_p shm_get(i64_t fd) {
+    UNUSED(fd);
+    return NULL;
+}
+
+shm_p shm_create(i64_t fds[3]) {
+    UNUSED(fds);
+    errno = ENOTSUP;
+    return NULL;
+}
+
+shm_p shm_attach(i64_t fds[3]) {
+    UNUSED(fds);
+    errno = ENOTSUP;
+    return NULL;
+}
+
+nil_t shm_destroy(shm_p shm) { UNUSED(shm); }
+
+nil_t shm_shutdown(shm_p shm) { UNUSED(shm); }
+
+nil_t shm_ring(shm_p shm) { UNUSED(shm); }
+
+i64_t shm_recv(i64_t fd, u8_t *buf, i64_t size) {
+    UNUSED(fd);
+    UNUSED(buf);
+    UNUSED(size);
+    return -1;
+}
+
+i64_t shm_send(i64_t fd, u8_t *buf, i64_t size) {
+    UNUSED(fd);
+    UNUSED(buf);
+    UNUSED(size);
+    return -1;
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+#ifndef SHM_H
+#define SHM_H
+
+#include "rayforce.h"
+
+#define SHM_RING_MB 4  // bytes of each direction of a shared memory connection, IPC_SHM_MB overrides
+
+// A shared memory connection: a ring per direction in one mapping, and an eventfd doorbell per side
+typedef struct shm_t {
+    struct shm_ring_t *rx;  // the peer writes, we read
+    struct shm_ring_t *tx;  // we write, the peer reads
+    raw_p map;
+    i64_t size;  // of the mapping
+    i64_t ring;  // of the data of each ring, fixed at setup as the peer can write the ring headers
+    i64_t fd;    // our doorbell, rung by the peer
+    i64_t peer;  // the peer's doorbell
+    i64_t link;  // selector of the socket the peer came by, its hangup closes the connection
+    b8_t down;   // shut down on our side, nothing is read or written any more
+} *shm_p;
+
+// Client side: maps fresh rings, fds gets {memory, server doorbell, client doorbell} to hand over to the server
+shm_p shm_create(i64_t fds[3]);
+
+// Server side: maps the rings from the fds handed over by the client, taking them over
+shm_p shm_attach(i64_t fds[3]);
+
+// Marks the connection closed for the peer and unmaps it, our doorbell is left to whoever polls it
+nil_t shm_destroy(shm_p shm);
+
+// Shuts the connection down both ways, and rings both doorbells so either side finds it closed
+nil_t shm_shutdown(shm_p shm);
+
+// Rings our own doorbell, so whoever polls it looks at the rings again
+nil_t shm_ring(shm_p shm);
+
+// The connection rung through a doorbell of ours, NULL if none
+shm_p shm_get(i64_t fd);
+
+// Byte stream over the rings, both look the connection up by our doorbell
+i64_t shm_recv(i64_t fd, u8_t *buf, i64_t size);
+i64_t shm_send(i64_t fd, u8_t *buf, i64_t size);
+
+#endif  // SHM_H
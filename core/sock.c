@@ -31,7 +31,14 @@
 #else
 #include <fcntl.h>
 #include <netdb.h>
+#include <stddef.h>
 #include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #endif
@@ -40,14 +47,47 @@
 #include "log.h"
 #include "ops.h"
 
+#define SOCK_FDS_MAX 4  // file descriptors passed at once
+
 i64_t sock_addr_from_str(str_p str, i64_t len, sock_addr_t *addr) {
     i64_t r;
-    str_p tok;
+    str_p tok, start = str;
 
     // Check for NULL pointers
     if (str == NULL || addr == NULL)
         return -1;
 
+    addr->shm = B8_FALSE;
+
+    // unix:/path or unix:///path names a unix domain socket, shm: the same used to set up shared memory rings
+    if (len > 4 && memcmp(str, "shm:", 4) == 0) {
+        str += 4;
+        len -= 4;
+        addr->shm = B8_TRUE;
+    } else if (len > 5 && memcmp(str, "unix:", 5) == 0) {
+        str += 5;
+        len -= 5;
+    }
+
+    if (str != start) {
+        if (len > 2 && str[0] == '/' && str[1] == '/') {
+            str += 2;
+            len -= 2;
+        }
+
+        if (len >= ISIZEOF(addr->ip))
+            return -1;
+
+        memcpy(addr->ip, str, len);
+        addr->ip[len] = '\0';
+        addr->port = 0;
+        addr->local = B8_TRUE;
+
+        return 0;
+    }
+
+    addr->local = B8_FALSE;
+
     // Get host part
     tok = (str_p)memchr(str, ':', len);
     if (tok == NULL)
@@ -84,12 +124,17 @@ i64_t sock_open(sock_addr_t *addr, i64_t timeout) {
     SOCKET fd = INVALID_SOCKET;
     struct addrinfo hints, *result = NULL, *rp;
     i32_t code;
-    i32_t last_error = 0;
+    i32_t last_error = 0, nodelay = 1;
     struct timeval tm;
     char port_str[16];
 
     LOG_DEBUG("sock_open: addr=%s port=%lld timeout=%lld", addr->ip, addr->port, timeout);
 
+    if (addr->local) {
+        WSASetLastError(WSAEAFNOSUPPORT);
+        return -1;
+    }
+
     // Convert port to string for getaddrinfo
     _snprintf(port_str, sizeof(port_str), "%lld", addr->port);
 
@@ -141,6 +186,14 @@ i64_t sock_open(sock_addr_t *addr, i64_t timeout) {
             }
         }
 
+        // Messages are written whole, don't hold back the tail of one until the previous is acknowledged
+        if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&nodelay, sizeof(nodelay)) == SOCKET_ERROR) {
+            last_error = WSAGetLastError();
+            LOG_DEBUG("sock_open: TCP_NODELAY failed, error=%d", last_error);
+            closesocket(fd);
+            continue;
+        }
+
         // Try to connect
         LOG_DEBUG("sock_open: connecting...");
         if (connect(fd, rp->ai_addr, rp->ai_addrlen) != SOCKET_ERROR) {
@@ -170,6 +223,7 @@ i64_t sock_accept(i64_t fd) {
     struct linger linger_opt;
     socklen_t len = sizeof(addr);
     SOCKET acc_fd;
+    i32_t nodelay = 1;
     char ip_str[INET_ADDRSTRLEN];
 
     acc_fd = accept((SOCKET)fd, (struct sockaddr *)&addr, &len);
@@ -192,6 +246,12 @@ i64_t sock_accept(i64_t fd) {
         return -1;
     }
 
+    if (setsockopt(acc_fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&nodelay, sizeof(nodelay)) < 0) {
+        LOG_ERROR("Failed to set TCP_NODELAY on accepted socket: %d", WSAGetLastError());
+        closesocket(acc_fd);
+        return -1;
+    }
+
     inet_ntop(AF_INET, &addr.sin_addr, ip_str, INET_ADDRSTRLEN);
     LOG_DEBUG("Accepted new connection on fd %lld from %s:%d", acc_fd, ip_str, ntohs(addr.sin_port));
     return (i64_t)acc_fd;
@@ -236,6 +296,28 @@ i64_t sock_listen(i64_t port) {
     return (i64_t)fd;
 }
 
+i64_t sock_listen_local(lit_p path) {
+    UNUSED(path);
+    WSASetLastError(WSAEAFNOSUPPORT);
+    return -1;
+}
+
+i64_t sock_send_fds(i64_t fd, i64_t *fds, i64_t n) {
+    UNUSED(fd);
+    UNUSED(fds);
+    UNUSED(n);
+    WSASetLastError(WSAEAFNOSUPPORT);
+    return -1;
+}
+
+i64_t sock_recv_fds(i64_t fd, i64_t *fds, i64_t n) {
+    UNUSED(fd);
+    UNUSED(fds);
+    UNUSED(n);
+    WSASetLastError(WSAEAFNOSUPPORT);
+    return -1;
+}
+
 i64_t sock_close(i64_t fd) {
     LOG_DEBUG("Closing socket fd %lld", fd);
     return closesocket((SOCKET)fd);
@@ -297,6 +379,21 @@ send:
     }
 }
 
+// iov is an array of WSABUF, sends what fits into the socket buffer in one call
+i64_t sock_sendv(i64_t fd, raw_p iov, i64_t count) {
+    DWORD sz;
+
+    if (WSASend((SOCKET)fd, (LPWSABUF)iov, (DWORD)count, &sz, 0, NULL, NULL) == SOCKET_ERROR) {
+        if (WSAGetLastError() == WSAEWOULDBLOCK)
+            return 0;
+        LOG_ERROR("Failed to send data on fd %lld: %d", fd, WSAGetLastError());
+        return -1;
+    }
+
+    LOG_TRACE("Sent %lld bytes on fd %lld", (i64_t)sz, fd);
+    return (i64_t)sz;
+}
+
 #else
 
 i64_t sock_set_nonblocking(i64_t fd, b8_t flag) {
@@ -314,13 +411,65 @@ i64_t sock_set_nonblocking(i64_t fd, b8_t flag) {
     return 0;
 }
 
+// Fills a unix domain socket address, a leading '@' names an abstract socket on Linux
+static i64_t sock_local_addr(lit_p path, struct sockaddr_un *addr, socklen_t *len) {
+    i64_t n = strlen(path);
+
+    if (n == 0 || n >= ISIZEOF(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, path, n);
+    *len = sizeof(*addr);
+
+#if defined(OS_LINUX)
+    if (path[0] == '@') {
+        addr->sun_path[0] = '\0';
+        *len = offsetof(struct sockaddr_un, sun_path) + n;
+    }
+#endif
+
+    return 0;
+}
+
+static i64_t sock_open_local(sock_addr_t *addr, i64_t timeout) {
+    i64_t fd;
+    struct sockaddr_un un;
+    socklen_t len;
+    struct timeval tm;
+
+    if (sock_local_addr(addr->ip, &un, &len) == -1)
+        return -1;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+
+    tm.tv_sec = timeout;
+    tm.tv_usec = 0;
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tm, sizeof(tm)) < 0 || connect(fd, (struct sockaddr *)&un, len) == -1) {
+        LOG_ERROR("Could not connect to unix:%s: %s", addr->ip, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
 i64_t sock_open(sock_addr_t *addr, i64_t timeout) {
     i64_t fd = -1;
+    i32_t nodelay = 1;
     struct addrinfo hints, *result, *rp;
     struct linger linger_opt;
     struct timeval tm;
     char port_str[16];
 
+    if (addr->local)
+        return sock_open_local(addr, timeout);
+
     // Convert port to string for getaddrinfo
     snprintf(port_str, sizeof(port_str), "%lld", addr->port);
 
@@ -359,6 +508,12 @@ i64_t sock_open(sock_addr_t *addr, i64_t timeout) {
             continue;
         }
 
+        // Messages are written whole, don't hold back the tail of one until the previous is acknowledged
+        if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay))) {
+            close(fd);
+            continue;
+        }
+
         // Try to connect
         if (connect(fd, rp->ai_addr, rp->ai_addrlen) != -1)
             break;  // Success
@@ -378,10 +533,11 @@ i64_t sock_open(sock_addr_t *addr, i64_t timeout) {
 }
 
 i64_t sock_accept(i64_t fd) {
-    struct sockaddr_in addr;
+    struct sockaddr_storage addr;
     struct linger linger_opt;
     socklen_t len = sizeof(addr);
     i64_t acc_fd;
+    i32_t nodelay = 1;
 
     acc_fd = accept(fd, (struct sockaddr *)&addr, &len);
     if (acc_fd == -1) {
@@ -401,7 +557,18 @@ i64_t sock_accept(i64_t fd) {
         return -1;
     }
 
-    LOG_DEBUG("Accepted new connection on fd %lld from %s:%d", acc_fd, inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    if (addr.ss_family != AF_UNIX && setsockopt(acc_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) < 0) {
+        LOG_ERROR("Failed to set TCP_NODELAY on accepted socket: %s", strerror(errno));
+        close(acc_fd);
+        return -1;
+    }
+
+    if (addr.ss_family == AF_INET)
+        LOG_DEBUG("Accepted new connection on fd %lld from %s:%d", acc_fd,
+                  inet_ntoa(((struct sockaddr_in *)&addr)->sin_addr), ntohs(((struct sockaddr_in *)&addr)->sin_port));
+    else
+        LOG_DEBUG("Accepted new local connection on fd %lld", acc_fd);
+
     return acc_fd;
 }
 
@@ -440,6 +607,135 @@ i64_t sock_listen(i64_t port) {
     return fd;
 }
 
+i64_t sock_listen_local(lit_p path) {
+    struct sockaddr_un addr;
+    struct stat st;
+    socklen_t len;
+    i64_t fd, probe;
+
+    LOG_INFO("Starting socket listener on unix:%s", path);
+
+    if (sock_local_addr(path, &addr, &len) == -1)
+        return -1;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create socket: %s", strerror(errno));
+        return -1;
+    }
+
+    // A socket file nobody accepts on is left over from a server that died, take its place
+    if (path[0] != '@' && lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe != -1 && connect(probe, (struct sockaddr *)&addr, len) == -1 && errno == ECONNREFUSED)
+            unlink(path);
+        if (probe != -1)
+            close(probe);
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, len) == -1) {
+        LOG_ERROR("Failed to bind socket: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, SOMAXCONN) == -1) {
+        LOG_ERROR("Failed to listen on socket: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    LOG_DEBUG("Socket listener started successfully on fd %lld", fd);
+    return fd;
+}
+
+i64_t sock_send_fds(i64_t fd, i64_t *fds, i64_t n) {
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    u8_t byte = 0;
+    union {
+        struct cmsghdr hdr;
+        c8_t buf[CMSG_SPACE(sizeof(i32_t) * SOCK_FDS_MAX)];
+    } ctl;
+    i64_t i;
+
+    if (n > SOCK_FDS_MAX)
+        return -1;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&ctl, 0, sizeof(ctl));
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(i32_t) * n);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(i32_t) * n);
+    for (i = 0; i < n; i++)
+        ((i32_t *)CMSG_DATA(cmsg))[i] = (i32_t)fds[i];
+
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != 1) {
+        LOG_ERROR("Failed to pass fds on fd %lld: %s", fd, strerror(errno));
+        return -1;
+    }
+
+    return n;
+}
+
+// Takes exactly n fds if they came already, 0 if not yet
+i64_t sock_recv_fds(i64_t fd, i64_t *fds, i64_t n) {
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    u8_t byte;
+    union {
+        struct cmsghdr hdr;
+        c8_t buf[CMSG_SPACE(sizeof(i32_t) * SOCK_FDS_MAX)];
+    } ctl;
+    i64_t i, got, sz;
+
+    if (n > SOCK_FDS_MAX)
+        return -1;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+
+recv:
+    sz = recvmsg(fd, &msg, MSG_DONTWAIT);
+    if (sz == -1) {
+        if (errno == EINTR)
+            goto recv;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+
+    if (sz != 1)
+        return -1;
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        return -1;
+
+    // anything but the count asked for is closed right away
+    got = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(i32_t);
+    for (i = 0; i < got; i++) {
+        if (got == n)
+            fds[i] = ((i32_t *)CMSG_DATA(cmsg))[i];
+        else
+            close(((i32_t *)CMSG_DATA(cmsg))[i]);
+    }
+
+    return (got == n) ? n : -1;
+}
+
 i64_t sock_close(i64_t fd) {
     LOG_DEBUG("Closing socket fd %lld", fd);
     return close(fd);
@@ -506,4 +802,28 @@ send:
     }
 }
 
+// iov is an array of struct iovec, sends what fits into the socket buffer in one call
+i64_t sock_sendv(i64_t fd, raw_p iov, i64_t count) {
+    i64_t sz;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = count;
+
+send:
+    sz = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (sz == -1) {
+        if (errno == EINTR)
+            goto send;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        LOG_ERROR("Failed to send data on fd %lld: %s", fd, strerror(errno));
+        return -1;
+    }
+
+    LOG_TRACE("Sent %lld bytes on fd %lld", sz, fd);
+    return sz;
+}
+
 #endif
@@ -27,8 +27,10 @@
 #include "rayforce.h"
 
 typedef struct sock_addr_t {
-    c8_t ip[256];  // For IPv4 addresses or hostnames
+    c8_t ip[256];  // For IPv4 addresses or hostnames, the path of a unix socket
     i64_t port;
+    b8_t local;  // unix domain socket, a leading '@' in the path names an abstract one (Linux)
+    b8_t shm;    // shared memory rings, set up over the unix domain socket
 } sock_addr_t;
 
 i64_t sock_addr_from_str(str_p str, i64_t len, sock_addr_t *addr);
@@ -36,9 +38,15 @@ i64_t sock_set_nonblocking(i64_t fd, b8_t flag);
 i64_t sock_open(sock_addr_t *addr, i64_t timeout);
 i64_t sock_close(i64_t fd);
 i64_t sock_listen(i64_t port);
+i64_t sock_listen_local(lit_p path);
 i64_t sock_accept(i64_t fd);
 i64_t sock_recv(i64_t fd, u8_t *buf, i64_t size);
 i64_t sock_send(i64_t fd, u8_t *buf, i64_t size);
+i64_t sock_sendv(i64_t fd, raw_p iov, i64_t count);
 i64_t sock_flush(i64_t fd);
 
+// pass file descriptors over a unix domain socket, along with a single byte
+i64_t sock_send_fds(i64_t fd, i64_t *fds, i64_t n);
+i64_t sock_recv_fds(i64_t fd, i64_t *fds, i64_t n);
+
 #endif  // SOCK_H
@@ -27,6 +27,11 @@
 #include "error.h"
 #include "symbols.h"
 #include "pool.h"
+#include "items.h"
+#include "unary.h"
+#include "util.h"
+#include "runtime.h"
+#include "spill.h"
 
 // Maximum range for counting sort - configurable constant
 #define COUNTING_SORT_MAX_RANGE 1000000
@@ -56,6 +61,7 @@ typedef i64_t (*compare_func_t)(obj_p vec, i64_t idx_i, i64_t idx_j);
 // Forward declarations for optimized sorting functions
 static obj_p ray_iasc_optimized(obj_p x);
 static obj_p ray_idesc_optimized(obj_p x);
+static obj_p sort_over_budget(obj_p vec, i64_t asc);
 
 static i64_t compare_symbols(obj_p vec, i64_t idx_i, i64_t idx_j) {
     i64_t sym_i = AS_I64(vec)[idx_i];
@@ -450,6 +456,10 @@ obj_p ray_sort_asc(obj_p vec) {
         return indices;
     }
 
+    indices = sort_over_budget(vec, 1);
+    if (indices != NULL)
+        return indices;
+
     switch (vec->type) {
         case TYPE_B8:
         case TYPE_U8:
@@ -711,6 +721,10 @@ obj_p ray_sort_desc(obj_p vec) {
         return indices;
     }
 
+    indices = sort_over_budget(vec, -1);
+    if (indices != NULL)
+        return indices;
+
     switch (vec->type) {
         case TYPE_B8:
         case TYPE_U8:
@@ -880,6 +894,83 @@ static obj_p counting_sort_i64(obj_p vec, i64_t asc) {
     return indices;
 }
 
+// Stable LSD radix sort of idx by keys (16 bit digits), constant digits are skipped
+static nil_t radix_sort_keys(u64_t* keys, i64_t* idx, i64_t len, i64_t bits, u64_t* ktmp, i64_t* itmp, u64_t* pos) {
+    i64_t i, shift;
+    u64_t d, *ks = keys, *kd = ktmp, *kt;
+    i64_t *is = idx, *id = itmp, *it;
+
+    for (shift = 0; shift < bits; shift += 16) {
+        memset(pos, 0, 65537 * sizeof(u64_t));
+        for (i = 0; i < len; i++)
+            pos[((ks[i] >> shift) & 0xffff) + 1]++;
+
+        d = (ks[0] >> shift) & 0xffff;
+        if (pos[d + 1] == (u64_t)len)
+            continue;
+
+        for (i = 2; i <= 65536; i++)
+            pos[i] += pos[i - 1];
+
+        for (i = 0; i < len; i++) {
+            d = (ks[i] >> shift) & 0xffff;
+            kd[pos[d]] = ks[i];
+            id[pos[d]++] = is[i];
+        }
+
+        kt = ks, ks = kd, kd = kt;
+        it = is, is = id, id = it;
+    }
+
+    if (is != idx)
+        memcpy(idx, is, len * sizeof(i64_t));
+}
+
+// Symbols are radix sorted by their cached lexical ranks
+static obj_p symbol_sort(obj_p vec, i64_t asc) {
+    i64_t i, bits, len = vec->len;
+    symbols_p symbols = runtime_get()->symbols;
+    u32_t* ranks = symbols_ranks(symbols);
+    i64_t *sym = AS_I64(vec), *ids;
+    obj_p res, keys, ktmp, itmp, pos;
+    u64_t *k, lo = ~0ull, hi = 0;
+
+    keys = I64(len);
+    k = (u64_t*)AS_I64(keys);
+    for (i = 0; i < len; i++) {
+        k[i] = SYMBOL_RANK(symbols, ranks, sym[i]);
+        if (k[i] < lo)
+            lo = k[i];
+        if (k[i] > hi)
+            hi = k[i];
+    }
+    symbols_ranks_done(symbols);
+
+    for (i = 0; i < len; i++)
+        k[i] = (asc > 0) ? k[i] - lo : hi - k[i];
+
+    res = I64(len);
+    ids = AS_I64(res);
+    for (i = 0; i < len; i++)
+        ids[i] = i;
+
+    for (bits = 0, lo = hi - lo; lo; lo >>= 1)
+        bits++;
+
+    ktmp = I64(len);
+    itmp = I64(len);
+    pos = I64(65537);
+
+    radix_sort_keys(k, ids, len, bits, (u64_t*)AS_I64(ktmp), AS_I64(itmp), (u64_t*)AS_I64(pos));
+
+    drop_obj(keys);
+    drop_obj(ktmp);
+    drop_obj(itmp);
+    drop_obj(pos);
+
+    return res;
+}
+
 // Optimized sort dispatcher
 static obj_p optimized_sort(obj_p vec, i64_t asc) {
     obj_p res;
@@ -912,9 +1003,10 @@ static obj_p optimized_sort(obj_p vec, i64_t asc) {
 
     // For larger arrays: try counting sort first for integer types
     switch (vec->type) {
+        case TYPE_SYMBOL:
+            return symbol_sort(vec, asc);
         case TYPE_I64:
         case TYPE_TIME:
-        case TYPE_SYMBOL:
             res = counting_sort_i64(vec, asc);
             if (res)
                 return res;
@@ -930,3 +1022,437 @@ static obj_p optimized_sort(obj_p vec, i64_t asc) {
 // Optimized sorting functions
 static obj_p ray_iasc_optimized(obj_p x) { return optimized_sort(x, 1); }
 static obj_p ray_idesc_optimized(obj_p x) { return optimized_sort(x, -1); }
+
+// ============================================================================
+// Multi-column sort via packed keys
+// ============================================================================
+
+// Each sort column is mapped to a dense unsigned key (nulls first) and the
+// keys are packed most-significant-column-first into up to 128 bits, so the
+// whole table is ordered by a single stable LSD radix sort.
+#define PACKED_SORT_MAX_BITS 128
+// Bytes per row of the in-memory packed sort and of a spilled run
+#define PACKED_SORT_ROW_BYTES 40
+#define PACKED_SPILL_ROW_BYTES 48
+#define PACKED_SPILL_MIN_RUN 65536
+
+typedef struct {
+    obj_p vec;          // column
+    i64_t* map;         // enum domain ranks or NULL
+    symbols_p symbols;  // symbol table the ranks belong to
+    u32_t* ranks;       // symbol ranks or NULL
+    u64_t min;          // smallest non-null ordinal
+    u64_t nulls;        // 1 if the column has nulls (they take key 0)
+    u64_t flip;         // key mask for descending order, 0 otherwise
+    i64_t bits;         // key width
+    i64_t shift;        // key offset in the packed key
+} packed_col_t;
+
+typedef struct {
+    packed_col_t* cols;
+    i64_t n;
+    u64_t* lo;
+    u64_t* hi;
+    i64_t start;  // first row of the keys
+} packed_ctx_t;
+
+static inline b8_t packed_ordinal(packed_col_t* c, i64_t i, u64_t* o) {
+    obj_p v = c->vec;
+    f64_t f;
+
+    switch (v->type) {
+        case TYPE_B8:
+        case TYPE_U8:
+        case TYPE_C8:
+            *o = AS_U8(v)[i];
+            return B8_TRUE;
+        case TYPE_I16:
+            *o = (u64_t)(i64_t)AS_I16(v)[i] ^ 0x8000000000000000ULL;
+            return AS_I16(v)[i] != NULL_I16;
+        case TYPE_I32:
+        case TYPE_DATE:
+        case TYPE_TIME:
+            *o = (u64_t)(i64_t)AS_I32(v)[i] ^ 0x8000000000000000ULL;
+            return AS_I32(v)[i] != NULL_I32;
+        case TYPE_F64:
+            f = AS_F64(v)[i];
+            *o = f64_to_sortable_u64(f);
+            return !ISNANF64(f);
+        case TYPE_SYMBOL:
+            *o = SYMBOL_RANK(c->symbols, c->ranks, AS_I64(v)[i]);
+            return B8_TRUE;
+        case TYPE_ENUM:
+            *o = (u64_t)c->map[AS_I64(ENUM_VAL(v))[i]];
+            return B8_TRUE;
+        default:
+            *o = (u64_t)AS_I64(v)[i] ^ 0x8000000000000000ULL;
+            return AS_I64(v)[i] != NULL_I64;
+    }
+}
+
+static obj_p packed_keys_worker(i64_t len, i64_t offset, void* ctx) {
+    packed_ctx_t* p = ctx;
+    packed_col_t* c;
+    i64_t i, j, end = offset + len, start = p->start;
+    u64_t o, k;
+
+    memset(p->lo + offset, 0, len * sizeof(u64_t));
+    if (p->hi)
+        memset(p->hi + offset, 0, len * sizeof(u64_t));
+
+    for (j = 0; j < p->n; j++) {
+        c = &p->cols[j];
+        if (c->bits == 0)
+            continue;
+
+        for (i = offset; i < end; i++) {
+            k = packed_ordinal(c, start + i, &o) ? o - c->min + c->nulls : 0;
+            k ^= c->flip;
+            if (c->shift >= 64) {
+                p->hi[i] |= k << (c->shift - 64);
+            } else {
+                p->lo[i] |= k << c->shift;
+                if (c->shift > 0 && c->shift + c->bits > 64)
+                    p->hi[i] |= k >> (64 - c->shift);
+            }
+        }
+    }
+
+    return NULL_OBJ;
+}
+
+// Prepares the key mapping of a column, returns NULL if it can't be packed
+static obj_p packed_col_init(packed_col_t* c, obj_p col, i64_t asc, obj_p* keep) {
+    i64_t i, len;
+    u64_t o, lo, hi, range;
+    b8_t any;
+    obj_p k, v;
+
+    *keep = NULL_OBJ;
+    c->vec = col;
+    c->map = NULL;
+    c->symbols = runtime_get()->symbols;
+    c->ranks = NULL;
+    c->min = 0;
+    c->nulls = 0;
+
+    switch (col->type) {
+        case TYPE_SYMBOL:
+            c->ranks = symbols_ranks(c->symbols);
+            break;
+        case TYPE_ENUM:
+            k = ray_key(col);
+            if (IS_ERR(k))
+                return k;
+            v = ray_get(k);
+            drop_obj(k);
+            if (IS_ERR(v))
+                return v;
+            if (v->type != TYPE_SYMBOL) {
+                drop_obj(v);
+                return NULL;
+            }
+            c->ranks = symbols_ranks(c->symbols);
+            len = v->len;
+            k = I64(len);
+            for (i = 0; i < len; i++)
+                AS_I64(k)[i] = SYMBOL_RANK(c->symbols, c->ranks, AS_I64(v)[i]);
+            drop_obj(v);
+            *keep = k;
+            c->map = AS_I64(k);
+            break;
+        default:
+            break;
+    }
+
+    switch (col->type) {
+        case TYPE_B8:
+        case TYPE_U8:
+        case TYPE_C8:
+        case TYPE_I16:
+        case TYPE_I32:
+        case TYPE_DATE:
+        case TYPE_TIME:
+        case TYPE_I64:
+        case TYPE_TIMESTAMP:
+        case TYPE_F64:
+        case TYPE_SYMBOL:
+        case TYPE_ENUM:
+            len = col->len;
+            lo = 0;
+            hi = 0;
+            any = B8_FALSE;
+            for (i = 0; i < len; i++) {
+                if (!packed_ordinal(c, i, &o)) {
+                    c->nulls = 1;
+                    continue;
+                }
+                if (!any || o < lo)
+                    lo = o;
+                if (!any || o > hi)
+                    hi = o;
+                any = B8_TRUE;
+            }
+            c->min = lo;
+            range = hi - lo;
+            break;
+        default:
+            return NULL;
+    }
+
+    // Keys span [0, range + nulls]
+    o = range + c->nulls;
+    if (o < range)
+        return NULL;
+
+    for (c->bits = 0; o; o >>= 1)
+        c->bits++;
+
+    c->flip = (asc > 0 || c->bits == 0) ? 0 : (~0ULL >> (64 - c->bits));
+
+    return NULL_OBJ;
+}
+
+// Radix sorts ids by packed keys: low words first, then the high words (lo is clobbered)
+static nil_t packed_sort_keys(u64_t* lo, u64_t* hi, i64_t* ids, i64_t len, i64_t bits, u64_t* tmp, i64_t* itmp,
+                              u64_t* pos) {
+    i64_t i;
+
+    radix_sort_keys(lo, ids, len, (bits > 64) ? 64 : bits, tmp, itmp, pos);
+
+    if (bits > 64) {
+        for (i = 0; i < len; i++)
+            lo[i] = hi[ids[i]];
+        radix_sort_keys(lo, ids, len, bits - 64, tmp, itmp, pos);
+    }
+}
+
+static inline b8_t packed_rec_lt(u64_t* a, u64_t* b) {
+    if (a[0] != b[0])
+        return a[0] < b[0];
+    if (a[1] != b[1])
+        return a[1] < b[1];
+    return a[2] < b[2];
+}
+
+// Out-of-core variant for inputs over the spill budget: runs of rows that fit the budget
+// are sorted and spilled as (hi, lo, row) records, then k-way merged into the result
+static obj_p packed_sort_spill(packed_col_t* pc, i64_t n, i64_t len, i64_t bits) {
+    i64_t i, j, c, l, r, m, rl, run, runs;
+    obj_p res, lo, hi, klo, tmp, ids, itmp, pos, heap;
+    u64_t rec[3], *rk, *hk;
+    i64_t *out, *h;
+    packed_ctx_t ctx;
+    spill_p spill;
+
+    run = spill_get_budget() / PACKED_SPILL_ROW_BYTES;
+    if (run < PACKED_SPILL_MIN_RUN)
+        run = PACKED_SPILL_MIN_RUN;
+    if (run > len)
+        run = len;
+    runs = (len + run - 1) / run;
+
+    spill = spill_create();
+    if (spill == NULL)
+        return err_os();
+
+    lo = I64(run);
+    hi = (bits > 64) ? I64(run) : NULL_OBJ;
+    klo = I64(run);
+    tmp = I64(run);
+    ids = I64(run);
+    itmp = I64(run);
+    pos = I64(65537);
+    hk = (bits > 64) ? (u64_t*)AS_I64(hi) : NULL;
+    res = NULL_OBJ;
+
+    // Run generation
+    for (r = 0; r < runs; r++) {
+        rl = (len - r * run < run) ? len - r * run : run;
+        ctx = (packed_ctx_t){pc, n, (u64_t*)AS_I64(lo), hk, r * run};
+        pool_map(rl, packed_keys_worker, &ctx);
+
+        memcpy(AS_I64(klo), AS_I64(lo), rl * sizeof(u64_t));
+        for (i = 0; i < rl; i++)
+            AS_I64(ids)[i] = i;
+
+        packed_sort_keys((u64_t*)AS_I64(klo), hk, AS_I64(ids), rl, bits, (u64_t*)AS_I64(tmp), AS_I64(itmp),
+                         (u64_t*)AS_I64(pos));
+
+        for (i = 0; i < rl; i++) {
+            j = AS_I64(ids)[i];
+            rec[0] = hk ? hk[j] : 0;
+            rec[1] = ((u64_t*)AS_I64(lo))[j];
+            rec[2] = (u64_t)(r * run + j);
+            if (spill_write(spill, rec, sizeof(rec)) == -1) {
+                res = err_os();
+                break;
+            }
+        }
+
+        if (res != NULL_OBJ)
+            break;
+    }
+
+    drop_obj(lo);
+    drop_obj(hi);
+    drop_obj(klo);
+    drop_obj(tmp);
+    drop_obj(ids);
+    drop_obj(itmp);
+    drop_obj(pos);
+
+    if (res != NULL_OBJ) {
+        spill_destroy(spill);
+        return res;
+    }
+
+    rk = (u64_t*)spill_map(spill);
+    if (rk == NULL) {
+        spill_destroy(spill);
+        return err_os();
+    }
+
+    // Merge: binary heap of run cursors (record positions)
+    heap = I64(runs);
+    h = AS_I64(heap);
+    for (r = 0; r < runs; r++)
+        h[r] = r * run;
+
+    m = runs;
+    for (r = m / 2 - 1; r >= 0; r--) {
+        for (j = r;;) {
+            l = 2 * j + 1;
+            if (l >= m)
+                break;
+            if (l + 1 < m && packed_rec_lt(rk + h[l + 1] * 3, rk + h[l] * 3))
+                l++;
+            if (!packed_rec_lt(rk + h[l] * 3, rk + h[j] * 3))
+                break;
+            c = h[j], h[j] = h[l], h[l] = c;
+            j = l;
+        }
+    }
+
+    res = I64(len);
+    out = AS_I64(res);
+
+    for (i = 0; i < len; i++) {
+        c = h[0];
+        out[i] = (i64_t)rk[c * 3 + 2];
+
+        // Advance the cursor, drop the run once it's exhausted
+        c++;
+        h[0] = (c % run == 0 || c == len) ? h[--m] : c;
+
+        for (j = 0;;) {
+            l = 2 * j + 1;
+            if (l >= m)
+                break;
+            if (l + 1 < m && packed_rec_lt(rk + h[l + 1] * 3, rk + h[l] * 3))
+                l++;
+            if (!packed_rec_lt(rk + h[l] * 3, rk + h[j] * 3))
+                break;
+            c = h[j], h[j] = h[l], h[l] = c;
+            j = l;
+        }
+    }
+
+    drop_obj(heap);
+    spill_destroy(spill);
+
+    return res;
+}
+
+obj_p ray_sort_multi(obj_p cols, i64_t asc) {
+    i64_t i, n, len, bits;
+    obj_p res, keep, lo, hi, tmp, itmp, pos;
+    packed_col_t* pc;
+    packed_ctx_t ctx;
+    i64_t* ids;
+
+    n = cols->len;
+    if (n == 0)
+        return NULL;
+
+    len = AS_LIST(cols)[0]->len;
+    for (i = 0; i < n; i++)
+        if (AS_LIST(cols)[i]->len != len)
+            return NULL;
+
+    pc = (packed_col_t*)heap_alloc(n * sizeof(packed_col_t));
+    if (pc == NULL)
+        return NULL;
+    memset(pc, 0, n * sizeof(packed_col_t));
+
+    keep = LIST(n);
+    keep->len = 0;
+
+    // Least significant column goes to the lowest bits
+    for (i = n - 1, bits = 0; i >= 0; i--) {
+        res = packed_col_init(&pc[i], AS_LIST(cols)[i], asc, &AS_LIST(keep)[keep->len]);
+        keep->len++;
+        if (res == NULL || IS_ERR(res))
+            goto cleanup;
+        pc[i].shift = bits;
+        bits += pc[i].bits;
+        if (bits > PACKED_SORT_MAX_BITS) {
+            res = NULL;
+            goto cleanup;
+        }
+    }
+
+    if (bits > 0 && len > 1 && spill_exceeds(len * PACKED_SORT_ROW_BYTES)) {
+        res = packed_sort_spill(pc, n, len, bits);
+        goto cleanup;
+    }
+
+    res = I64(len);
+    ids = AS_I64(res);
+    for (i = 0; i < len; i++)
+        ids[i] = i;
+
+    if (bits == 0 || len < 2)
+        goto cleanup;
+
+    lo = I64(len);
+    hi = (bits > 64) ? I64(len) : NULL_OBJ;
+    tmp = I64(len);
+    itmp = I64(len);
+    pos = I64(65537);
+
+    ctx = (packed_ctx_t){pc, n, (u64_t*)AS_I64(lo), (bits > 64) ? (u64_t*)AS_I64(hi) : NULL, 0};
+    pool_map(len, packed_keys_worker, &ctx);
+
+    packed_sort_keys((u64_t*)AS_I64(lo), ctx.hi, ids, len, bits, (u64_t*)AS_I64(tmp), AS_I64(itmp),
+                     (u64_t*)AS_I64(pos));
+
+    drop_obj(lo);
+    drop_obj(hi);
+    drop_obj(tmp);
+    drop_obj(itmp);
+    drop_obj(pos);
+
+cleanup:
+    for (i = 0; i < n; i++)
+        if (pc[i].ranks != NULL)
+            symbols_ranks_done(pc[i].symbols);
+    drop_obj(keep);
+    heap_free(pc);
+
+    return res;
+}
+
+// Sorts a vector out of core if its intermediates don't fit the spill budget, NULL otherwise
+static obj_p sort_over_budget(obj_p vec, i64_t asc) {
+    obj_p cols, res;
+
+    if (!spill_exceeds(vec->len * PACKED_SORT_ROW_BYTES))
+        return NULL;
+
+    cols = vn_list(1, clone_obj(vec));
+    res = ray_sort_multi(cols, asc);
+    drop_obj(cols);
+
+    return res;
+}
@@ -29,6 +29,9 @@
 obj_p ray_sort_asc(obj_p vec);
 obj_p ray_sort_desc(obj_p vec);
 
+// Sorts rows by a list of columns at once, NULL if the keys can't be packed
+obj_p ray_sort_multi(obj_p cols, i64_t asc);
+
 // Internal merge sort function
 obj_p mergesort_generic_obj(obj_p vec, i64_t asc);
 
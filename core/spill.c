@@ -0,0 +1,127 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+
+#include "spill.h"
+#include <stdio.h>
+#include "heap.h"
+#include "fs.h"
+#include "mmap.h"
+#include "ops.h"
+#include "eval.h"
+
+// Memory budget (bytes) for operator intermediates, 0 means unlimited
+static i64_t __SPILL_BUDGET = 0;
+
+nil_t spill_set_budget(i64_t bytes) { __SPILL_BUDGET = (bytes > 0) ? bytes : 0; }
+
+// The tighter of the spill budget and what is left of the query memory budget
+i64_t spill_get_budget(nil_t) {
+    i64_t left = heap_query_left();
+
+    if (left < 0 || (__SPILL_BUDGET > 0 && __SPILL_BUDGET < left))
+        return __SPILL_BUDGET;
+
+    return left;
+}
+
+b8_t spill_exceeds(i64_t bytes) { return (__SPILL_BUDGET > 0 || heap_get_limit() > 0) && bytes > spill_get_budget(); }
+
+spill_p spill_create(nil_t) {
+    spill_p spill;
+
+    spill = (spill_p)heap_alloc(sizeof(struct spill_t));
+    if (spill == NULL)
+        return NULL;
+
+    // Spill files live next to the heap swap files (HEAP_SWAP)
+    snprintf(spill->path, sizeof(spill->path), "%sspill_%llu.dat", VM->heap->swap_path, ops_rand_u64());
+    spill->fd = fs_fopen(spill->path, ATTR_RDWR | ATTR_CREAT | ATTR_TRUNC);
+
+    if (spill->fd == -1) {
+        heap_free(spill);
+        return NULL;
+    }
+
+    spill->size = 0;
+    spill->map = NULL;
+    spill->buf_len = 0;
+
+    return spill;
+}
+
+static i64_t spill_flush(spill_p spill) {
+    if (spill->buf_len == 0)
+        return 0;
+
+    if (fs_fwrite(spill->fd, (str_p)spill->buf, spill->buf_len) != spill->buf_len)
+        return -1;
+
+    spill->buf_len = 0;
+
+    return 0;
+}
+
+i64_t spill_write(spill_p spill, raw_p data, i64_t size) {
+    i64_t n;
+    u8_t *src = (u8_t *)data;
+
+    while (size > 0) {
+        if (spill->buf_len == SPILL_BUF_SIZE && spill_flush(spill) == -1)
+            return -1;
+
+        n = MINU64(size, SPILL_BUF_SIZE - spill->buf_len);
+        memcpy(spill->buf + spill->buf_len, src, n);
+        spill->buf_len += n;
+        spill->size += n;
+        src += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+// Maps the written data back (read only use), the file must not be empty
+raw_p spill_map(spill_p spill) {
+    if (spill->map != NULL)
+        return spill->map;
+
+    if (spill->size == 0 || spill_flush(spill) == -1)
+        return NULL;
+
+    spill->map = mmap_file(spill->fd, NULL, spill->size, 0);
+
+    return spill->map;
+}
+
+nil_t spill_destroy(spill_p spill) {
+    if (spill == NULL)
+        return;
+
+    if (spill->map != NULL)
+        mmap_free(spill->map, spill->size);
+
+    fs_fclose(spill->fd);
+    fs_fdelete(spill->path);
+    heap_free(spill);
+}
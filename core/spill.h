@@ -0,0 +1,50 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include "rayforce.h"
+
+#define SPILL_BUF_SIZE (RAY_PAGE_SIZE * 4)
+
+// Spill file: buffered appends while writing, then mapped back for reading
+typedef struct spill_t {
+    i64_t fd;
+    i64_t size;     // bytes written so far
+    raw_p map;      // read mapping, NULL until spill_map()
+    i64_t buf_len;  // pending bytes in buf
+    c8_t path[128];
+    u8_t buf[SPILL_BUF_SIZE];
+} *spill_p;
+
+nil_t spill_set_budget(i64_t bytes);
+i64_t spill_get_budget(nil_t);
+b8_t spill_exceeds(i64_t bytes);
+spill_p spill_create(nil_t);
+i64_t spill_write(spill_p spill, raw_p data, i64_t size);
+raw_p spill_map(spill_p spill);
+nil_t spill_destroy(spill_p spill);
+
+#endif  // SPILL_H
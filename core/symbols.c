@@ -74,6 +74,12 @@ str_p string_intern(symbols_p symbols, lit_p str, i64_t len) {
     memcpy(node, str, len);
     node[len] = '\0';
 
+    // Strings are published in pool order, once the ones before this one are written too
+    rounds = 0;
+    while (__atomic_load_n(&symbols->string_done, __ATOMIC_ACQUIRE) != curr)
+        backoff_spin(&rounds);
+    __atomic_store_n(&symbols->string_done, curr + cap, __ATOMIC_RELEASE);
+
     return node;
 }
 
@@ -164,6 +170,7 @@ symbols_p symbols_create(nil_t) {
 
     symbols->string_pool = string_pool;
     symbols->string_curr = symbols->string_pool;
+    symbols->string_done = symbols->string_pool;
     symbols->string_node = symbols->string_pool + STRING_NODE_SIZE;
 
     if (mmap_commit(symbols->string_pool, STRING_NODE_SIZE) == -1) {
@@ -188,6 +195,18 @@ nil_t symbols_destroy(symbols_p symbols) {
         }
     }
 
+    if (symbols->ranks != NULL)
+        mmap_free(symbols->ranks, STRING_POOL_SIZE);
+
+    for (i = 0; i < symbols->retired_len; i++)
+        mmap_free(symbols->retired[i], STRING_POOL_SIZE);
+
+    if (symbols->retired != NULL)
+        mmap_free(symbols->retired, symbols->retired_cap * sizeof(u32_t *));
+
+    if (symbols->sorted != NULL)
+        mmap_free(symbols->sorted, symbols->sorted_cap * sizeof(i64_t));
+
     mmap_free(symbols->syms, symbols->size * sizeof(symbol_p));
     mmap_free(symbols->string_pool, STRING_POOL_SIZE);
     heap_unmap(symbols, sizeof(struct symbols_t));
@@ -197,6 +216,181 @@ str_p str_from_symbol(i64_t key) { return (key == NULL_I64) ? (str_p) "" : (str_
 
 i64_t symbols_count(symbols_p symbols) { return symbols->count; }
 
+static nil_t symbols_sort(i64_t *a, i64_t *t, i64_t n) {
+    i64_t i, j, k, m;
+
+    if (n < 2)
+        return;
+
+    m = n / 2;
+    symbols_sort(a, t, m);
+    symbols_sort(a + m, t, n - m);
+
+    for (i = 0, j = m, k = 0; i < m && j < n;)
+        t[k++] = (strcmp((str_p)a[j], (str_p)a[i]) < 0) ? a[j++] : a[i++];
+    while (i < m)
+        t[k++] = a[i++];
+    while (j < n)
+        t[k++] = a[j++];
+
+    memcpy(a, t, n * sizeof(i64_t));
+}
+
+static nil_t symbols_ranks_lock(symbols_p symbols) {
+    i64_t rounds = 0;
+
+    while (__atomic_exchange_n(&symbols->ranks_lock, 1, __ATOMIC_ACQUIRE))
+        backoff_spin(&rounds);
+}
+
+static nil_t symbols_ranks_unlock(symbols_p symbols) { __atomic_store_n(&symbols->ranks_lock, 0, __ATOMIC_RELEASE); }
+
+// Unmaps the replaced tables once nobody reads them, called with the lock held
+static nil_t symbols_ranks_reclaim(symbols_p symbols) {
+    i64_t i;
+
+    if (symbols->ranks_users > 0)
+        return;
+
+    for (i = 0; i < symbols->retired_len; i++)
+        mmap_free(symbols->retired[i], STRING_POOL_SIZE);
+
+    symbols->retired_len = 0;
+}
+
+// Keeps a replaced table until nobody reads it, called with the lock held
+static nil_t symbols_ranks_retire(symbols_p symbols, u32_t *ranks) {
+    i64_t cap;
+    u32_t **retired;
+
+    if (symbols->retired_len == symbols->retired_cap) {
+        cap = (symbols->retired_cap > 0) ? symbols->retired_cap * 2 : RAY_PAGE_SIZE / ISIZEOF(u32_t *);
+        retired = (u32_t **)mmap_alloc(cap * sizeof(u32_t *));
+        if (retired == NULL) {
+            perror("symbol ranks mmap_alloc");
+            exit(1);
+        }
+
+        if (symbols->retired != NULL) {
+            memcpy(retired, symbols->retired, symbols->retired_len * sizeof(u32_t *));
+            mmap_free(symbols->retired, symbols->retired_cap * sizeof(u32_t *));
+        }
+
+        symbols->retired = retired;
+        symbols->retired_cap = cap;
+    }
+
+    symbols->retired[symbols->retired_len++] = ranks;
+}
+
+// Returns lexical ranks of all interned symbols (see SYMBOL_RANK). The table is rebuilt
+// when new symbols were interned since the last call: only the new strings are sorted,
+// then merged into the already ordered ones, but every symbol is ranked again into a new
+// table that replaces the old one, so a rebuild costs O(all symbols) and a table is never
+// changed while a caller reads it. Strings still being written by interners are left to
+// the next rebuild.
+// Every call must be paired with symbols_ranks_done() once the caller is done with it.
+u32_t *symbols_ranks(symbols_p symbols) {
+    i64_t i, j, k, n, m, cap;
+    i64_t *fresh, *sorted;
+    u32_t *ranks;
+    str_p p, curr;
+
+    symbols_ranks_lock(symbols);
+
+    curr = __atomic_load_n(&symbols->string_done, __ATOMIC_ACQUIRE);
+
+    if (symbols->ranks == NULL)
+        symbols->ranks_curr = symbols->string_pool;
+
+    if (symbols->ranks_curr == curr)
+        goto done;
+
+    ranks = (u32_t *)mmap_reserve(NULL, STRING_POOL_SIZE);
+    if (ranks == NULL) {
+        perror("symbol ranks mmap_reserve");
+        exit(1);
+    }
+
+    // Every string takes at least 8 bytes, so a slot per 4 bytes fits in the pool size
+    if (mmap_commit(ranks, ALIGNUP(curr - symbols->string_pool, RAY_PAGE_SIZE)) != 0) {
+        perror("symbol ranks mmap_commit");
+        exit(1);
+    }
+
+    for (n = 0, p = symbols->ranks_curr; p < curr; n++)
+        p += ALIGNUP(sizeof(u32_t) + *(u32_t *)p + 1, sizeof(u32_t));
+
+    fresh = (i64_t *)heap_alloc(n * 2 * sizeof(i64_t));
+    if (fresh == NULL) {
+        perror("symbol ranks heap_alloc");
+        exit(1);
+    }
+
+    for (i = 0, p = symbols->ranks_curr; p < curr; i++) {
+        fresh[i] = (i64_t)(p + sizeof(u32_t));
+        p += ALIGNUP(sizeof(u32_t) + *(u32_t *)p + 1, sizeof(u32_t));
+    }
+
+    symbols_sort(fresh, fresh + n, n);
+
+    m = symbols->sorted_len;
+    if (m + n > symbols->sorted_cap) {
+        cap = (symbols->sorted_cap > 0) ? symbols->sorted_cap : STRING_NODE_SIZE;
+        while (cap < m + n)
+            cap *= 2;
+
+        sorted = (i64_t *)mmap_alloc(cap * sizeof(i64_t));
+        if (sorted == NULL) {
+            perror("symbol ranks mmap_alloc");
+            exit(1);
+        }
+
+        if (symbols->sorted != NULL) {
+            memcpy(sorted, symbols->sorted, m * sizeof(i64_t));
+            mmap_free(symbols->sorted, symbols->sorted_cap * sizeof(i64_t));
+        }
+
+        symbols->sorted = sorted;
+        symbols->sorted_cap = cap;
+    }
+
+    // Merge new strings in from the back
+    sorted = symbols->sorted;
+    for (i = m - 1, j = n - 1, k = m + n - 1; j >= 0; k--)
+        sorted[k] = (i >= 0 && strcmp((str_p)sorted[i], (str_p)fresh[j]) > 0) ? sorted[i--] : fresh[j--];
+
+    heap_free(fresh);
+
+    // Rank 0 is reserved for the null symbol
+    for (i = 0; i < m + n; i++)
+        ranks[((str_p)sorted[i] - symbols->string_pool) >> 2] = (u32_t)(i + 1);
+
+    symbols->sorted_len = m + n;
+    symbols->ranks_curr = curr;
+
+    if (symbols->ranks != NULL) {
+        symbols_ranks_retire(symbols, symbols->ranks);
+        symbols_ranks_reclaim(symbols);
+    }
+
+    symbols->ranks = ranks;
+
+done:
+    ranks = symbols->ranks;
+    symbols->ranks_users++;
+    symbols_ranks_unlock(symbols);
+
+    return ranks;
+}
+
+nil_t symbols_ranks_done(symbols_p symbols) {
+    symbols_ranks_lock(symbols);
+    symbols->ranks_users--;
+    symbols_ranks_reclaim(symbols);
+    symbols_ranks_unlock(symbols);
+}
+
 // TODO
 nil_t symbols_rebuild(symbols_p symbols) {
     UNUSED(symbols);
@@ -31,6 +31,8 @@
 #define STRING_NODE_SIZE RAY_PAGE_SIZE
 #define STRING_POOL_SIZE (RAY_PAGE_SIZE * 1024ull * 1024ull)
 #define SYMBOL_STRLEN(x) ((x == NULL_I64) ? 0 : *((u32_t *)(x - sizeof(u32_t))))
+// Lexical rank of an interned symbol (null sorts first), r is the table from symbols_ranks()
+#define SYMBOL_RANK(s, r, x) ((x == NULL_I64) ? 0 : (r)[((str_p)(x) - (s)->string_pool) >> 2])
 
 typedef struct symbol_t {
     lit_p str;
@@ -44,6 +46,17 @@ typedef struct symbols_t {
     str_p string_pool;  // string pool
     str_p string_node;  // string pool current node
     str_p string_curr;  // string pool cursor
+    str_p string_done;  // string pool cursor up to which every string is written
+    u32_t *ranks;       // lexical ranks indexed by 4-byte string pool slot, replaced as a whole once built
+    str_p ranks_curr;   // string pool cursor the ranks are built for
+    i64_t ranks_users;  // callers still reading a table returned by symbols_ranks()
+    u32_t **retired;    // replaced tables, unmapped once no caller reads any
+    i64_t retired_len;
+    i64_t retired_cap;
+    i64_t *sorted;      // interned strings in lexical order
+    i64_t sorted_len;
+    i64_t sorted_cap;
+    i64_t ranks_lock;
 } *symbols_p;
 
 i64_t symbols_intern(lit_p s, i64_t len);
@@ -52,5 +65,7 @@ nil_t symbols_destroy(symbols_p symbols);
 i64_t symbols_count(symbols_p symbols);
 str_p str_from_symbol(i64_t key);
 nil_t symbols_rebuild(symbols_p symbols);
+u32_t *symbols_ranks(symbols_p symbols);
+nil_t symbols_ranks_done(symbols_p symbols);
 
 #endif  // SYMBOLS_H
@@ -228,11 +228,18 @@ obj_p sys_listen(i32_t argc, str_p argv[]) {
     UNUSED(argv);
 
     i64_t l, res = 0;
+    sock_addr_t addr;
 
     if (argc != 1)
         return err_length(0, 0);
 
     l = strlen(argv[0]);
+
+    if (sock_addr_from_str(argv[0], l, &addr) == 0 && addr.local) {
+        res = ipc_listen_local(runtime_get()->poll, addr.ip);
+        return (res == -1) ? err_os() : i64(res);
+    }
+
     i64_from_str(argv[0], l, &res);
     if (res < 0)
         return err_type(0, 0, 0);
@@ -34,10 +34,15 @@
 #include "string.h"
 #include "fdmap.h"
 #include "iter.h"
+#include "serve.h"
 
 obj_p unary_call(obj_p f, obj_p x) {
     unary_f fn;
 
+    // A reader stops short of any side effect, its request runs again on the main thread
+    if (UNLIKELY(f->attrs & FN_EFFECT) && serve_rerun())
+        return err_nyi(0);
+
     if (f->attrs & FN_ATOMIC)
         return map_unary(f, x);
 
@@ -35,6 +35,7 @@
 #include "query.h"
 #include "aggr.h"
 #include "compose.h"
+#include "serve.h"
 
 #define UNCOW_OBJ(o, v, orig, r) \
     {                            \
@@ -48,6 +49,10 @@
 
 obj_p __fetch(obj_p obj, obj_p **val, obj_p *original) {
     if (obj->type == -TYPE_SYMBOL) {
+        // Changes a global in place, which a reader leaves to the main thread
+        if (serve_rerun())
+            return err_nyi(0);
+
         *val = resolve(obj->i64);
         if (*val == NULL)
             return err_value(0);
@@ -319,6 +324,9 @@ obj_p ray_alter(obj_p *x, i64_t n) {
         return err_type(0, 0, 0);
 
     if (x[0]->type == -TYPE_SYMBOL) {
+        if (serve_rerun())
+            return err_nyi(0);
+
         cur = resolve(x[0]->i64);
         if (cur == NULL)
             return err_value(0);
@@ -368,6 +376,9 @@ obj_p ray_modify(obj_p *x, i64_t n) {
         return err_type(0, 0, 0);
 
     if (x[0]->type == -TYPE_SYMBOL) {
+        if (serve_rerun())
+            return err_nyi(0);
+
         cur = resolve(x[0]->i64);
         if (cur == NULL)
             return err_value(0);
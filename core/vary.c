@@ -40,10 +40,15 @@
 #include "order.h"
 #include "cmp.h"
 #include "iter.h"
+#include "serve.h"
 
 obj_p vary_call(obj_p f, obj_p *x, i64_t n) {
     vary_f fn;
 
+    // A reader stops short of any side effect, its request runs again on the main thread
+    if (UNLIKELY(f->attrs & FN_EFFECT) && serve_rerun())
+        return err_nyi(0);
+
     if ((f->attrs & FN_ATOMIC) || (n && x[0]->type == TYPE_MAPGROUP))
         return map_vary(f, x, n);
     else {
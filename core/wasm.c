@@ -78,6 +78,13 @@ poll_buffer_p poll_buf_create(i64_t size) {
     return NULL;
 }
 
+poll_buffer_p poll_buf_ref(obj_p obj, i64_t offset, i64_t size) {
+    UNUSED(offset);
+    UNUSED(size);
+    drop_obj(obj);
+    return NULL;
+}
+
 nil_t poll_buf_destroy(poll_buffer_p buf) {
     UNUSED(buf);
 }
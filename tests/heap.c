@@ -238,4 +238,220 @@ test_result_t test_allocate_and_free_obj() {
     drop_obj(ht5);
 
     PASS();
-}
\ No newline at end of file
+}
+
+test_result_t test_query_limit() {
+    heap_set_limit(4 << 20);
+
+    TEST_ASSERT_ER("(til 10000000)", "limit");
+    TEST_ASSERT_ER("(sum (+ (til 1000000) 1))", "limit");
+    TEST_ASSERT_EQ("(sum (til 100000))", "4999950000");
+    TEST_ASSERT(heap_query_used() == 0, "heap_query_used() == 0");
+
+    heap_set_limit(0);
+
+    TEST_ASSERT_EQ("(sum (+ (til 1000000) 1))", "500000500000");
+
+    PASS();
+}
+
+test_result_t test_query_arena() {
+    raw_p p1, p2;
+
+    heap_arena_begin();
+    heap_temp_begin();
+
+    p1 = heap_alloc(40);
+    p2 = heap_alloc(40);
+    TEST_ASSERT(p1 != NULL && p2 != NULL, "p1 != NULL && p2 != NULL");
+    TEST_ASSERT((u8_t *)p2 == (u8_t *)p1 + 64, "p2 == p1 + 64");
+
+    heap_free(p1);
+    p1 = heap_realloc(p2, 4096);
+    TEST_ASSERT(p1 != NULL, "p1 != NULL");
+
+    heap_temp_end();
+    heap_arena_end();
+
+    TEST_ASSERT_EQ("(set t (table [k v] (list (% (til 100000) 7) (til 100000)))) (count (select {s: (sum v) from: t by: k}))",
+                   "7");
+    TEST_ASSERT_EQ("(at (select {s: (sum v) from: t by: k}) 's)",
+                   "[714264285 714278571 714292857 714307143 714321429 714235715 714250000]");
+
+    PASS();
+}
+
+test_result_t test_alloc_profile() {
+    obj_p v;
+    heap_prof_t before[256], after[256];
+
+    heap_prof_set(B8_TRUE);
+    heap_prof_types(before);
+
+    v = I64(100000);
+    heap_prof_types(after);
+    TEST_ASSERT(after[TYPE_I64].count == before[TYPE_I64].count + 1, "one I64 vector allocated");
+    TEST_ASSERT(after[TYPE_I64].live - before[TYPE_I64].live >= 800000, "I64 live bytes grow");
+
+    drop_obj(v);
+    heap_prof_types(after);
+    TEST_ASSERT(after[TYPE_I64].live == before[TYPE_I64].live, "I64 live bytes are back");
+
+    TEST_ASSERT_EQ("(count (til 100000)) (in 'til (at (memstat 'sites) 'site))", "true");
+    TEST_ASSERT_EQ("(in 'I64 (at (memstat 'types) 'type))", "true");
+    TEST_ASSERT_ER("(memstat 'nope)", "value");
+
+    heap_prof_set(B8_FALSE);
+
+    PASS();
+}
+
+test_result_t test_soft_limit_spill() {
+    obj_p v;
+    memstat_t stat;
+
+    heap_set_soft_limit(1);
+
+    v = I64(8 << 20);
+    stat = heap_memstat();
+    TEST_ASSERT(stat.spill >= (8 << 20) * 8, "large pool is spilled");
+
+    AS_I64(v)[0] = 1;
+    AS_I64(v)[v->len - 1] = 2;
+    TEST_ASSERT(AS_I64(v)[0] + AS_I64(v)[v->len - 1] == 3, "spilled pool is usable");
+
+    drop_obj(v);
+    stat = heap_memstat();
+    TEST_ASSERT(stat.spill == 0, "spilled pool is released on free");
+
+    heap_set_soft_limit(0);
+
+    PASS();
+}
+
+test_result_t test_heap_slabs() {
+    i64_t i, n = 5000, size = 64 - sizeof(struct obj_t), slab = 6 - MIN_BLOCK_ORDER;
+    u8_t *ptrs[n], *p;
+    heap_p heap = heap_get();
+
+    // With the caches empty the first block carves a batch, the rest of it follows in order
+    heap_gc();
+    TEST_ASSERT(heap->slabs_count[slab] == 0, "slab emptied");
+
+    ptrs[0] = heap_alloc(size);
+    TEST_ASSERT(heap->slabs_count[slab] > 0, "a batch is carved");
+
+    for (i = 1; i < 16; i++) {
+        ptrs[i] = heap_alloc(size);
+        TEST_ASSERT(ptrs[i] == ptrs[i - 1] + 64, "blocks of a batch are adjacent");
+    }
+
+    // The last one freed is the first one taken
+    heap_free(ptrs[15]);
+    p = heap_alloc(size);
+    TEST_ASSERT(p == ptrs[15], "slab is LIFO");
+
+    for (; i < n; i++) {
+        ptrs[i] = heap_alloc(size);
+        TEST_ASSERT(ptrs[i] != NULL, "ptrs[i] != NULL");
+    }
+
+    // Not all of them are kept, and heap_gc gives the cached ones back
+    for (i = 0; i < n; i++)
+        heap_free(ptrs[i]);
+    TEST_ASSERT(heap->slabs_count[slab] > 0 && heap->slabs_count[slab] < n, "slab is bounded");
+
+    heap_gc();
+    TEST_ASSERT(heap->slabs_count[slab] == 0, "slab flushed by heap_gc");
+
+    PASS();
+}
+
+test_result_t test_heap_scavenge() {
+    i64_t n, pool = (64 << 20) - sizeof(struct obj_t), size = (8 << 20) - sizeof(struct obj_t);
+    u8_t *p, *q;
+    memstat_t before, after;
+    heap_p heap = heap_get();
+
+    // A pool of its own is kept warm while it fits, unmapped once it does not
+    p = heap_alloc(pool);
+    TEST_ASSERT(p != NULL, "p != NULL");
+    heap_free(p);
+
+    before = heap_memstat();
+    heap_scavenge(heap, 1ll << 40);
+    after = heap_memstat();
+    TEST_ASSERT(after.system == before.system, "pools within keep stay");
+
+    n = heap_scavenge(heap, 0);
+    after = heap_memstat();
+    TEST_ASSERT(n >= (64 << 20), "free pool returned");
+    TEST_ASSERT(after.system <= before.system - (64 << 20), "free pool unmapped");
+
+    // A free block of a pool in use has its pages discarded, and is handed out again as usual
+    p = heap_alloc(size);
+    q = heap_alloc(size);
+    TEST_ASSERT(p != NULL && q != NULL, "p != NULL && q != NULL");
+    heap_free(p);
+
+    n = heap_scavenge(heap, 0);
+    TEST_ASSERT(n > 0, "free block discarded");
+    TEST_ASSERT(heap_scavenge(heap, 0) == 0, "discarded once");
+
+    p = heap_alloc(size);
+    TEST_ASSERT(p != NULL, "p != NULL");
+    memset(p, 0xab, size);
+    TEST_ASSERT(p[0] == 0xab && p[size - 1] == 0xab, "discarded block is usable");
+
+    heap_free(p);
+    heap_free(q);
+
+    PASS();
+}
+
+static obj_p __REMOTE_TEST_RES = NULL;
+
+// Keeps the result, made on the heap of the reader
+static nil_t remote_test_done(poll_p poll, serve_job_p job) {
+    __REMOTE_TEST_RES = job->res;
+    job->res = NULL_OBJ;
+    serve_job_destroy(job);
+    poll_exit(poll, 0);
+}
+
+test_result_t test_heap_remote_free() {
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+    SKIP("no readers on this platform");
+#else
+    obj_p name, v;
+    block_p block;
+    heap_p owner;
+    poll_p poll = runtime_get()->poll;
+
+    TEST_ASSERT(serve_init(poll, 1, remote_test_done) == 1, "serve_init");
+    name = string_from_str("test", 4);
+
+    serve_submit(str_fmt(-1, "(til 1000)"), name, 0, 0);
+    poll_run(poll);
+    v = __REMOTE_TEST_RES;
+    block = (block_p)((u8_t *)v - sizeof(struct obj_t));
+    owner = serve_heap(block->heap_id);
+    TEST_ASSERT(owner != NULL && owner != heap_get(), "made on the heap of the reader");
+
+    // Dropped here, it is queued for its owner instead of being freed into this heap
+    drop_obj(v);
+    TEST_ASSERT(__atomic_load_n(&owner->remote_blocks, __ATOMIC_ACQUIRE) == block, "queued for the owner");
+
+    // The owner takes it back with its next allocation, and hands it out again
+    poll->code = NULL_I64;
+    serve_submit(str_fmt(-1, "(til 1000)"), name, 0, 0);
+    poll_run(poll);
+    TEST_ASSERT(__atomic_load_n(&owner->remote_blocks, __ATOMIC_ACQUIRE) == NULL, "drained by the owner");
+    TEST_ASSERT(__REMOTE_TEST_RES == v, "block reused by the owner");
+
+    drop_obj(__REMOTE_TEST_RES);
+    drop_obj(name);
+
+    PASS();
+#endif
+}
@@ -0,0 +1,615 @@
+/*
+ *   Copyright (c) 2025 Anton Kundenko <singaraiona@gmail.com>
+ *   All rights reserved.
+
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ */
+
+// The test binary itself, run as a server by the IPC tests
+static str_p __IPC_TEST_EXE = NULL;
+
+// Started with arguments, the test binary serves as rayforce does
+static i32_t ipc_test_serve(i32_t argc, str_p argv[]) {
+    i32_t code;
+
+    runtime_create(argc, argv);
+    code = runtime_run();
+    runtime_destroy();
+
+    return code;
+}
+
+#if !defined(OS_WINDOWS) && !defined(OS_WASM)
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#ifdef OS_LINUX
+#include <sys/prctl.h>
+#endif
+
+// Unix socket of the server of a test
+static nil_t ipc_test_path(c8_t *buf, i64_t len, lit_p name) { snprintf(buf, len, "/tmp/rayforce-%s-%d.sock", name, getpid()); }
+
+// Init script of the server, next to its socket or in /tmp for an abstract name
+static nil_t ipc_test_file(c8_t *buf, i64_t len, lit_p path) {
+    if (path[0] == '@')
+        snprintf(buf, len, "/tmp/%s.rf", path + 1);
+    else
+        snprintf(buf, len, "%s.rf", path);
+}
+
+// Runs a server on a unix socket, for the test process to be its client.
+// The heap is shared with a forked child, so the child execs a server of its own.
+static pid_t ipc_test_server(lit_p path, lit_p init, i64_t readers) {
+    c8_t file[160], addr[160], workers[32];
+    str_p argv[10];
+    i32_t fd, i;
+    pid_t pid;
+    FILE *f;
+    sock_addr_t sa;
+
+    ipc_test_file(file, sizeof(file), path);
+    f = fopen(file, "w");
+    if (f == NULL)
+        return -1;
+    fprintf(f, "%s\n", init);
+    fclose(f);
+
+    snprintf(addr, sizeof(addr), "unix:%s", path);
+    snprintf(workers, sizeof(workers), "%lld", readers);
+    argv[0] = __IPC_TEST_EXE;
+    argv[1] = "-r";
+    argv[2] = "0";
+    argv[3] = "-p";
+    argv[4] = addr;
+    argv[5] = "-f";
+    argv[6] = file;
+    argv[7] = "-w";
+    argv[8] = workers;
+    argv[9] = NULL;
+
+    unlink(path);
+    fflush(stdout);
+    pid = fork();
+
+    if (pid == 0) {
+#ifdef OS_LINUX
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+        fd = open("/dev/null", O_RDWR);
+        dup2(fd, 0);
+        dup2(fd, 1);
+        dup2(fd, 2);
+        execv(__IPC_TEST_EXE, argv);
+        _exit(1);
+    }
+
+    if (pid == -1)
+        return -1;
+
+    // Ready once it accepts a connection
+    memset(&sa, 0, sizeof(sa));
+    snprintf(sa.ip, sizeof(sa.ip), "%s", path);
+    sa.local = B8_TRUE;
+    for (i = 0; i < 500; i++) {
+        fd = sock_open(&sa, 100);
+        if (fd != -1) {
+            sock_close(fd);
+            break;
+        }
+        usleep(10000);
+    }
+
+    if (fd == -1) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        unlink(file);
+        return -1;
+    }
+
+    // A test that hangs fails instead
+    alarm(30);
+
+    return pid;
+}
+
+static nil_t ipc_test_stop(pid_t pid, lit_p path) {
+    c8_t file[160];
+
+    alarm(0);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    unlink(path);
+    ipc_test_file(file, sizeof(file), path);
+    unlink(file);
+}
+
+// Evaluates a format of the connection string on the client side
+static obj_p ipc_test_eval(lit_p fmt, lit_p path) {
+    c8_t buf[256];
+
+    snprintf(buf, sizeof(buf), fmt, path);
+    return eval_str(buf);
+}
+
+#endif
+
+#define SERVE_TEST_JOBS 200
+#define SERVE_TEST_GETS 20
+#define SERVE_TEST_DB "/tmp/rayforce_test_serve/"
+
+static i64_t __SERVE_TEST_DONE;
+static i64_t __SERVE_TEST_WRONG;
+static i64_t __SERVE_TEST_RERUN;
+
+// Each job is expected to give its correlation id back, unless it has to run on the main thread
+static nil_t serve_test_done(poll_p poll, serve_job_p job) {
+    if (job->rerun)
+        __SERVE_TEST_RERUN++;
+    else if (job->res->type != -TYPE_I64 || job->res->i64 != job->corr)
+        __SERVE_TEST_WRONG++;
+
+    serve_job_destroy(job);
+
+    if (++__SERVE_TEST_DONE == SERVE_TEST_JOBS + SERVE_TEST_GETS + 3)
+        poll_exit(poll, 0);
+}
+
+test_result_t test_serve_readers() {
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+    SKIP("no readers on this platform");
+#else
+    i64_t i;
+    obj_p name, res;
+    poll_p poll = runtime_get()->poll;
+
+    __SERVE_TEST_DONE = 0;
+    __SERVE_TEST_WRONG = 0;
+    __SERVE_TEST_RERUN = 0;
+
+    // Locals of a shared lambda, set and read back by both readers at once
+    res = eval_str("(set g (fn [x] (let a x) (let s (sum (til 200000))) (let b (+ a s)) (- b s)))");
+    TEST_ASSERT(!IS_ERR(res), "define g");
+    drop_obj(res);
+
+    system("rm -rf " SERVE_TEST_DB);
+    res = eval_str("(set-splayed \"" SERVE_TEST_DB "t/\" (table [sym p] (list (take ['a 'b] 1000) (til 1000))))");
+    TEST_ASSERT(!IS_ERR(res), "set-splayed");
+    drop_obj(res);
+
+    TEST_ASSERT(serve_init(poll, 2, serve_test_done) == 2, "serve_init");
+
+    name = string_from_str("test", 4);
+    for (i = 0; i < SERVE_TEST_JOBS; i++)
+        serve_submit(str_fmt(-1, "(g %lld)", i), name, 0, i);
+
+    // Writes and side effects stop the reader, try does not hold it back
+    // Columns mapped and dropped by both readers at once
+    for (i = 0; i < SERVE_TEST_GETS; i++) {
+        if (i % 2)
+            serve_submit(str_fmt(-1, "(count (get-splayed \"" SERVE_TEST_DB "t/\"))"), name, 0, 1000);
+        else
+            serve_submit(str_fmt(-1, "(sum (at (get-splayed \"" SERVE_TEST_DB "t/\") 'p))"), name, 0, 499500);
+    }
+
+    serve_submit(str_fmt(-1, "(set w 1)"), name, 0, -1);
+    serve_submit(str_fmt(-1, "(do (let z 5) z)"), name, 0, -1);
+    serve_submit(str_fmt(-1, "(try (set w 2) (fn [e] 0))"), name, 0, -1);
+    drop_obj(name);
+
+    poll_run(poll);
+
+    TEST_ASSERT(__SERVE_TEST_WRONG == 0, "every reader sees its own locals");
+    TEST_ASSERT(__SERVE_TEST_RERUN == 3, "writes are left to the main thread");
+
+    res = eval_str("w");
+    TEST_ASSERT(IS_ERR(res), "a reader does not write globals");
+    drop_obj(res);
+
+    system("rm -rf " SERVE_TEST_DB);
+
+    PASS();
+#endif
+}
+
+test_result_t test_ipc_readers() {
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+    SKIP("no readers on this platform");
+#else
+    c8_t path[128];
+    pid_t pid;
+    obj_p res;
+
+    ipc_test_path(path, sizeof(path), "readers");
+    pid = ipc_test_server(path,
+                          "(set n 0) (set g (fn [x] (let a x) (let s (sum (til 200000))) (let b (+ a s)) (- b s)))",
+                          2);
+    TEST_ASSERT(pid != -1, "server started");
+
+    res = ipc_test_eval("(set h (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected");
+    drop_obj(res);
+    res = ipc_test_eval("(set h2 (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected twice");
+    drop_obj(res);
+
+    // Served by the readers, the two connections at once
+    TEST_ASSERT_EQ("(set a (request h \"(g 5)\")) (set b (request h2 \"(g 6)\")) (+ (await h a) (await h2 b))", "11");
+    TEST_ASSERT_EQ("(write h \"(g 7)\")", "7");
+
+    // Writes run once, on the main thread, and try does not keep them on the reader
+    TEST_ASSERT_EQ("(write h \"(do (set n (+ n 1)) n)\")", "1");
+    TEST_ASSERT_EQ("(write h2 \"(try (do (set n (+ n 1)) n) (fn [e] 0))\")", "2");
+    TEST_ASSERT_EQ("(write h \"n\")", "2");
+
+    ipc_test_stop(pid, path);
+
+    PASS();
+#endif
+}
+
+test_result_t test_ipc_defer() {
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+    SKIP("no unix sockets on this platform");
+#else
+    c8_t path[128];
+    pid_t pid;
+    obj_p res;
+
+    ipc_test_path(path, sizeof(path), "defer");
+    pid = ipc_test_server(path,
+                          "(set d (fn [x] (set v x) (set k (defer)) (timer 20 1 (fn [t] (respond k (* v 10))))))"
+                          "(set fail (fn [x] (set e (defer)) (timer 20 1 (fn [t] (respond e \"boom\" true)))))",
+                          0);
+    TEST_ASSERT(pid != -1, "server started");
+
+    res = ipc_test_eval("(set h (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected");
+    drop_obj(res);
+
+    // Answered later by a timer, the caller waits for it
+    TEST_ASSERT_EQ("(write h \"(d 4)\")", "40");
+    TEST_ASSERT_EQ("(write h \"(d 5)\")", "50");
+
+    // An error response reaches the caller as an error
+    res = eval_str("(write h \"(fail 0)\")");
+    TEST_ASSERT(IS_ERR(res), "deferred error");
+    drop_obj(res);
+
+    // The connection serves on after both
+    TEST_ASSERT_EQ("(write h \"(+ 1 2)\")", "3");
+
+    ipc_test_stop(pid, path);
+
+    PASS();
+#endif
+}
+
+test_result_t test_ipc_pipeline() {
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+    SKIP("no unix sockets on this platform");
+#else
+    c8_t path[128];
+    pid_t pid;
+    obj_p res;
+
+    ipc_test_path(path, sizeof(path), "pipeline");
+    pid = ipc_test_server(path,
+                          "(set ks (list))"
+                          "(set q (fn [x] (set ks (concat ks (list (defer)))) x))"
+                          "(set answer (fn [x] (respond (at ks 1) 20) (respond (at ks 0) 10) (set ks (list)) 0))",
+                          0);
+    TEST_ASSERT(pid != -1, "server started");
+
+    res = ipc_test_eval("(set h (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected");
+    drop_obj(res);
+
+    // Several requests in flight, each answer picked by its id
+    TEST_ASSERT_EQ("(set a (request h \"(+ 1 2)\")) (set b (request h \"(* 2 3)\")) (await h b)", "6");
+    TEST_ASSERT_EQ("(await h a)", "3");
+
+    // Answered in the reverse order, awaited in the order asked
+    TEST_ASSERT_EQ("(set a (request h \"(q 1)\")) (set b (request h \"(q 2)\")) (write h \"(answer 0)\")", "0");
+    TEST_ASSERT_EQ("(await h (concat a b))", "(list 10 20)");
+
+    // Plain sync calls go on in between
+    TEST_ASSERT_EQ("(write h \"(+ 2 2)\")", "4");
+
+    // An id already awaited, or never given, is an error instead of a wait
+    TEST_ASSERT_EQ("(set a (request h \"(+ 3 4)\")) (await h a)", "7");
+    TEST_ASSERT_ER("(await h a)", "index");
+    TEST_ASSERT_ER("(await h 1000)", "index");
+    TEST_ASSERT_EQ("(await h (request h \"(+ 4 4)\"))", "8");
+
+    ipc_test_stop(pid, path);
+
+    PASS();
+#endif
+}
+
+test_result_t test_ipc_pubsub() {
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+    SKIP("no unix sockets on this platform");
+#else
+    c8_t path[128];
+    pid_t pid;
+    obj_p res;
+
+    // A subscriber more than a MB behind is cut
+    setenv("PUBSUB_QUEUE_MB", "1", 1);
+    ipc_test_path(path, sizeof(path), "pubsub");
+    pid = ipc_test_server(path,
+                          "(set later (fn [x] (set v x) (set k (defer)) (timer 100 1 (fn [t] (respond k v)))))"
+                          "(set big (table [sym p] (list (take ['a 'b] 1000000) (til 1000000))))",
+                          0);
+    unsetenv("PUBSUB_QUEUE_MB");
+    TEST_ASSERT(pid != -1, "server started");
+
+    res = ipc_test_eval("(set h (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected");
+    drop_obj(res);
+    res = ipc_test_eval("(set h2 (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected twice");
+    drop_obj(res);
+
+    res = eval_str("(set got 0) (set upd (fn [t x] (set got (+ got (count x)))))");
+    TEST_ASSERT(!IS_ERR(res), "define upd");
+    drop_obj(res);
+
+    // Sent once 3 rows are in
+    TEST_ASSERT_EQ("(write h \"(subscribe 'trade null 0 3)\")", "null");
+    TEST_ASSERT_EQ("(write h \"(publish 'trade (table [sym p] (list ['a 'b] [1 2])))\") got", "0");
+    TEST_ASSERT_EQ("(write h \"(publish 'trade (table [sym p] (list ['a] [3])))\") got", "3");
+
+    // Sent once the first pending row waited 20 ms
+    TEST_ASSERT_EQ("(write h \"(subscribe 'trade null 20 0)\")", "null");
+    TEST_ASSERT_EQ("(write h \"(publish 'trade (table [sym p] (list ['a] [4])))\") got", "3");
+    TEST_ASSERT_EQ("(write h \"(later 0)\") got", "4");
+
+    // A publish that fails for one topic of the table leaves the others as they were
+    TEST_ASSERT_EQ("(write h \"(subscribe 'quote null 0 2)\")", "null");
+    TEST_ASSERT_EQ("(write h2 \"(subscribe 'quote 'zzz)\")", "null");
+    res = eval_str("(write h \"(publish 'quote (table [p] (list [1])))\")");
+    TEST_ASSERT(IS_ERR(res), "no sym column");
+    drop_obj(res);
+    TEST_ASSERT_EQ("(write h \"(publish 'quote (table [sym p] (list ['a] [2])))\") got", "4");
+    TEST_ASSERT_EQ("(write h \"(publish 'quote (table [sym p] (list ['b] [3])))\") got", "6");
+
+    // h2 never reads what it is sent while h publishes
+    TEST_ASSERT_EQ("(write h2 \"(subscribe 'trade)\")", "null");
+    TEST_ASSERT_EQ("(write h \"(publish 'trade big)\") (write h \"(publish 'trade big)\") (write h \"(later 1)\")", "1");
+    res = eval_str("(write h2 \"(+ 1 2)\")");
+    TEST_ASSERT(IS_ERR(res), "slow subscriber cut");
+    drop_obj(res);
+
+    // The one that kept up is still served
+    TEST_ASSERT_EQ("(write h \"(+ 1 2)\")", "3");
+
+    ipc_test_stop(pid, path);
+
+    PASS();
+#endif
+}
+
+test_result_t test_ipc_hqueue() {
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+    SKIP("no send queues on this platform");
+#else
+    c8_t path[128];
+    pid_t pid;
+    obj_p res;
+
+    // Three 8 MB messages at once to a queue of one, the limits lifted again for the response
+    ipc_test_path(path, sizeof(path), "hqueue");
+    pid = ipc_test_server(path,
+                          "(set big (til 1000000))"
+                          "(set burst (fn [p] (hqueue c 0 1 p)"
+                          " (write (neg c) (list 'inc big)) (write (neg c) (list 'inc big)) (write (neg c) (list 'inc big))"
+                          " (set d (at (hqueue c) 'dropped)) (hqueue c 0 0 'drop) d))",
+                          0);
+    TEST_ASSERT(pid != -1, "server started");
+
+    res = ipc_test_eval("(set h (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected");
+    drop_obj(res);
+
+    res = eval_str("(set cnt 0) (set inc (fn [x] (set cnt (+ cnt 1))))");
+    TEST_ASSERT(!IS_ERR(res), "define inc");
+    drop_obj(res);
+
+    TEST_ASSERT_EQ("(hqueue h 1024 0 'block) (at (hqueue h) 'max-bytes)", "1024");
+    TEST_ASSERT_EQ("(hqueue h 0 0 'drop) (at (hqueue h) 'policy)", "'drop");
+    TEST_ASSERT_ER("(hqueue h 0 0 'wait)", "value");
+
+    res = eval_str("(write h \"(set c .z.w)\")");
+    TEST_ASSERT(!IS_ERR(res), "server keeps its handle of the client");
+    drop_obj(res);
+
+    // The first is let in, the others do not fit
+    TEST_ASSERT_EQ("(write h \"(burst 'drop)\")", "2");
+    TEST_ASSERT_EQ("cnt", "1");
+
+    // Waits for the client to take each in, none more dropped
+    TEST_ASSERT_EQ("(write h \"(burst 'block)\")", "2");
+    TEST_ASSERT_EQ("cnt", "4");
+
+    // The connection goes, the server stays
+    res = eval_str("(write h \"(burst 'disconnect)\")");
+    TEST_ASSERT(IS_ERR(res), "disconnected");
+    drop_obj(res);
+
+    res = ipc_test_eval("(set h (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected again");
+    drop_obj(res);
+    TEST_ASSERT_EQ("(write h \"(+ 1 2)\")", "3");
+
+    ipc_test_stop(pid, path);
+
+    PASS();
+#endif
+}
+
+test_result_t test_ipc_unix() {
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+    SKIP("no unix sockets on this platform");
+#else
+    c8_t path[128];
+    pid_t pid;
+    obj_p res;
+
+    ipc_test_path(path, sizeof(path), "unix");
+    pid = ipc_test_server(path, "(set n 0) (set total (fn [x] (sum x)))", 0);
+    TEST_ASSERT(pid != -1, "server started");
+
+    res = ipc_test_eval("(set h (hopen \"unix:%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected");
+    drop_obj(res);
+    res = ipc_test_eval("(set h2 (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected by url");
+    drop_obj(res);
+
+    TEST_ASSERT_EQ("(write h \"(+ 1 2)\")", "3");
+    TEST_ASSERT_EQ("(write (neg h2) \"(set n 5)\") (write h2 \"n\")", "5");
+
+    // Larger than a socket buffer either way
+    TEST_ASSERT_EQ("(write h \"(count (til 2000000))\")", "2000000");
+    TEST_ASSERT_EQ("(sum (write h \"(til 2000000)\"))", "1999999000000");
+    TEST_ASSERT_EQ("(write h (list 'total (til 2000000)))", "1999999000000");
+
+    res = eval_str("(hclose h) (write h \"1\")");
+    TEST_ASSERT(IS_ERR(res), "closed");
+    drop_obj(res);
+    TEST_ASSERT_EQ("(write h2 \"(+ 2 2)\")", "4");
+
+    ipc_test_stop(pid, path);
+
+    res = ipc_test_eval("(hopen \"unix://%s\")", path);
+    TEST_ASSERT(IS_ERR(res), "nothing listens");
+    drop_obj(res);
+
+#ifdef OS_LINUX
+    // Abstract names leave no file behind
+    snprintf(path, sizeof(path), "@rayforce-unix-%d", getpid());
+    pid = ipc_test_server(path, "(set n 0)", 0);
+    TEST_ASSERT(pid != -1, "abstract server started");
+
+    res = ipc_test_eval("(set h (hopen \"unix:%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected to an abstract name");
+    drop_obj(res);
+    TEST_ASSERT_EQ("(write h \"(+ 1 2)\")", "3");
+
+    ipc_test_stop(pid, path);
+#endif
+
+    PASS();
+#endif
+}
+
+test_result_t test_ipc_shm() {
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+    SKIP("no shared memory rings on this platform");
+#else
+    c8_t path[128];
+    pid_t pid;
+    obj_p res;
+
+    ipc_test_path(path, sizeof(path), "shm");
+    pid = ipc_test_server(path, "(set n 0) (set total (fn [x] (sum x)))", 0);
+    TEST_ASSERT(pid != -1, "server started");
+
+    res = ipc_test_eval("(set h (hopen \"shm://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected");
+    drop_obj(res);
+
+    TEST_ASSERT_EQ("(write h \"(+ 1 2)\")", "3");
+    TEST_ASSERT_EQ("(write (neg h) \"(set n 5)\") (write (neg h) \"(set n (+ n 1))\") (write h \"n\")", "6");
+
+    // Many times the ring either way, passed through in parts
+    TEST_ASSERT_EQ("(sum (write h \"(til 2000000)\"))", "1999999000000");
+    TEST_ASSERT_EQ("(write h (list 'total (til 2000000)))", "1999999000000");
+
+    // A socket connection to the same server alongside
+    res = ipc_test_eval("(set h2 (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected over the socket");
+    drop_obj(res);
+    TEST_ASSERT_EQ("(+ (write h \"n\") (write h2 \"n\"))", "12");
+
+    res = eval_str("(hclose h) (write h \"1\")");
+    TEST_ASSERT(IS_ERR(res), "closed");
+    drop_obj(res);
+    TEST_ASSERT_EQ("(write h2 \"(+ 2 2)\")", "4");
+
+    ipc_test_stop(pid, path);
+
+    PASS();
+#endif
+}
+
+test_result_t test_ipc_stream() {
+#if defined(OS_WINDOWS) || defined(OS_WASM)
+    SKIP("no unix sockets on this platform");
+#else
+    c8_t path[128];
+    pid_t pid;
+    obj_p res;
+
+    ipc_test_path(path, sizeof(path), "stream");
+    pid = ipc_test_server(path,
+                          "(set t (table [sym p] (list (take ['a 'b 'c] 1000) (til 1000))))"
+                          "(set big (table [sym p] (list (take ['a 'b] 1000000) (til 1000000))))",
+                          0);
+    TEST_ASSERT(pid != -1, "server started");
+
+    res = ipc_test_eval("(set h (hopen \"unix://%s\"))", path);
+    TEST_ASSERT(!IS_ERR(res), "connected");
+    drop_obj(res);
+
+    // Without a function the parts make the table up again
+    TEST_ASSERT_EQ("(set r (stream h \"t\" 100)) (count r)", "1000");
+    TEST_ASSERT_EQ("(sum (at r 'p))", "499500");
+    TEST_ASSERT_EQ("(set r (stream h 't 100)) (at r 'sym)", "(take ['a 'b 'c] 1000)");
+
+    // With one each part is passed to it
+    res = eval_str("(set rows 0) (set parts 0) (set f (fn [x] (set parts (+ parts 1)) (set rows (+ rows (count x)))))");
+    TEST_ASSERT(!IS_ERR(res), "define f");
+    drop_obj(res);
+    TEST_ASSERT_EQ("(stream h \"t\" 100 f)", "1000");
+    TEST_ASSERT_EQ("(list parts rows)", "(list 10 1000)");
+
+    // Results that fit in a part, or are not tables, come whole
+    TEST_ASSERT_EQ("(set parts 0) (stream h \"t\" 5000 f) parts", "1");
+    TEST_ASSERT_EQ("(stream h \"(+ 1 2)\" 10)", "3");
+
+    // A function that fails gives its error, the rest of the parts are dropped
+    res = eval_str("(stream h \"t\" 100 (fn [x] (+ 1 'a)))");
+    TEST_ASSERT(IS_ERR(res), "function failed");
+    drop_obj(res);
+    TEST_ASSERT_EQ("(write h \"(+ 1 2)\")", "3");
+
+    // Paced by what the client took in
+    TEST_ASSERT_EQ("(sum (at (stream h \"big\" 100000) 'p))", "499999500000");
+
+    ipc_test_stop(pid, path);
+
+    PASS();
+#endif
+}
@@ -41,6 +41,10 @@
 #include "../core/sys.h"
 #include "../core/eval.h"
 #include "../core/error.h"
+#include "../core/spill.h"
+#include "../core/compress.h"
+#include "../core/serve.h"
+#include "../core/sock.h"
 
 typedef enum test_status_t { TEST_PASS = 0, TEST_FAIL, TEST_SKIP } test_status_t;
 
@@ -174,6 +178,7 @@ nil_t on_skip(str_p msg) { printf("%sSkipped%s (%s)\n", YELLOW, RESET, msg ? msg
 #include "lang.c"
 #include "serde.c"
 #include "parted.c"
+#include "ipc.c"
 
 // Add tests here
 test_entry_t tests[] = {
@@ -189,6 +194,13 @@ test_entry_t tests[] = {
     {"test_realloc_same_size", test_realloc_same_size},
     {"test_alloc_dealloc_stress", test_alloc_dealloc_stress},
     {"test_allocate_and_free_obj", test_allocate_and_free_obj},
+    {"test_query_limit", test_query_limit},
+    {"test_query_arena", test_query_arena},
+    {"test_alloc_profile", test_alloc_profile},
+    {"test_heap_slabs", test_heap_slabs},
+    {"test_heap_scavenge", test_heap_scavenge},
+    {"test_heap_remote_free", test_heap_remote_free},
+    {"test_soft_limit_spill", test_soft_limit_spill},
     {"test_hash", test_hash},
     {"test_env", test_env},
     {"test_sort_asc", test_sort_asc},
@@ -196,7 +208,9 @@ test_entry_t tests[] = {
     {"test_asc_desc", test_asc_desc},
     {"test_sort_xasc", test_sort_xasc},
     {"test_sort_xdesc", test_sort_xdesc},
+    {"test_sort_spill", test_sort_spill},
     {"test_rank_xrank", test_rank_xrank},
+    {"test_symbol_ranks", test_symbol_ranks},
     {"test_reverse", test_reverse},
     {"test_str_match", test_str_match},
     {"test_lang_map", test_lang_map},
@@ -210,6 +224,9 @@ test_entry_t tests[] = {
     {"test_lang_cmp", test_lang_cmp},
     {"test_lang_split", test_lang_split},
     {"test_serde_different_sizes", test_serde_different_sizes},
+    {"test_serde_split", test_serde_split},
+    {"test_serde_view", test_serde_view},
+    {"test_serde_compress", test_serde_compress},
     {"test_lang_distinct", test_lang_distinct},
     {"test_lang_concat", test_lang_concat},
     {"test_lang_raze", test_lang_raze},
@@ -240,6 +257,16 @@ test_entry_t tests[] = {
     {"test_lang_do_let", test_lang_do_let},
     {"test_lang_error", test_lang_error},
     {"test_lang_safety", test_lang_safety},
+    // IPC tests
+    {"test_serve_readers", test_serve_readers},
+    {"test_ipc_readers", test_ipc_readers},
+    {"test_ipc_defer", test_ipc_defer},
+    {"test_ipc_pipeline", test_ipc_pipeline},
+    {"test_ipc_pubsub", test_ipc_pubsub},
+    {"test_ipc_hqueue", test_ipc_hqueue},
+    {"test_ipc_unix", test_ipc_unix},
+    {"test_ipc_shm", test_ipc_shm},
+    {"test_ipc_stream", test_ipc_stream},
     // Parted table tests
     {"test_parted_load", test_parted_load},
     {"test_parted_select_where_date", test_parted_select_where_date},
@@ -405,9 +432,14 @@ test_entry_t tests[] = {
 };
 // ---
 
-i32_t main() {
+i32_t main(i32_t argc, str_p argv[]) {
     i32_t i, num_tests, num_passed = 0, num_skipped = 0;
 
+    if (argc > 1)
+        return ipc_test_serve(argc, argv);
+
+    __IPC_TEST_EXE = argv[0];
+
     num_tests = sizeof(tests) / sizeof(test_entry_t);
     printf("%sTotal tests: %s%d\n", YELLOW, RESET, num_tests);
 
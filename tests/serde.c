@@ -36,4 +36,174 @@ test_result_t test_serde_different_sizes() {
     TEST_ASSERT(size == size1, "size != size1");
 
     PASS();
-}
\ No newline at end of file
+}
+test_result_t test_serde_split() {
+    i64_t i, j, size, skip, at, len;
+    u8_t *full, *part;
+    obj_p x, a, b;
+    struct ser_refs_t refs = {0};
+
+    a = vector(TYPE_I64, 20000);
+    b = vector(TYPE_F64, 10000);
+    for (i = 0; i < 20000; i++)
+        AS_I64(a)[i] = i * 7;
+    for (i = 0; i < 10000; i++)
+        AS_F64(b)[i] = i / 3.0;
+
+    x = vn_list(4, a, string_from_str("abc", 3), clone_obj(b), b);
+
+    size = size_obj(x);
+    full = heap_alloc(size);
+    ser_raw(full, x);
+
+    // Payloads left out of the split stream must land back exactly where ser_raw put them
+    skip = ser_refs(x, &refs);
+    TEST_ASSERT(refs.n == 3, "three payloads are referenced");
+    TEST_ASSERT(skip == 20000 * 8 + 2 * 10000 * 8, "skipped bytes");
+
+    part = heap_alloc(size - skip);
+    refs.base = part;
+    TEST_ASSERT(ser_raw_split(part, x, &refs) == size - skip, "inline size");
+    TEST_ASSERT(refs.k == refs.n, "all payloads placed");
+
+    for (i = 0, j = 0, at = 0; i < refs.n; i++) {
+        TEST_ASSERT(memcmp(full + j, part + at, refs.offs[i] - at) == 0, "inline bytes");
+        j += refs.offs[i] - at;
+        at = refs.offs[i];
+        len = refs.objs[i]->len * size_of_type(refs.objs[i]->type);
+        TEST_ASSERT(memcmp(full + j, AS_U8(refs.objs[i]), len) == 0, "payload bytes");
+        j += len;
+    }
+    TEST_ASSERT(memcmp(full + j, part + at, size - skip - at) == 0, "tail bytes");
+
+    heap_free(full);
+    heap_free(part);
+    drop_obj(x);
+
+    PASS();
+}
+
+test_result_t test_serde_view() {
+    i64_t i, j, size, skip, at, len;
+    u8_t *part, *msg;
+    i64_t *owner;
+    obj_p x, a, b, r;
+    struct ser_refs_t refs = {0};
+
+    a = vector(TYPE_I64, 20000);
+    b = vector(TYPE_F64, 10000);
+    for (i = 0; i < 20000; i++)
+        AS_I64(a)[i] = i * 7;
+    for (i = 0; i < 10000; i++)
+        AS_F64(b)[i] = i / 3.0;
+
+    x = vn_list(3, a, string_from_str("abc", 3), b);
+
+    refs.aligned = B8_TRUE;
+    size = size_obj(x);
+    skip = ser_refs(x, &refs);
+    part = heap_alloc(size - skip + refs.pad);
+    refs.base = part;
+    len = ser_raw_split(part, x, &refs);
+
+    // Put the stream together the way the receiver sees it, right after the owner's count
+    owner = heap_alloc(16 + len + skip);
+    msg = (u8_t *)owner + 16;
+    for (i = 0, j = 0, at = 0; i < refs.n; i++) {
+        memcpy(msg + j, part + at, refs.offs[i] - at);
+        j += refs.offs[i] - at;
+        at = refs.offs[i];
+        size = refs.objs[i]->len * size_of_type(refs.objs[i]->type);
+        memcpy(msg + j, AS_U8(refs.objs[i]), size);
+        j += size;
+    }
+    memcpy(msg + j, part + at, len - at);
+    heap_free(part);
+
+    *owner = 1;
+    size = len + skip;
+    r = de_raw_view(msg, &size, owner);
+
+    TEST_ASSERT(size == 0, "whole stream decoded");
+    TEST_ASSERT(*owner == 3, "both payloads are views");
+    TEST_ASSERT(IS_EXTERNAL_VIEW(AS_LIST(r)[0]) && IS_EXTERNAL_VIEW(AS_LIST(r)[2]), "views");
+    TEST_ASSERT(((i64_t)AS_I64(AS_LIST(r)[0]) & 15) == 0, "aligned payload");
+    TEST_ASSERT(memcmp(AS_I64(AS_LIST(r)[0]), AS_I64(a), 20000 * 8) == 0, "i64 payload");
+    TEST_ASSERT(memcmp(AS_F64(AS_LIST(r)[2]), AS_F64(b), 10000 * 8) == 0, "f64 payload");
+    TEST_ASSERT(AS_LIST(r)[1]->len == 3, "inline string");
+
+    // Growing a view copies it out of the buffer
+    a = clone_obj(AS_LIST(r)[0]);
+    drop_obj(r);
+    TEST_ASSERT(*owner == 2, "one view left");
+    i = 1;
+    push_raw(&a, &i);
+    TEST_ASSERT(IS_INTERNAL(a) && a->len == 20001 && AS_I64(a)[19999] == 19999 * 7, "copied on resize");
+    TEST_ASSERT(*owner == 1, "no views left");
+
+    drop_obj(a);
+    heap_free(owner);
+    drop_obj(x);
+
+    PASS();
+}
+
+test_result_t test_serde_compress() {
+    i64_t i, size, len, raw, cap;
+    u64_t seed;
+    u8_t *buf, *frame, *out;
+    obj_p x, a, b, r;
+    struct ser_refs_t refs = {0};
+
+    // A few blocks worth of timestamps and prices, the sort of thing a large result carries
+    a = vector(TYPE_TIMESTAMP, 300000);
+    b = vector(TYPE_F64, 300000);
+    for (i = 0; i < 300000; i++) {
+        AS_TIMESTAMP(a)[i] = 1700000000000000000ll + i * 1000000ll + (i % 7);
+        AS_F64(b)[i] = 100.0 + (i % 1000) / 100.0;
+    }
+
+    x = vn_list(3, a, string_from_str("abc", 3), b);
+
+    size = size_obj(x);
+    buf = heap_alloc(size);
+    refs.base = buf;
+    refs.filter = B8_TRUE;
+    TEST_ASSERT(ser_raw_split(buf, x, &refs) == size, "filters keep the size");
+
+    cap = compress_frame_bound(size);
+    frame = heap_alloc(cap);
+    len = compress_frame(buf, size, frame, cap);
+    TEST_ASSERT(len > 0 && len < size / 4, "filtered columns compress");
+    TEST_ASSERT(decompress_frame_size(frame, len) == size, "frame size");
+
+    out = heap_alloc(size);
+    TEST_ASSERT(decompress_frame(frame, len, out, size) == size, "frame decompressed");
+    TEST_ASSERT(memcmp(buf, out, size) == 0, "frame round trip");
+    TEST_ASSERT(decompress_frame(frame, len - 1, out, size) == -1, "truncated frame is rejected");
+
+    raw = size;
+    r = de_raw(out, &raw);
+    TEST_ASSERT(r->type == TYPE_LIST && r->len == 3, "list decoded");
+    TEST_ASSERT(memcmp(AS_TIMESTAMP(AS_LIST(r)[0]), AS_TIMESTAMP(a), 300000 * 8) == 0, "delta undone");
+    TEST_ASSERT(memcmp(AS_F64(AS_LIST(r)[2]), AS_F64(b), 300000 * 8) == 0, "shuffle undone");
+    drop_obj(r);
+
+    // Noise does not shrink and is stored as is
+    for (i = 0, seed = 88172645463325252ull; i < size; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        buf[i] = (u8_t)seed;
+    }
+    len = compress_frame(buf, size, frame, cap);
+    TEST_ASSERT(len > size && len <= cap, "stored blocks");
+    TEST_ASSERT(decompress_frame(frame, len, out, size) == size && memcmp(buf, out, size) == 0, "stored round trip");
+
+    heap_free(buf);
+    heap_free(frame);
+    heap_free(out);
+    drop_obj(x);
+
+    PASS();
+}
@@ -225,6 +225,14 @@ test_result_t test_sort_xasc() {
         "(table ['sym 'time 'price] (list ['AAPL 'AAPL 'GOOG] [09:30:00.000 10:30:00.000 11:00:00.000] [140.0 150.5 "
         "2800.0]))");
 
+    // Test multi-column sort with nulls, negatives and floats
+    TEST_ASSERT_EQ("(xasc (table ['a 'b] (list [2 0Nl -1 2] [0Nf 1.5 -2.0 -3.0])) ['a 'b])",
+                   "(table ['a 'b] (list [0Nl -1 2 2] [1.5 -2.0 0Nf -3.0]))");
+    TEST_ASSERT_EQ("(xasc (table ['s 'd 't] (list ['b 'a 'b 'a] [2024.01.02 2024.01.02 2024.01.01 2024.01.02] [3 2 1 0])) "
+                   "['d 's 't])",
+                   "(table ['s 'd 't] (list ['b 'a 'a 'b] [2024.01.01 2024.01.02 2024.01.02 2024.01.02] [1 0 2 3]))");
+    TEST_ASSERT_EQ("(take (at (xasc (table ['a 'b] (list (% (til 100000) 7) (til 100000))) ['a 'b]) 'b) 3)", "[0 7 14]");
+
     // Test sorting by empty vector of symbols [] - should return original table
     TEST_ASSERT_EQ(
         "(xasc (table ['sym 'time 'price] (list ['AAPL 'GOOG 'MSFT] [10:30:00.000 09:30:00.000 11:00:00.000] [150.5 "
@@ -280,6 +288,12 @@ test_result_t test_sort_xdesc() {
         "(table ['sym 'time 'price] (list ['GOOG 'AAPL 'AAPL] [11:00:00.000 10:30:00.000 09:30:00.000] [2800.0 150.5 "
         "140.0]))");
 
+    // Test multi-column sort with nulls, negatives and floats in descending order
+    TEST_ASSERT_EQ("(xdesc (table ['a 'b] (list [2 0Nl -1 2] [0Nf 1.5 -2.0 -3.0])) ['a 'b])",
+                   "(table ['a 'b] (list [2 2 -1 0Nl] [-3.0 0Nf -2.0 1.5]))");
+    TEST_ASSERT_EQ("(take (at (xdesc (table ['a 'b] (list (% (til 100000) 7) (til 100000))) ['a 'b]) 'b) 3)",
+                   "[99994 99987 99980]");
+
     // Test sorting by empty vector of symbols [] - should return original table
     TEST_ASSERT_EQ(
         "(xdesc (table ['sym 'time 'price] (list ['AAPL 'GOOG 'MSFT] [10:30:00.000 09:30:00.000 11:00:00.000] [150.5 "
@@ -297,6 +311,38 @@ test_result_t test_sort_timsort_symbols() {
     TEST_ASSERT_EQ("(iasc (list 'single))", "[0]");
     TEST_ASSERT_EQ("(asc (list 'single))", "(list 'single)");
 
+    // Larger vectors are ordered by lexical rank, not by interning order
+    TEST_ASSERT_EQ("(take (iasc (take ['zq27 'aq27 'mq27] 40)) 3)", "[1 4 7]");
+    TEST_ASSERT_EQ("(take (idesc (take ['zq27 'aq27 'mq27] 40)) 3)", "[0 3 6]");
+    TEST_ASSERT_EQ("(take (asc (take ['zq27 'aq27 'mq27 'zq28 'aq26] 50)) 11)",
+                   "['aq26 'aq26 'aq26 'aq26 'aq26 'aq26 'aq26 'aq26 'aq26 'aq26 'aq27]");
+    TEST_ASSERT_EQ("(xasc (table ['s 'v] (list (take ['zq27 'aq27 'mq27] 40) (til 40))) ['s 'v])",
+                   "(xasc (table ['s 'v] (list (take ['zq27 'aq27 'mq27] 40) (til 40))) 's)");
+
+    PASS();
+}
+
+test_result_t test_sort_spill() {
+    // Force every sort and group-by over the tiny budget through the on-disk path
+    TEST_ASSERT_EQ("(set w (* 7919 (til 200000)))", "(* 7919 (til 200000))");
+    TEST_ASSERT_EQ("(set v (% w 100003))", "(% w 100003)");
+    TEST_ASSERT_EQ("(set t (table ['a 'b] (list (% (til 200000) 7) (til 200000))))",
+                   "(table ['a 'b] (list (% (til 200000) 7) (til 200000)))");
+    TEST_ASSERT_EQ("(set r0 (iasc v))", "(iasc v)");
+    spill_set_budget(1);
+
+    TEST_ASSERT_EQ("(count (where (== r0 (iasc v))))", "200000");
+    TEST_ASSERT_EQ("(take (iasc v) 3)", "[0 100003 47318]");
+    TEST_ASSERT_EQ("(take (asc v) 5)", "[0 0 1 1 2]");
+    TEST_ASSERT_EQ("(first (idesc v))", "52685");
+    TEST_ASSERT_EQ("(take (at (xasc t ['a 'b]) 'b) 3)", "[0 7 14]");
+    TEST_ASSERT_EQ("(take (at (xdesc t ['a 'b]) 'b) 3)", "[199996 199989 199982]");
+    TEST_ASSERT_EQ("(set k (* 1000003 (% v 1000)))", "(* 1000003 (% v 1000))");
+    TEST_ASSERT_EQ("(take (key (group k)) 3)", "[0 919002757 838002514]");
+    TEST_ASSERT_EQ("(take (at (group k) 919002757) 3)", "[1 518 8827]");
+    TEST_ASSERT_EQ("(count (group k))", "1000");
+
+    spill_set_budget(0);
     PASS();
 }
 
@@ -325,6 +371,30 @@ test_result_t test_rank_xrank() {
     PASS();
 }
 
+test_result_t test_symbol_ranks() {
+    i64_t b, c;
+    u32_t *r1, *r2;
+    symbols_p symbols = runtime_get()->symbols;
+
+    b = symbols_intern("ranks_b", 7);
+    c = symbols_intern("ranks_c", 7);
+    r1 = symbols_ranks(symbols);
+    TEST_ASSERT(SYMBOL_RANK(symbols, r1, b) + 1 == SYMBOL_RANK(symbols, r1, c), "b is ranked right before c");
+
+    // A new symbol in between gets a new table, the one still read is left as it was
+    symbols_intern("ranks_bb", 8);
+    r2 = symbols_ranks(symbols);
+    TEST_ASSERT(r1 != r2, "r1 != r2");
+    TEST_ASSERT(SYMBOL_RANK(symbols, r1, b) + 1 == SYMBOL_RANK(symbols, r1, c), "r1 is unchanged");
+    TEST_ASSERT(SYMBOL_RANK(symbols, r2, b) + 2 == SYMBOL_RANK(symbols, r2, c), "r2 ranks bb between b and c");
+    symbols_ranks_done(symbols);
+    symbols_ranks_done(symbols);
+
+    TEST_ASSERT_EQ("(asc ['ranks_c 'ranks_bb 'ranks_b])", "['ranks_b 'ranks_bb 'ranks_c]");
+
+    PASS();
+}
+
 test_result_t test_reverse() {
     // strings (C8)
     TEST_ASSERT_EQ("(reverse \"hello\")", "\"olleh\"");